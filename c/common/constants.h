@@ -36,6 +36,27 @@
 /* "code length of 8 is repeated" */
 #define BROTLI_INITIAL_REPEATED_CODE_LENGTH 8
 
+/* Content size metadata block, see BROTLI_PARAM_CONTENT_SIZE.
+
+   Payload of the first metablock (metadata) is the signature "BRSZ" followed
+   by 64-bit little-endian uncompressed size. Longer payloads are allowed;
+   bytes after the size are reserved for future extensions. */
+#define BROTLI_CONTENT_SIZE_SIGNATURE 0x5A535242u  /* "BRSZ", little-endian */
+#define BROTLI_CONTENT_SIZE_BLOCK_SIZE 12
+
+/* Seek table metadata block, see BROTLI_PARAM_SEGMENT_SIZE.
+
+   Seekable stream ends with the seek table metadata block followed by an
+   empty last metablock (single 0x03 byte). Payload of the block is a sequence
+   of (compressed offset, uncompressed offset) pairs of 64-bit little-endian
+   integers, one per segment, then 32-bit little-endian number of segments and
+   the signature "BRST". Metadata block payload is limited to 2**24 bytes. */
+#define BROTLI_SEEK_TABLE_SIGNATURE 0x54535242u  /* "BRST", little-endian */
+#define BROTLI_SEEK_TABLE_ENTRY_SIZE 16
+#define BROTLI_SEEK_TABLE_TAIL_SIZE 8
+#define BROTLI_SEEK_TABLE_MAX_SEGMENTS \
+  (((1u << 24) - BROTLI_SEEK_TABLE_TAIL_SIZE) / BROTLI_SEEK_TABLE_ENTRY_SIZE)
+
 /* "Large Window Brotli" */
 
 /**
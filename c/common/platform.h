@@ -15,9 +15,15 @@
     * BROTLI_BUILD_PORTABLE disables dangerous optimizations, like unaligned
       read and overlapping memcpy; this reduces decompression speed by 5%
     * BROTLI_BUILD_NO_RBIT disables "rbit" optimization for ARM CPUs
+    * BROTLI_BUILD_NO_BMI2 disables run-time selection of BMI2 decoder code
+      for x86-64 CPUs
     * BROTLI_DEBUG dumps file name and line number when decoder detects stream
       or memory error
     * BROTLI_ENABLE_LOG enables asserts and dumps various state information
+    * BROTLI_ENCODER_STATS collects per-stage encoder timings and counters,
+      reported by BrotliEncoderGetStats
+    * BROTLI_DECODER_STATS collects decoder hot-path counters, reported by
+      BrotliDecoderGetStats
 */
 
 #ifndef BROTLI_COMMON_PLATFORM_H_
@@ -83,6 +89,15 @@ OR:
 #define BROTLI_PREDICT_TRUE(x) (x)
 #endif
 
+/* BROTLI_PREFETCH(ADDR) hints that the memory at |ADDR| is going to be read
+   soon; it is never dereferenced, so any address is acceptable. */
+#if BROTLI_GNUC_HAS_BUILTIN(__builtin_prefetch, 3, 1, 0) || \
+    BROTLI_INTEL_VERSION_CHECK(16, 0, 0)
+#define BROTLI_PREFETCH(ADDR) __builtin_prefetch(ADDR)
+#else
+#define BROTLI_PREFETCH(ADDR)
+#endif
+
 #if defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 199901L) && \
     !defined(__cplusplus)
 #define BROTLI_RESTRICT restrict
@@ -215,6 +230,23 @@ OR:
 #define BROTLI_TARGET_X64
 #endif
 
+#if defined(__SSSE3__)
+#define BROTLI_TARGET_SSSE3
+#endif
+
+/* BMI2 (SHRX, BZHI) makes variable shifts and masks single instructions.
+   If the build does not target BMI2, the decoder hot loop is compiled once
+   more with BROTLI_BMI2_TARGET_ATTRIBUTE and selected at run time. */
+#if defined(__BMI2__)
+#define BROTLI_TARGET_BMI2
+#elif defined(BROTLI_TARGET_X64) && !defined(BROTLI_BUILD_NO_BMI2) && \
+    BROTLI_GNUC_HAS_ATTRIBUTE(target, 4, 9, 0) &&                     \
+    BROTLI_GNUC_HAS_BUILTIN(__builtin_cpu_supports, 4, 9, 0)
+#define BROTLI_BMI2_DISPATCH
+#define BROTLI_BMI2_TARGET_ATTRIBUTE __attribute__((target("bmi2")))
+#define BROTLI_CPU_HAS_BMI2() (!!__builtin_cpu_supports("bmi2"))
+#endif
+
 #if defined(__PPC64__)
 #define BROTLI_TARGET_POWERPC64
 #endif
@@ -459,7 +491,9 @@ static BROTLI_INLINE void BROTLI_UNALIGNED_STORE64LE(void* p, uint64_t v) {
 #define BROTLI_IS_CONSTANT(x) (!!0)
 #endif
 
-#if defined(BROTLI_TARGET_ARMV7) || defined(BROTLI_TARGET_ARMV8_ANY)
+/* BZHI on x86 with BMI2 is the counterpart of ARM UBFX. */
+#if defined(BROTLI_TARGET_ARMV7) || defined(BROTLI_TARGET_ARMV8_ANY) || \
+    defined(BROTLI_TARGET_BMI2)
 #define BROTLI_HAS_UBFX (!!1)
 #else
 #define BROTLI_HAS_UBFX (!!0)
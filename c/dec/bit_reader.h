@@ -41,6 +41,17 @@ static BROTLI_INLINE uint32_t BitMask(uint32_t n) {
   }
 }
 
+/* Same as BitMask, but the expression is chosen by the |bmi2| compile-time
+   parameter: code instantiated for BMI2 targets computes the mask with
+   a single BZHI instruction instead of a table look-up. */
+static BROTLI_INLINE uint32_t BitMaskFor(int bmi2, uint32_t n) {
+  if (bmi2) {
+    return ~((0xFFFFFFFFu) << n);
+  } else {
+    return BitMask(n);
+  }
+}
+
 typedef struct {
   brotli_reg_t val_;       /* pre-fetched bits */
   uint32_t bit_pos_;       /* current bit-reading position in val_ */
@@ -240,24 +251,30 @@ static BROTLI_INLINE void BrotliBitReaderUnload(BrotliBitReader* br) {
 
 /* Reads the specified number of bits from |br| and advances the bit pos.
    Precondition: accumulator MUST contain at least |n_bits|. */
-static BROTLI_INLINE void BrotliTakeBits(
+static BROTLI_INLINE void BrotliTakeBitsInternal(int bmi2,
   BrotliBitReader* const br, uint32_t n_bits, uint32_t* val) {
-  *val = (uint32_t)BrotliGetBitsUnmasked(br) & BitMask(n_bits);
+  *val = (uint32_t)BrotliGetBitsUnmasked(br) & BitMaskFor(bmi2, n_bits);
   BROTLI_LOG(("[BrotliTakeBits]  %d %d %d val: %6x\n",
       (int)br->avail_in, (int)br->bit_pos_, (int)n_bits, (int)*val));
   BrotliDropBits(br, n_bits);
 }
 
+static BROTLI_INLINE void BrotliTakeBits(
+  BrotliBitReader* const br, uint32_t n_bits, uint32_t* val) {
+  BrotliTakeBitsInternal(0, br, n_bits, val);
+}
+
 /* Reads the specified number of bits from |br| and advances the bit pos.
    Assumes that there is enough input to perform BrotliFillBitWindow.
-   Up to 24 bits are allowed to be requested from this method. */
+   Up to 24 bits are allowed to be requested from this method.
+   |bmi2| is a compile-time parameter, see BitMaskFor. */
 static BROTLI_INLINE uint32_t BrotliReadBits24(
-    BrotliBitReader* const br, uint32_t n_bits) {
+    int bmi2, BrotliBitReader* const br, uint32_t n_bits) {
   BROTLI_DCHECK(n_bits <= 24);
   if (BROTLI_64_BITS || (n_bits <= 16)) {
     uint32_t val;
     BrotliFillBitWindow(br, n_bits);
-    BrotliTakeBits(br, n_bits, &val);
+    BrotliTakeBitsInternal(bmi2, br, n_bits, &val);
     return val;
   } else {
     uint32_t low_val;
@@ -265,19 +282,19 @@ static BROTLI_INLINE uint32_t BrotliReadBits24(
     BrotliFillBitWindow(br, 16);
     BrotliTakeBits(br, 16, &low_val);
     BrotliFillBitWindow(br, 8);
-    BrotliTakeBits(br, n_bits - 16, &high_val);
+    BrotliTakeBitsInternal(bmi2, br, n_bits - 16, &high_val);
     return low_val | (high_val << 16);
   }
 }
 
 /* Same as BrotliReadBits24, but allows reading up to 32 bits. */
 static BROTLI_INLINE uint32_t BrotliReadBits32(
-    BrotliBitReader* const br, uint32_t n_bits) {
+    int bmi2, BrotliBitReader* const br, uint32_t n_bits) {
   BROTLI_DCHECK(n_bits <= 32);
   if (BROTLI_64_BITS || (n_bits <= 16)) {
     uint32_t val;
     BrotliFillBitWindow(br, n_bits);
-    BrotliTakeBits(br, n_bits, &val);
+    BrotliTakeBitsInternal(bmi2, br, n_bits, &val);
     return val;
   } else {
     uint32_t low_val;
@@ -285,7 +302,7 @@ static BROTLI_INLINE uint32_t BrotliReadBits32(
     BrotliFillBitWindow(br, 16);
     BrotliTakeBits(br, 16, &low_val);
     BrotliFillBitWindow(br, 16);
-    BrotliTakeBits(br, n_bits - 16, &high_val);
+    BrotliTakeBitsInternal(bmi2, br, n_bits - 16, &high_val);
     return low_val | (high_val << 16);
   }
 }
@@ -333,6 +350,16 @@ static BROTLI_INLINE BROTLI_BOOL BrotliJumpToByteBoundary(BrotliBitReader* br) {
   return TO_BROTLI_BOOL(pad_bits == 0);
 }
 
+/* Skips |num| input bytes; same requirements as for BrotliCopyBytes apply. */
+static BROTLI_INLINE void BrotliSkipBytes(BrotliBitReader* br, size_t num) {
+  while (BrotliGetAvailableBits(br) >= 8 && num > 0) {
+    BrotliDropBits(br, 8);
+    --num;
+  }
+  br->avail_in -= num;
+  br->next_in += num;
+}
+
 /* Copies remaining input bytes stored in the bit reader to the output. Value
    |num| may not be larger than BrotliGetRemainingBytes. The bit reader must be
    warmed up again after this. */
@@ -22,6 +22,8 @@
 
 #if defined(BROTLI_TARGET_NEON)
 #include <arm_neon.h>
+#elif defined(BROTLI_TARGET_SSSE3)
+#include <tmmintrin.h>
 #endif
 
 #if defined(__cplusplus) || defined(c_plusplus)
@@ -45,6 +47,19 @@ extern "C" {
         5 prefix + 24 base + 8 suffix */
 static const uint32_t kRingBufferWriteAheadSlack = 42;
 
+/* Literal pair tables are built only for metablocks with a few literal trees
+   and enough data to amortize the construction. */
+static const uint32_t kMaxLiteralPairTables = 4;
+static const int kMinBytesPerLiteralPairTable = 1 << 15;
+
+/* Huffman table cache is used only for short metablocks, where building
+   tables takes a noticeable share of decoding time. */
+static const int kHuffmanCacheMaxMetablockLength = 1 << 16;
+
+/* Sources of copies that are at least that far behind are likely to be out
+   of cache; they are prefetched while the literals are being decoded. */
+static const int kMinPrefetchDistance = 1 << 16;
+
 static const uint8_t kCodeLengthCodeOrder[BROTLI_CODE_LENGTH_CODES] = {
   1, 2, 3, 4, 0, 5, 17, 6, 16, 7, 8, 9, 10, 11, 12, 13, 14, 15,
 };
@@ -70,6 +85,10 @@ BROTLI_BOOL BrotliDecoderSetParameter(
       state->large_window = TO_BROTLI_BOOL(!!value);
       return BROTLI_TRUE;
 
+    case BROTLI_DECODER_PARAM_VALIDATE_ONLY:
+      state->validate_only = TO_BROTLI_BOOL(!!value);
+      return BROTLI_TRUE;
+
     default: return BROTLI_FALSE;
   }
 }
@@ -177,6 +196,76 @@ static BROTLI_INLINE void memmove16(uint8_t* dst, uint8_t* src) {
 #endif
 }
 
+#if defined(BROTLI_TARGET_SSSE3)
+/* Shuffle masks that repeat first |distance| bytes, for distances 0..15. */
+static const uint8_t kPatternShuffle[16][16] = {
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+  {0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1},
+  {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+  {0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0},
+  {0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1},
+  {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1},
+  {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0}
+};
+#endif
+
+/* Copies |length| bytes from |dst - distance| to |dst|, when regions overlap,
+   i.e. 0 < distance < length; the result repeats first |distance| bytes.
+   Like the fast copy path, it may write up to 15 bytes past the end. */
+static BROTLI_INLINE void CopyRepeatedPattern(
+    uint8_t* dst, int distance, int length) {
+  uint8_t* src = dst - distance;
+  if (distance == 1) {
+    memset(dst, src[0], (size_t)length);
+  } else if (distance < 16) {
+    /* Largest multiple of |distance| that fits 16 bytes. */
+    int period = 16 - (16 % distance);
+#if defined(BROTLI_TARGET_SSSE3)
+    __m128i pattern = _mm_shuffle_epi8(
+        _mm_loadu_si128((const __m128i*)(const void*)src),
+        _mm_loadu_si128(
+            (const __m128i*)(const void*)kPatternShuffle[distance]));
+    while (length > 2 * period) {
+      _mm_storeu_si128((__m128i*)(void*)dst, pattern);
+      _mm_storeu_si128((__m128i*)(void*)(dst + period), pattern);
+      dst += 2 * period;
+      length -= 2 * period;
+    }
+    while (length > 0) {
+      _mm_storeu_si128((__m128i*)(void*)dst, pattern);
+      dst += period;
+      length -= period;
+    }
+#else
+    uint8_t pattern[16];
+    int k;
+    for (k = 0; k < 16; ++k) pattern[k] = src[k % distance];
+    while (length > 0) {
+      memcpy(dst, pattern, 16);
+      dst += period;
+      length -= period;
+    }
+#endif
+  } else {
+    /* Every 16-byte chunk of source is complete before it is read. */
+    while (length > 0) {
+      memmove16(dst, src);
+      dst += 16;
+      src += 16;
+      length -= 16;
+    }
+  }
+}
+
 /* Decodes a number in the range [0..255], by reading 1 - 11 bits. */
 static BROTLI_NOINLINE BrotliDecoderErrorCode DecodeVarLenUint8(
     BrotliDecoderState* s, BrotliBitReader* br, uint32_t* value) {
@@ -345,7 +434,7 @@ static BrotliDecoderErrorCode BROTLI_NOINLINE DecodeMetaBlockLength(
    This method doesn't read data from the bit reader, BUT drops the amount of
    bits that correspond to the decoded symbol.
    bits MUST contain at least 15 (BROTLI_HUFFMAN_MAX_CODE_LENGTH) valid bits. */
-static BROTLI_INLINE uint32_t DecodeSymbol(uint32_t bits,
+static BROTLI_INLINE uint32_t DecodeSymbol(int bmi2, uint32_t bits,
                                            const HuffmanCode* table,
                                            BrotliBitReader* br) {
   BROTLI_HC_MARK_TABLE_FOR_FAST_LOAD(table);
@@ -355,17 +444,18 @@ static BROTLI_INLINE uint32_t DecodeSymbol(uint32_t bits,
     BrotliDropBits(br, HUFFMAN_TABLE_BITS);
     BROTLI_HC_ADJUST_TABLE_INDEX(table,
         BROTLI_HC_FAST_LOAD_VALUE(table) +
-        ((bits >> HUFFMAN_TABLE_BITS) & BitMask(nbits)));
+        ((bits >> HUFFMAN_TABLE_BITS) & BitMaskFor(bmi2, nbits)));
   }
   BrotliDropBits(br, BROTLI_HC_FAST_LOAD_BITS(table));
   return BROTLI_HC_FAST_LOAD_VALUE(table);
 }
 
 /* Reads and decodes the next Huffman code from bit-stream.
-   This method peeks 16 bits of input and drops 0 - 15 of them. */
-static BROTLI_INLINE uint32_t ReadSymbol(const HuffmanCode* table,
+   This method peeks 16 bits of input and drops 0 - 15 of them.
+   |bmi2| is a compile-time parameter, see BitMaskFor. */
+static BROTLI_INLINE uint32_t ReadSymbol(int bmi2, const HuffmanCode* table,
                                          BrotliBitReader* br) {
-  return DecodeSymbol(BrotliGet16BitsUnmasked(br), table, br);
+  return DecodeSymbol(bmi2, BrotliGet16BitsUnmasked(br), table, br);
 }
 
 /* Same as DecodeSymbol, but it is known that there is less than 15 bits of
@@ -414,7 +504,7 @@ static BROTLI_INLINE BROTLI_BOOL SafeReadSymbol(
     const HuffmanCode* table, BrotliBitReader* br, uint32_t* result) {
   uint32_t val;
   if (BROTLI_PREDICT_TRUE(BrotliSafeGetBits(br, 15, &val))) {
-    *result = DecodeSymbol(val, table, br);
+    *result = DecodeSymbol(0, val, table, br);
     return BROTLI_TRUE;
   }
   return SafeDecodeSymbol(table, br, result);
@@ -437,7 +527,8 @@ static BROTLI_INLINE void PreloadSymbol(int safe,
 
 /* Decodes the next Huffman code using data prepared by PreloadSymbol.
    Reads 0 - 15 bits. Also peeks 8 following bits. */
-static BROTLI_INLINE uint32_t ReadPreloadedSymbol(const HuffmanCode* table,
+static BROTLI_INLINE uint32_t ReadPreloadedSymbol(int bmi2,
+                                                  const HuffmanCode* table,
                                                   BrotliBitReader* br,
                                                   uint32_t* bits,
                                                   uint32_t* value) {
@@ -445,7 +536,7 @@ static BROTLI_INLINE uint32_t ReadPreloadedSymbol(const HuffmanCode* table,
   if (BROTLI_PREDICT_FALSE(*bits > HUFFMAN_TABLE_BITS)) {
     uint32_t val = BrotliGet16BitsUnmasked(br);
     const HuffmanCode* ext = table + (val & HUFFMAN_TABLE_MASK) + *value;
-    uint32_t mask = BitMask((*bits - HUFFMAN_TABLE_BITS));
+    uint32_t mask = BitMaskFor(bmi2, *bits - HUFFMAN_TABLE_BITS);
     BROTLI_HC_MARK_TABLE_FOR_FAST_LOAD(ext);
     BrotliDropBits(br, HUFFMAN_TABLE_BITS);
     BROTLI_HC_ADJUST_TABLE_INDEX(ext, (val >> HUFFMAN_TABLE_BITS) & mask);
@@ -732,6 +823,155 @@ static BrotliDecoderErrorCode ReadCodeLengthCodeLengths(BrotliDecoderState* s) {
   return BROTLI_DECODER_SUCCESS;
 }
 
+/* Describes the code that is about to be built in h->huffman_cache_key:
+   simple codes are a marker with the number of symbols followed by symbols;
+   complex codes are symbols in table construction order, with code length in
+   the upper bits. Returns the number of key items. */
+static uint32_t DescribeHuffmanCode(BrotliMetablockHeaderArena* h,
+                                    BROTLI_BOOL simple) {
+  uint16_t* key = h->huffman_cache_key;
+  uint32_t size = 0;
+  if (simple) {
+    uint32_t num_symbols = h->symbol == 4 ? 4 : h->symbol + 1;
+    uint32_t i;
+    key[size++] = (uint16_t)(0x8000 | h->symbol);
+    for (i = 0; i < num_symbols; ++i) {
+      key[size++] = h->symbols_lists_array[i];
+    }
+  } else {
+    uint32_t len;
+    for (len = 1; len <= BROTLI_HUFFMAN_MAX_CODE_LENGTH; ++len) {
+      int symbol = (int)len - (BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1);
+      uint32_t n;
+      for (n = h->code_length_histo[len]; n != 0; --n) {
+        symbol = h->symbol_lists[symbol];
+        key[size++] = (uint16_t)((uint32_t)symbol | (len << 11));
+      }
+    }
+  }
+  return size;
+}
+
+/* Cheap fingerprint of the code that is about to be built: symbols of a simple
+   code, or population count and last symbol for each code length. */
+static uint32_t HashHuffmanCode(const BrotliMetablockHeaderArena* h,
+                                BROTLI_BOOL simple) {
+  uint32_t hash = 0;
+  uint32_t i;
+  if (simple) {
+    uint32_t num_symbols = h->symbol == 4 ? 4 : h->symbol + 1;
+    hash = 0x8000 | h->symbol;
+    for (i = 0; i < num_symbols; ++i) {
+      hash = (hash ^ h->symbols_lists_array[i]) * 0x9E3779B1u;
+    }
+  } else {
+    for (i = 1; i <= BROTLI_HUFFMAN_MAX_CODE_LENGTH; ++i) {
+      hash = (hash ^ h->code_length_histo[i]) * 0x9E3779B1u;
+      hash = (hash ^ (uint32_t)h->next_symbol[i]) * 0x9E3779B1u;
+    }
+  }
+  return hash;
+}
+
+/* Looks up the table for the code that is about to be built. On hit returns
+   the cached table. On miss returns NULL; if the code has been seen before,
+   |slot| is set to the entry that should store its table, otherwise the code
+   is remembered and |slot| is set to -1. Storing a table only on the second
+   sighting, and comparing full descriptions only on fingerprint match, keeps
+   misses cheap for streams that never repeat a code. |key_size| is set once
+   the code is described in h->huffman_cache_key. */
+static HuffmanCode* LookupHuffmanCache(BrotliDecoderState* s,
+    BROTLI_BOOL simple, uint32_t hash, uint32_t* key_size, int* slot) {
+  BrotliMetablockHeaderArena* h = &s->arena.header;
+  uint32_t oldest = 0;
+  int victim = -1;
+  int i;
+  *slot = -1;
+  for (i = 0; i < BROTLI_HUFFMAN_CACHE_SIZE; ++i) {
+    BrotliHuffmanCacheEntry* entry = &s->huffman_cache[i];
+    uint32_t age = s->metablock_sequence - entry->last_used;
+    if (entry->last_used != 0 && entry->hash == hash) {
+      if (entry->table_size == 0) {
+        *slot = i;
+        return NULL;
+      }
+      if (*key_size == 0) *key_size = DescribeHuffmanCode(h, simple);
+      if (entry->key_size == *key_size &&
+          memcmp(&entry->table[entry->table_size], h->huffman_cache_key,
+                 *key_size * sizeof(uint16_t)) == 0) {
+        entry->last_used = s->metablock_sequence;
+        return entry->table;
+      }
+    }
+    if (entry->last_used == 0) age = 0xFFFFFFFFu;
+    if (age > oldest) {
+      oldest = age;
+      victim = i;
+    }
+  }
+  if (victim >= 0) {
+    BrotliHuffmanCacheEntry* entry = &s->huffman_cache[victim];
+    entry->hash = hash;
+    entry->table_size = 0;
+    entry->last_used = s->metablock_sequence;
+  }
+  return NULL;
+}
+
+/* Stores a copy of the freshly built table. Failure to allocate is not an
+   error: the table is just not cached. */
+static void StoreHuffmanCache(BrotliDecoderState* s, int slot,
+    uint32_t key_size, const HuffmanCode* table, uint32_t table_size) {
+  BrotliHuffmanCacheEntry* entry = &s->huffman_cache[slot];
+  size_t table_bytes = table_size * sizeof(HuffmanCode);
+  size_t size = table_bytes + key_size * sizeof(uint16_t);
+  if (entry->capacity < size) {
+    BROTLI_DECODER_FREE(s, entry->table);
+    entry->capacity = 0;
+    entry->table = (HuffmanCode*)BROTLI_DECODER_ALLOC(s, size);
+    if (!entry->table) return;
+    entry->capacity = size;
+  }
+  entry->last_used = s->metablock_sequence;
+  entry->key_size = key_size;
+  entry->table_size = table_size;
+  memcpy(entry->table, table, table_bytes);
+  memcpy(&entry->table[table_size], s->arena.header.huffman_cache_key,
+         key_size * sizeof(uint16_t));
+}
+
+/* Builds the table for the code that has been read, unless a table for the
+   same code is found in cache; then |*opt_cached_table| points to it and
+   nothing is written to |table|. */
+static uint32_t BuildHuffmanTableCached(BrotliDecoderState* s,
+    BROTLI_BOOL simple, HuffmanCode* table, HuffmanCode** opt_cached_table) {
+  BrotliMetablockHeaderArena* h = &s->arena.header;
+  uint32_t key_size = 0;
+  uint32_t table_size;
+  int slot = -1;
+  if (opt_cached_table) {
+    *opt_cached_table = LookupHuffmanCache(
+        s, simple, HashHuffmanCode(h, simple), &key_size, &slot);
+    if (*opt_cached_table) {
+      BROTLI_DECODER_STATS_ADD(s, huffman_cache_hits, 1);
+      return 0;
+    }
+    /* Table construction consumes code length counts. */
+    if (slot >= 0 && key_size == 0) key_size = DescribeHuffmanCode(h, simple);
+  }
+  if (simple) {
+    table_size = BrotliBuildSimpleHuffmanTable(
+        table, HUFFMAN_TABLE_BITS, h->symbols_lists_array, h->symbol);
+  } else {
+    table_size = BrotliBuildHuffmanTable(
+        table, HUFFMAN_TABLE_BITS, h->symbol_lists, h->code_length_histo);
+  }
+  if (slot >= 0) {
+    StoreHuffmanCache(s, slot, key_size, table, table_size);
+  }
+  return table_size;
+}
+
 /* Decodes the Huffman tables.
    There are 2 scenarios:
     A) Huffman code contains only few symbols (1..4). Those symbols are read
@@ -742,11 +982,15 @@ static BrotliDecoderErrorCode ReadCodeLengthCodeLengths(BrotliDecoderState* s) {
     B.1) Small Huffman table is decoded; it is specified with code lengths
          encoded with predefined entropy code. 32 - 74 bits are used.
     B.2) Decoded table is used to decode code lengths of symbols in resulting
-         Huffman table. In worst case 3520 bits are read. */
+         Huffman table. In worst case 3520 bits are read.
+
+   |opt_cached_table| enables the Huffman table cache; see
+   BuildHuffmanTableCached. */
 static BrotliDecoderErrorCode ReadHuffmanCode(uint32_t alphabet_size_max,
                                               uint32_t alphabet_size_limit,
                                               HuffmanCode* table,
                                               uint32_t* opt_table_size,
+                                              HuffmanCode** opt_cached_table,
                                               BrotliDecoderState* s) {
   BrotliBitReader* br = &s->br;
   BrotliMetablockHeaderArena* h = &s->arena.header;
@@ -802,8 +1046,8 @@ static BrotliDecoderErrorCode ReadHuffmanCode(uint32_t alphabet_size_max,
           h->symbol += bits;
         }
         BROTLI_LOG_UINT(h->symbol);
-        table_size = BrotliBuildSimpleHuffmanTable(
-            table, HUFFMAN_TABLE_BITS, h->symbols_lists_array, h->symbol);
+        table_size = BuildHuffmanTableCached(
+            s, BROTLI_TRUE, table, opt_cached_table);
         if (opt_table_size) {
           *opt_table_size = table_size;
         }
@@ -851,8 +1095,8 @@ static BrotliDecoderErrorCode ReadHuffmanCode(uint32_t alphabet_size_max,
           BROTLI_LOG(("[ReadHuffmanCode] space = %d\n", (int)h->space));
           return BROTLI_FAILURE(BROTLI_DECODER_ERROR_FORMAT_HUFFMAN_SPACE);
         }
-        table_size = BrotliBuildHuffmanTable(
-            table, HUFFMAN_TABLE_BITS, h->symbol_lists, h->code_length_histo);
+        table_size = BuildHuffmanTableCached(
+            s, BROTLI_FALSE, table, opt_cached_table);
         if (opt_table_size) {
           *opt_table_size = table_size;
         }
@@ -872,9 +1116,9 @@ static BROTLI_INLINE uint32_t ReadBlockLength(const HuffmanCode* table,
                                               BrotliBitReader* br) {
   uint32_t code;
   uint32_t nbits;
-  code = ReadSymbol(table, br);
+  code = ReadSymbol(0, table, br);
   nbits = kBlockLengthPrefixCode[code].nbits;  /* nbits == 2..24 */
-  return kBlockLengthPrefixCode[code].offset + BrotliReadBits24(br, nbits);
+  return kBlockLengthPrefixCode[code].offset + BrotliReadBits24(0, br, nbits);
 }
 
 /* WARNING: if state is not BROTLI_STATE_READ_BLOCK_LENGTH_NONE, then
@@ -966,11 +1210,20 @@ static BrotliDecoderErrorCode HuffmanTreeGroupDecode(
   }
   while (h->htree_index < group->num_htrees) {
     uint32_t table_size;
+    HuffmanCode* cached_table = NULL;
     BrotliDecoderErrorCode result = ReadHuffmanCode(group->alphabet_size_max,
-        group->alphabet_size_limit, h->next, &table_size, s);
+        group->alphabet_size_limit, h->next, &table_size,
+        s->meta_block_remaining_len <= kHuffmanCacheMaxMetablockLength ?
+            &cached_table : NULL, s);
     if (result != BROTLI_DECODER_SUCCESS) return result;
-    group->htrees[h->htree_index] = h->next;
-    h->next += table_size;
+    if (cached_table) {
+      group->htrees[h->htree_index] = cached_table;
+    } else {
+      BROTLI_DECODER_STATS_ADD(s, huffman_tables, 1);
+      BROTLI_DECODER_STATS_ADD(s, huffman_table_entries, table_size);
+      group->htrees[h->htree_index] = h->next;
+      h->next += table_size;
+    }
     ++h->htree_index;
   }
   h->substate_tree_group = BROTLI_STATE_TREE_GROUP_NONE;
@@ -1037,7 +1290,7 @@ static BrotliDecoderErrorCode DecodeContextMap(uint32_t context_map_size,
     case BROTLI_STATE_CONTEXT_MAP_HUFFMAN: {
       uint32_t alphabet_size = *num_htrees + h->max_run_length_prefix;
       result = ReadHuffmanCode(alphabet_size, alphabet_size,
-                               h->context_map_table, NULL, s);
+                               h->context_map_table, NULL, NULL, s);
       if (result != BROTLI_DECODER_SUCCESS) return result;
       h->code = 0xFFFF;
       h->substate_context_map = BROTLI_STATE_CONTEXT_MAP_DECODE;
@@ -1130,7 +1383,7 @@ static BROTLI_INLINE BROTLI_BOOL DecodeBlockTypeAndLength(
 
   /* Read 0..15 + 3..39 bits. */
   if (!safe) {
-    block_type = ReadSymbol(type_tree, br);
+    block_type = ReadSymbol(0, type_tree, br);
     s->block_length[tree_type] = ReadBlockLength(len_tree, br);
   } else {
     BrotliBitReaderState memento;
@@ -1155,6 +1408,7 @@ static BROTLI_INLINE BROTLI_BOOL DecodeBlockTypeAndLength(
   }
   ringbuffer[0] = ringbuffer[1];
   ringbuffer[1] = block_type;
+  BROTLI_DECODER_STATS_ADD(s, block_switches, 1);
   return BROTLI_TRUE;
 }
 
@@ -1176,6 +1430,32 @@ static BROTLI_INLINE void DetectTrivialLiteralBlockTypes(
   }
 }
 
+/* Builds literal pair tables, if those are expected to pay off. Tables are
+   only used by the fast path for block types without context modeling.
+   Allocation failure is not an error: decoding proceeds without tables. */
+static void BuildLiteralPairTables(BrotliDecoderState* s) {
+  uint32_t num_tables = s->num_literal_htrees;
+  uint32_t trivial = 0;
+  uint32_t i;
+  if (s->literal_pair_tables) return;
+  if (num_tables > kMaxLiteralPairTables) return;
+  if (s->meta_block_remaining_len <
+      (int)num_tables * kMinBytesPerLiteralPairTable) {
+    return;
+  }
+  for (i = 0; i < 8; ++i) trivial |= s->trivial_literal_contexts[i];
+  if (!trivial) return;
+  s->literal_pair_tables = (HuffmanLiteralPair*)BROTLI_DECODER_ALLOC(s,
+      sizeof(HuffmanLiteralPair) * num_tables *
+      BROTLI_LITERAL_PAIR_TABLE_SIZE);
+  if (!s->literal_pair_tables) return;
+  for (i = 0; i < num_tables; ++i) {
+    BrotliBuildLiteralPairTable(
+        &s->literal_pair_tables[(size_t)i << BROTLI_LITERAL_PAIR_TABLE_BITS],
+        s->literal_hgroup.htrees[i], HUFFMAN_TABLE_BITS);
+  }
+}
+
 static BROTLI_INLINE void PrepareLiteralDecoding(BrotliDecoderState* s) {
   uint8_t context_mode;
   size_t trivial;
@@ -1185,6 +1465,11 @@ static BROTLI_INLINE void PrepareLiteralDecoding(BrotliDecoderState* s) {
   trivial = s->trivial_literal_contexts[block_type >> 5];
   s->trivial_literal_context = (trivial >> (block_type & 31)) & 1;
   s->literal_htree = s->literal_hgroup.htrees[s->context_map_slice[0]];
+  s->literal_pair_table = NULL;
+  if (s->trivial_literal_context && s->literal_pair_tables) {
+    s->literal_pair_table = &s->literal_pair_tables[
+        (size_t)s->context_map_slice[0] << BROTLI_LITERAL_PAIR_TABLE_BITS];
+  }
   context_mode = s->context_modes[block_type] & 3;
   s->context_lookup = BROTLI_CONTEXT_LUT(context_mode);
 }
@@ -1264,25 +1549,35 @@ static size_t UnwrittenBytes(const BrotliDecoderState* s, BROTLI_BOOL wrap) {
 static BrotliDecoderErrorCode BROTLI_NOINLINE WriteRingBuffer(
     BrotliDecoderState* s, size_t* available_out, uint8_t** next_out,
     size_t* total_out, BROTLI_BOOL force) {
-  uint8_t* start =
-      s->ringbuffer + (s->partial_pos_out & (size_t)s->ringbuffer_mask);
+  uint8_t* start;
   size_t to_write = UnwrittenBytes(s, BROTLI_TRUE);
   size_t num_written = *available_out;
-  if (num_written > to_write) {
+  if (s->partial_pos_out < s->output_start) {
+    /* Drop data before the seek position, see BrotliDecoderSeek. */
+    size_t num_skipped = s->output_start - s->partial_pos_out;
+    if (num_skipped > to_write) num_skipped = to_write;
+    s->partial_pos_out += num_skipped;
+    to_write -= num_skipped;
+  }
+  start = s->ringbuffer + (s->partial_pos_out & (size_t)s->ringbuffer_mask);
+  if (num_written > to_write || s->validate_only) {
     num_written = to_write;
   }
   if (s->meta_block_remaining_len < 0) {
     return BROTLI_FAILURE(BROTLI_DECODER_ERROR_FORMAT_BLOCK_LENGTH_1);
   }
-  if (next_out && !*next_out) {
+  if (s->validate_only) {
+    /* Decoded data is discarded. */
+  } else if (next_out && !*next_out) {
     *next_out = start;
+    *available_out -= num_written;
   } else {
     if (next_out) {
       memcpy(*next_out, start, num_written);
       *next_out += num_written;
     }
+    *available_out -= num_written;
   }
-  *available_out -= num_written;
   BROTLI_LOG_UINT(to_write);
   BROTLI_LOG_UINT(num_written);
   s->partial_pos_out += num_written;
@@ -1349,6 +1644,54 @@ static BROTLI_BOOL BROTLI_NOINLINE BrotliEnsureRingBuffer(
   return BROTLI_TRUE;
 }
 
+/* Copies the head of an uncompressed metablock directly from input to output.
+
+   Only the last ring-buffer-size bytes of the metablock could be referenced
+   by subsequent metablocks; preceding bytes do not need to visit the ring
+   buffer. Direct copy is possible only when the ring buffer has reached its
+   final size, all of its content has been written out, and the caller
+   provided an output buffer; in validate-only mode those bytes are just
+   skipped. Position is advanced as if the bytes passed through the ring
+   buffer. Data before the seek position is left to the regular path. */
+static void PassThroughUncompressedBytes(size_t* available_out,
+    uint8_t** next_out, size_t* total_out, BrotliDecoderState* s) {
+  size_t nbytes;
+  if (s->ringbuffer_size != 1 << s->window_bits ||
+      s->meta_block_remaining_len <= s->ringbuffer_size ||
+      (!s->validate_only && (!next_out || !*next_out)) ||
+      s->should_wrap_ringbuffer || UnwrittenBytes(s, BROTLI_FALSE) != 0 ||
+      s->partial_pos_out < s->output_start) {
+    return;
+  }
+  nbytes = (size_t)(s->meta_block_remaining_len - s->ringbuffer_size);
+  if (nbytes > BrotliGetRemainingBytes(&s->br)) {
+    nbytes = BrotliGetRemainingBytes(&s->br);
+  }
+  if (!s->validate_only && nbytes > *available_out) {
+    nbytes = *available_out;
+  }
+  if (nbytes == 0) {
+    return;
+  }
+  if (s->validate_only) {
+    BrotliSkipBytes(&s->br, nbytes);
+  } else {
+    BrotliCopyBytes(*next_out, &s->br, nbytes);
+    *next_out += nbytes;
+    *available_out -= nbytes;
+  }
+  s->partial_pos_out += nbytes;
+  if (total_out) {
+    *total_out = s->partial_pos_out;
+  }
+  s->meta_block_remaining_len -= (int)nbytes;
+  s->pos += (int)nbytes;
+  s->rb_roundtrips += (size_t)(s->pos / s->ringbuffer_size);
+  s->pos &= s->ringbuffer_mask;
+  s->max_distance = s->max_backward_distance;
+  BROTLI_DECODER_STATS_ADD(s, passthrough_bytes, nbytes);
+}
+
 static BrotliDecoderErrorCode BROTLI_NOINLINE CopyUncompressedBlockToOutput(
     size_t* available_out, uint8_t** next_out, size_t* total_out,
     BrotliDecoderState* s) {
@@ -1361,7 +1704,9 @@ static BrotliDecoderErrorCode BROTLI_NOINLINE CopyUncompressedBlockToOutput(
   for (;;) {
     switch (s->substate_uncompressed) {
       case BROTLI_STATE_UNCOMPRESSED_NONE: {
-        int nbytes = (int)BrotliGetRemainingBytes(&s->br);
+        int nbytes;
+        PassThroughUncompressedBytes(available_out, next_out, total_out, s);
+        nbytes = (int)BrotliGetRemainingBytes(&s->br);
         if (nbytes > s->meta_block_remaining_len) {
           nbytes = s->meta_block_remaining_len;
         }
@@ -1613,14 +1958,14 @@ static void CalculateDistanceLut(BrotliDecoderState* s) {
 
 /* Precondition: s->distance_code < 0. */
 static BROTLI_INLINE BROTLI_BOOL ReadDistanceInternal(
-    int safe, BrotliDecoderState* s, BrotliBitReader* br) {
+    int safe, int bmi2, BrotliDecoderState* s, BrotliBitReader* br) {
   BrotliMetablockBodyArena* b = &s->arena.body;
   uint32_t code;
   uint32_t bits;
   BrotliBitReaderState memento;
   HuffmanCode* distance_tree = s->distance_hgroup.htrees[s->dist_htree_index];
   if (!safe) {
-    code = ReadSymbol(distance_tree, br);
+    code = ReadSymbol(bmi2, distance_tree, br);
   } else {
     BrotliBitReaderSaveState(br, &memento);
     if (!SafeReadSymbol(distance_tree, br, &code)) {
@@ -1637,7 +1982,7 @@ static BROTLI_INLINE BROTLI_BOOL ReadDistanceInternal(
     return BROTLI_TRUE;
   }
   if (!safe) {
-    bits = BrotliReadBits32(br, b->dist_extra_bits[code]);
+    bits = BrotliReadBits32(bmi2, br, b->dist_extra_bits[code]);
   } else {
     if (!SafeReadBits32(br, b->dist_extra_bits[code], &bits)) {
       ++s->block_length[2];
@@ -1651,24 +1996,24 @@ static BROTLI_INLINE BROTLI_BOOL ReadDistanceInternal(
 }
 
 static BROTLI_INLINE void ReadDistance(
-    BrotliDecoderState* s, BrotliBitReader* br) {
-  ReadDistanceInternal(0, s, br);
+    int bmi2, BrotliDecoderState* s, BrotliBitReader* br) {
+  ReadDistanceInternal(0, bmi2, s, br);
 }
 
 static BROTLI_INLINE BROTLI_BOOL SafeReadDistance(
-    BrotliDecoderState* s, BrotliBitReader* br) {
-  return ReadDistanceInternal(1, s, br);
+    int bmi2, BrotliDecoderState* s, BrotliBitReader* br) {
+  return ReadDistanceInternal(1, bmi2, s, br);
 }
 
-static BROTLI_INLINE BROTLI_BOOL ReadCommandInternal(
-    int safe, BrotliDecoderState* s, BrotliBitReader* br, int* insert_length) {
+static BROTLI_INLINE BROTLI_BOOL ReadCommandInternal(int safe, int bmi2,
+    BrotliDecoderState* s, BrotliBitReader* br, int* insert_length) {
   uint32_t cmd_code;
   uint32_t insert_len_extra = 0;
   uint32_t copy_length;
   CmdLutElement v;
   BrotliBitReaderState memento;
   if (!safe) {
-    cmd_code = ReadSymbol(s->htree_command, br);
+    cmd_code = ReadSymbol(bmi2, s->htree_command, br);
   } else {
     BrotliBitReaderSaveState(br, &memento);
     if (!SafeReadSymbol(s->htree_command, br, &cmd_code)) {
@@ -1682,9 +2027,10 @@ static BROTLI_INLINE BROTLI_BOOL ReadCommandInternal(
   *insert_length = v.insert_len_offset;
   if (!safe) {
     if (BROTLI_PREDICT_FALSE(v.insert_len_extra_bits != 0)) {
-      insert_len_extra = BrotliReadBits24(br, v.insert_len_extra_bits);
+      insert_len_extra =
+          BrotliReadBits24(bmi2, br, v.insert_len_extra_bits);
     }
-    copy_length = BrotliReadBits24(br, v.copy_len_extra_bits);
+    copy_length = BrotliReadBits24(bmi2, br, v.copy_len_extra_bits);
   } else {
     if (!SafeReadBits(br, v.insert_len_extra_bits, &insert_len_extra) ||
         !SafeReadBits(br, v.copy_len_extra_bits, &copy_length)) {
@@ -1698,14 +2044,14 @@ static BROTLI_INLINE BROTLI_BOOL ReadCommandInternal(
   return BROTLI_TRUE;
 }
 
-static BROTLI_INLINE void ReadCommand(
+static BROTLI_INLINE void ReadCommand(int bmi2,
     BrotliDecoderState* s, BrotliBitReader* br, int* insert_length) {
-  ReadCommandInternal(0, s, br, insert_length);
+  ReadCommandInternal(0, bmi2, s, br, insert_length);
 }
 
-static BROTLI_INLINE BROTLI_BOOL SafeReadCommand(
+static BROTLI_INLINE BROTLI_BOOL SafeReadCommand(int bmi2,
     BrotliDecoderState* s, BrotliBitReader* br, int* insert_length) {
-  return ReadCommandInternal(1, s, br, insert_length);
+  return ReadCommandInternal(1, bmi2, s, br, insert_length);
 }
 
 static BROTLI_INLINE BROTLI_BOOL CheckInputAmount(
@@ -1728,8 +2074,19 @@ static BROTLI_INLINE BROTLI_BOOL CheckInputAmount(
     }                                             \
   }
 
+/* Compile-time specializations of ProcessCommandsInternal; |shape| is
+   a combination of these flags, selected per metablock by
+   SelectCommandsShape. */
+/* Single literal block type and single literal tree. */
+#define BROTLI_SHAPE_SINGLE_LITERAL_TREE 1
+/* Single literal block type in UTF8 context mode, with context modeling. */
+#define BROTLI_SHAPE_UTF8_LITERALS 2
+/* Single distance block type. */
+#define BROTLI_SHAPE_NO_DISTANCE_SWITCH 4
+
+/* |bmi2| selects bit masking for BMI2 instantiation, see BitMaskFor. */
 static BROTLI_INLINE BrotliDecoderErrorCode ProcessCommandsInternal(
-    int safe, BrotliDecoderState* s) {
+    int safe, int bmi2, int shape, BrotliDecoderState* s) {
   int pos = s->pos;
   int i = s->loop_counter;
   BrotliDecoderErrorCode result = BROTLI_DECODER_SUCCESS;
@@ -1770,20 +2127,78 @@ CommandBegin:
     goto CommandBegin;
   }
   /* Read the insert/copy length in the command. */
-  BROTLI_SAFE(ReadCommand(s, br, &i));
+  BROTLI_SAFE(ReadCommand(bmi2, s, br, &i));
   BROTLI_LOG(("[ProcessCommandsInternal] pos = %d insert = %d copy = %d\n",
               pos, i, s->copy_length));
   if (i == 0) {
     goto CommandPostDecodeLiterals;
   }
   s->meta_block_remaining_len -= i;
+  BROTLI_DECODER_STATS_ADD(s, literal_bytes, i);
+  if (!safe && s->distance_code >= 0) {
+    /* Implicit distance is already known; warm up the copy source. */
+    int distance = s->dist_rb[(s->dist_rb_idx - 1) & 3];
+    if (distance >= kMinPrefetchDistance) {
+      const uint8_t* src =
+          &s->ringbuffer[(pos + i - distance) & s->ringbuffer_mask];
+      BROTLI_PREFETCH(src);
+      if (s->copy_length > 32) BROTLI_PREFETCH(src + 64);
+    }
+  }
 
 CommandInner:
   if (safe) {
     s->state = BROTLI_STATE_COMMAND_INNER;
   }
-  /* Read the literals in the command. */
-  if (s->trivial_literal_context) {
+  /* Read the literals in the command. With a single literal block type
+     block_length[0] can not run out within a metablock, so it is not
+     maintained. */
+  if (!(shape & BROTLI_SHAPE_UTF8_LITERALS) && !safe &&
+      s->literal_pair_table) {
+    do {
+      const HuffmanLiteralPair* pair;
+      if (!CheckInputAmount(safe, br, 28)) {  /* 162 bits + 7 bytes */
+        s->state = BROTLI_STATE_COMMAND_INNER;
+        result = BROTLI_DECODER_NEEDS_MORE_INPUT;
+        goto saveStateAndReturn;
+      }
+      if (!(shape & BROTLI_SHAPE_SINGLE_LITERAL_TREE) &&
+          BROTLI_PREDICT_FALSE(s->block_length[0] == 0)) {
+        BROTLI_SAFE(DecodeLiteralBlockSwitch(s));
+        if (!s->literal_pair_table) goto CommandInner;
+      }
+      pair = &s->literal_pair_table[
+          BrotliGet16BitsUnmasked(br) & BROTLI_LITERAL_PAIR_TABLE_MASK];
+      if (BROTLI_PREDICT_FALSE(
+          pair->first_bits > BROTLI_LITERAL_PAIR_TABLE_BITS)) {
+        s->ringbuffer[pos] = (uint8_t)ReadSymbol(bmi2, s->literal_htree, br);
+      } else if (pair->bits <= BROTLI_LITERAL_PAIR_TABLE_BITS && i > 1 &&
+                 ((shape & BROTLI_SHAPE_SINGLE_LITERAL_TREE) ||
+                     s->block_length[0] > 1) &&
+                 pos + 1 < s->ringbuffer_size) {
+        /* Both literals belong to the same command and block. */
+        BrotliDropBits(br, pair->bits);
+        s->ringbuffer[pos] = pair->literals[0];
+        if (!(shape & BROTLI_SHAPE_SINGLE_LITERAL_TREE)) --s->block_length[0];
+        BROTLI_LOG_ARRAY_INDEX(s->ringbuffer, pos);
+        ++pos;
+        --i;
+        s->ringbuffer[pos] = pair->literals[1];
+      } else {
+        BrotliDropBits(br, pair->first_bits);
+        s->ringbuffer[pos] = pair->literals[0];
+      }
+      if (!(shape & BROTLI_SHAPE_SINGLE_LITERAL_TREE)) --s->block_length[0];
+      BROTLI_LOG_ARRAY_INDEX(s->ringbuffer, pos);
+      ++pos;
+      if (BROTLI_PREDICT_FALSE(pos == s->ringbuffer_size)) {
+        s->state = BROTLI_STATE_COMMAND_INNER_WRITE;
+        --i;
+        goto saveStateAndReturn;
+      }
+    } while (--i != 0);
+  } else if (!(shape & BROTLI_SHAPE_UTF8_LITERALS) &&
+             s->trivial_literal_context) {
     uint32_t bits;
     uint32_t value;
     PreloadSymbol(safe, s->literal_htree, br, &bits, &value);
@@ -1793,14 +2208,17 @@ CommandInner:
         result = BROTLI_DECODER_NEEDS_MORE_INPUT;
         goto saveStateAndReturn;
       }
-      if (BROTLI_PREDICT_FALSE(s->block_length[0] == 0)) {
+      if (!(shape & BROTLI_SHAPE_SINGLE_LITERAL_TREE) &&
+          BROTLI_PREDICT_FALSE(s->block_length[0] == 0)) {
         BROTLI_SAFE(DecodeLiteralBlockSwitch(s));
         PreloadSymbol(safe, s->literal_htree, br, &bits, &value);
         if (!s->trivial_literal_context) goto CommandInner;
+        if (!safe && s->literal_pair_table) goto CommandInner;
       }
       if (!safe) {
         s->ringbuffer[pos] =
-            (uint8_t)ReadPreloadedSymbol(s->literal_htree, br, &bits, &value);
+            (uint8_t)ReadPreloadedSymbol(
+                bmi2, s->literal_htree, br, &bits, &value);
       } else {
         uint32_t literal;
         if (!SafeReadSymbol(s->literal_htree, br, &literal)) {
@@ -1809,7 +2227,7 @@ CommandInner:
         }
         s->ringbuffer[pos] = (uint8_t)literal;
       }
-      --s->block_length[0];
+      if (!(shape & BROTLI_SHAPE_SINGLE_LITERAL_TREE)) --s->block_length[0];
       BROTLI_LOG_ARRAY_INDEX(s->ringbuffer, pos);
       ++pos;
       if (BROTLI_PREDICT_FALSE(pos == s->ringbuffer_size)) {
@@ -1819,6 +2237,8 @@ CommandInner:
       }
     } while (--i != 0);
   } else {
+    ContextLut lut = (shape & BROTLI_SHAPE_UTF8_LITERALS) ?
+        BROTLI_CONTEXT_LUT(CONTEXT_UTF8) : s->context_lookup;
     uint8_t p1 = s->ringbuffer[(pos - 1) & s->ringbuffer_mask];
     uint8_t p2 = s->ringbuffer[(pos - 2) & s->ringbuffer_mask];
     do {
@@ -1829,16 +2249,18 @@ CommandInner:
         result = BROTLI_DECODER_NEEDS_MORE_INPUT;
         goto saveStateAndReturn;
       }
-      if (BROTLI_PREDICT_FALSE(s->block_length[0] == 0)) {
+      if (!(shape & BROTLI_SHAPE_UTF8_LITERALS) &&
+          BROTLI_PREDICT_FALSE(s->block_length[0] == 0)) {
         BROTLI_SAFE(DecodeLiteralBlockSwitch(s));
         if (s->trivial_literal_context) goto CommandInner;
+        lut = s->context_lookup;
       }
-      context = BROTLI_CONTEXT(p1, p2, s->context_lookup);
+      context = BROTLI_CONTEXT(p1, p2, lut);
       BROTLI_LOG_UINT(context);
       hc = s->literal_hgroup.htrees[s->context_map_slice[context]];
       p2 = p1;
       if (!safe) {
-        p1 = (uint8_t)ReadSymbol(hc, br);
+        p1 = (uint8_t)ReadSymbol(bmi2, hc, br);
       } else {
         uint32_t literal;
         if (!SafeReadSymbol(hc, br, &literal)) {
@@ -1848,7 +2270,7 @@ CommandInner:
         p1 = (uint8_t)literal;
       }
       s->ringbuffer[pos] = p1;
-      --s->block_length[0];
+      if (!(shape & BROTLI_SHAPE_UTF8_LITERALS)) --s->block_length[0];
       BROTLI_LOG_UINT(s->context_map_slice[context]);
       BROTLI_LOG_ARRAY_INDEX(s->ringbuffer, pos & s->ringbuffer_mask);
       ++pos;
@@ -1876,10 +2298,11 @@ CommandPostDecodeLiterals:
     s->distance_code = s->dist_rb[s->dist_rb_idx & 3];
   } else {
     /* Read distance code in the command, unless it was implicitly zero. */
-    if (BROTLI_PREDICT_FALSE(s->block_length[2] == 0)) {
+    if (!(shape & BROTLI_SHAPE_NO_DISTANCE_SWITCH) &&
+        BROTLI_PREDICT_FALSE(s->block_length[2] == 0)) {
       BROTLI_SAFE(DecodeDistanceBlockSwitch(s));
     }
-    BROTLI_SAFE(ReadDistance(s, br));
+    BROTLI_SAFE(ReadDistance(bmi2, s, br));
   }
   BROTLI_LOG(("[ProcessCommandsInternal] pos = %d distance = %d\n",
               pos, s->distance_code));
@@ -1908,7 +2331,7 @@ CommandPostDecodeLiterals:
       int offset = (int)s->dictionary->offsets_by_length[i];
       uint32_t shift = s->dictionary->size_bits_by_length[i];
 
-      int mask = (int)BitMask(shift);
+      int mask = (int)BitMaskFor(bmi2, shift);
       int word_idx = address & mask;
       int transform_idx = address >> shift;
       /* Compensate double distance-ring-buffer roll. */
@@ -1933,6 +2356,7 @@ CommandPostDecodeLiterals:
         }
         pos += len;
         s->meta_block_remaining_len -= len;
+        BROTLI_DECODER_STATS_ADD(s, dictionary_bytes, len);
         if (pos >= s->ringbuffer_size) {
           s->state = BROTLI_STATE_COMMAND_POST_WRITE_1;
           goto saveStateAndReturn;
@@ -1959,26 +2383,34 @@ CommandPostDecodeLiterals:
     s->dist_rb[s->dist_rb_idx & 3] = s->distance_code;
     ++s->dist_rb_idx;
     s->meta_block_remaining_len -= i;
+    BROTLI_DECODER_STATS_ADD(s, copy_bytes, i);
+    BROTLI_DECODER_STATS_ADD(s, num_copies, 1);
     /* There are 32+ bytes of slack in the ring-buffer allocation.
        Also, we have 16 short codes, that make these 16 bytes irrelevant
        in the ring-buffer. Let's copy over them as a first guess. */
     memmove16(copy_dst, copy_src);
     if (src_end > pos && dst_end > src_start) {
       /* Regions intersect. */
-      goto CommandPostWrapCopy;
-    }
-    if (dst_end >= s->ringbuffer_size || src_end >= s->ringbuffer_size) {
+      if (src_start > pos || dst_end >= s->ringbuffer_size) {
+        goto CommandPostWrapCopy;
+      }
+      /* Source directly precedes destination: repeat the pattern. */
+      CopyRepeatedPattern(copy_dst, pos - src_start, i);
+      pos += i;
+    } else if (dst_end >= s->ringbuffer_size ||
+               src_end >= s->ringbuffer_size) {
       /* At least one region wraps. */
       goto CommandPostWrapCopy;
-    }
-    pos += i;
-    if (i > 16) {
-      if (i > 32) {
-        memcpy(copy_dst + 16, copy_src + 16, (size_t)(i - 16));
-      } else {
-        /* This branch covers about 45% cases.
-           Fixed size short copy allows more compiler optimizations. */
-        memmove16(copy_dst + 16, copy_src + 16);
+    } else {
+      pos += i;
+      if (i > 16) {
+        if (i > 32) {
+          memcpy(copy_dst + 16, copy_src + 16, (size_t)(i - 16));
+        } else {
+          /* This branch covers about 45% cases.
+             Fixed size short copy allows more compiler optimizations. */
+          memmove16(copy_dst + 16, copy_src + 16);
+        }
       }
     }
   }
@@ -2019,14 +2451,66 @@ saveStateAndReturn:
 
 #undef BROTLI_SAFE
 
+/* Chooses the specialization of ProcessCommandsInternal for the metablock
+   that is about to be decoded. Only combinations instantiated in
+   ProcessCommandsShaped are produced. */
+static void SelectCommandsShape(BrotliDecoderState* s) {
+  int shape = 0;
+  if (s->num_block_types[2] == 1) {
+    shape |= BROTLI_SHAPE_NO_DISTANCE_SWITCH;
+    if (s->num_block_types[0] == 1) {
+      if (s->num_literal_htrees == 1) {
+        shape |= BROTLI_SHAPE_SINGLE_LITERAL_TREE;
+      } else if (!s->trivial_literal_context &&
+                 (s->context_modes[0] & 3) == CONTEXT_UTF8) {
+        shape |= BROTLI_SHAPE_UTF8_LITERALS;
+      }
+    }
+  }
+  s->commands_shape = shape;
+}
+
+static BROTLI_INLINE BrotliDecoderErrorCode ProcessCommandsShaped(
+    int bmi2, BrotliDecoderState* s) {
+  switch (s->commands_shape) {
+    case BROTLI_SHAPE_NO_DISTANCE_SWITCH | BROTLI_SHAPE_SINGLE_LITERAL_TREE:
+      return ProcessCommandsInternal(0, bmi2, BROTLI_SHAPE_NO_DISTANCE_SWITCH |
+          BROTLI_SHAPE_SINGLE_LITERAL_TREE, s);
+    case BROTLI_SHAPE_NO_DISTANCE_SWITCH | BROTLI_SHAPE_UTF8_LITERALS:
+      return ProcessCommandsInternal(0, bmi2, BROTLI_SHAPE_NO_DISTANCE_SWITCH |
+          BROTLI_SHAPE_UTF8_LITERALS, s);
+    case BROTLI_SHAPE_NO_DISTANCE_SWITCH:
+      return ProcessCommandsInternal(
+          0, bmi2, BROTLI_SHAPE_NO_DISTANCE_SWITCH, s);
+    default:
+      return ProcessCommandsInternal(0, bmi2, 0, s);
+  }
+}
+
+#undef BROTLI_SHAPE_SINGLE_LITERAL_TREE
+#undef BROTLI_SHAPE_UTF8_LITERALS
+#undef BROTLI_SHAPE_NO_DISTANCE_SWITCH
+
+#if defined(BROTLI_BMI2_DISPATCH)
+/* Same as ProcessCommands, but compiled for CPUs with BMI2. */
+static BROTLI_NOINLINE BROTLI_BMI2_TARGET_ATTRIBUTE BrotliDecoderErrorCode
+ProcessCommandsBmi2(BrotliDecoderState* s) {
+  return ProcessCommandsShaped(1, s);
+}
+#endif
+
 static BROTLI_NOINLINE BrotliDecoderErrorCode ProcessCommands(
     BrotliDecoderState* s) {
-  return ProcessCommandsInternal(0, s);
+#if defined(BROTLI_BMI2_DISPATCH)
+  if (BROTLI_CPU_HAS_BMI2()) return ProcessCommandsBmi2(s);
+#endif
+  return ProcessCommandsShaped(0, s);
 }
 
+/* Safe mode is used only near the end of input; it is not specialized. */
 static BROTLI_NOINLINE BrotliDecoderErrorCode SafeProcessCommands(
     BrotliDecoderState* s) {
-  return ProcessCommandsInternal(1, s);
+  return ProcessCommandsInternal(1, 0, 0, s);
 }
 
 BrotliDecoderResult BrotliDecoderDecompress(
@@ -2052,6 +2536,332 @@ BrotliDecoderResult BrotliDecoderDecompress(
   return result;
 }
 
+/* Returns the number of bytes the current metablock is still going to produce.
+   Returns 0 if the metablock header has not been fully read yet, or if the
+   metablock does not produce any output. */
+static size_t PendingMetaBlockBytes(const BrotliDecoderState* s) {
+  size_t pending;
+  switch (s->state) {
+    case BROTLI_STATE_METABLOCK_HEADER_2:
+    case BROTLI_STATE_CONTEXT_MODES:
+    case BROTLI_STATE_COMMAND_BEGIN:
+    case BROTLI_STATE_COMMAND_POST_DECODE_LITERALS:
+    case BROTLI_STATE_COMMAND_POST_WRITE_1:
+    case BROTLI_STATE_UNCOMPRESSED:
+    case BROTLI_STATE_BEFORE_COMPRESSED_METABLOCK_HEADER:
+    case BROTLI_STATE_HUFFMAN_CODE_0:
+    case BROTLI_STATE_HUFFMAN_CODE_1:
+    case BROTLI_STATE_HUFFMAN_CODE_2:
+    case BROTLI_STATE_HUFFMAN_CODE_3:
+    case BROTLI_STATE_CONTEXT_MAP_1:
+    case BROTLI_STATE_CONTEXT_MAP_2:
+    case BROTLI_STATE_TREE_GROUP:
+    case BROTLI_STATE_BEFORE_COMPRESSED_METABLOCK_BODY:
+      pending = 0;
+      break;
+
+    /* Length of the command being decoded is already subtracted from the
+       metablock length; |loop_counter| holds the part not produced yet. */
+    case BROTLI_STATE_COMMAND_INNER:
+    case BROTLI_STATE_COMMAND_INNER_WRITE:
+    case BROTLI_STATE_COMMAND_POST_WRAP_COPY:
+    case BROTLI_STATE_COMMAND_POST_WRITE_2:
+      pending = s->loop_counter > 0 ? (size_t)s->loop_counter : 0;
+      break;
+
+    default:
+      return 0;
+  }
+  if (s->meta_block_remaining_len > 0) {
+    pending += (size_t)s->meta_block_remaining_len;
+  }
+  return pending;
+}
+
+BrotliDecoderResult BrotliDecoderDecompressedSize(
+    size_t encoded_size, const uint8_t* encoded_buffer, size_t* decoded_size) {
+  BrotliDecoderState s;
+  BrotliDecoderResult result;
+  size_t total_out = 0;
+  size_t available_in = encoded_size;
+  const uint8_t* next_in = encoded_buffer;
+  size_t available_out = 0;
+  uint8_t* next_out = 0;
+  *decoded_size = 0;
+  if (!BrotliDecoderStateInit(&s, 0, 0, 0)) {
+    return BROTLI_DECODER_RESULT_ERROR;
+  }
+  s.validate_only = 1;
+  result = BrotliDecoderDecompressStream(
+      &s, &available_in, &next_in, &available_out, &next_out, &total_out);
+  if (result == BROTLI_DECODER_RESULT_SUCCESS) {
+    *decoded_size = total_out;
+  } else if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
+    *decoded_size = total_out + UnwrittenBytes(&s, BROTLI_FALSE) +
+        PendingMetaBlockBytes(&s);
+  } else {
+    result = BROTLI_DECODER_RESULT_ERROR;
+  }
+  BrotliDecoderStateCleanup(&s);
+  return result;
+}
+
+/* Reads |n_bits| bits at |*bit_pos| of |data|; returns BROTLI_FALSE if there
+   are less than |n_bits| bits left. */
+static BROTLI_BOOL PeekBits(const uint8_t* data, size_t size, size_t* bit_pos,
+    uint32_t n_bits, uint32_t* value) {
+  uint32_t i;
+  if (*bit_pos + n_bits > size * 8) return BROTLI_FALSE;
+  *value = 0;
+  for (i = 0; i < n_bits; ++i) {
+    size_t pos = *bit_pos + i;
+    *value |= (uint32_t)((data[pos >> 3] >> (pos & 7)) & 1) << i;
+  }
+  *bit_pos += n_bits;
+  return BROTLI_TRUE;
+}
+
+/* Reads stream header, see DecodeWindowBits. */
+static BROTLI_BOOL PeekWindowBits(const uint8_t* data, size_t size,
+    size_t* bit_pos, uint32_t* window_bits, BROTLI_BOOL* large_window) {
+  uint32_t bits;
+  *large_window = BROTLI_FALSE;
+  if (!PeekBits(data, size, bit_pos, 1, &bits)) return BROTLI_FALSE;
+  if (bits == 0) {
+    *window_bits = 16;
+    return BROTLI_TRUE;
+  }
+  if (!PeekBits(data, size, bit_pos, 3, &bits)) return BROTLI_FALSE;
+  if (bits != 0) {
+    *window_bits = 17 + bits;
+    return BROTLI_TRUE;
+  }
+  if (!PeekBits(data, size, bit_pos, 3, &bits)) return BROTLI_FALSE;
+  if (bits == 1) {
+    /* Large window: "reserved" bit and 6 bits of window size. */
+    if (!PeekBits(data, size, bit_pos, 1, &bits) || bits != 0 ||
+        !PeekBits(data, size, bit_pos, 6, window_bits) ||
+        *window_bits < BROTLI_LARGE_MIN_WBITS ||
+        *window_bits > BROTLI_LARGE_MAX_WBITS) {
+      return BROTLI_FALSE;
+    }
+    *large_window = BROTLI_TRUE;
+    return BROTLI_TRUE;
+  }
+  *window_bits = (bits != 0) ? 8 + bits : 17;
+  return BROTLI_TRUE;
+}
+
+BROTLI_BOOL BrotliDecoderPeekContentSize(size_t encoded_size,
+    const uint8_t* encoded_buffer, uint64_t* content_size) {
+  const uint8_t* payload;
+  size_t bit_pos = 0;
+  uint32_t bits;
+  uint32_t window_bits;
+  BROTLI_BOOL large_window;
+  uint32_t skip_bytes;
+  uint32_t block_size = 0;
+  uint32_t signature = 0;
+  uint64_t size = 0;
+  int i;
+  if (!PeekWindowBits(encoded_buffer, encoded_size, &bit_pos, &window_bits,
+                      &large_window)) {
+    return BROTLI_FALSE;
+  }
+  /* Metablock header: ISLAST = 0, MNIBBLES = 0 (encoded as 3), reserved 0. */
+  if (!PeekBits(encoded_buffer, encoded_size, &bit_pos, 4, &bits) ||
+      bits != 6) {
+    return BROTLI_FALSE;
+  }
+  if (!PeekBits(encoded_buffer, encoded_size, &bit_pos, 2, &skip_bytes) ||
+      skip_bytes == 0 ||
+      !PeekBits(encoded_buffer, encoded_size, &bit_pos, 8 * skip_bytes,
+                &block_size)) {
+    return BROTLI_FALSE;
+  }
+  block_size += 1;
+  bit_pos = (bit_pos + 7) & ~(size_t)7;
+  if (block_size < BROTLI_CONTENT_SIZE_BLOCK_SIZE ||
+      (bit_pos >> 3) + BROTLI_CONTENT_SIZE_BLOCK_SIZE > encoded_size) {
+    return BROTLI_FALSE;
+  }
+  payload = &encoded_buffer[bit_pos >> 3];
+  for (i = 3; i >= 0; --i) signature = (signature << 8) | payload[i];
+  if (signature != BROTLI_CONTENT_SIZE_SIGNATURE) return BROTLI_FALSE;
+  for (i = BROTLI_CONTENT_SIZE_BLOCK_SIZE - 1; i >= 4; --i) {
+    size = (size << 8) | payload[i];
+  }
+  *content_size = size;
+  return BROTLI_TRUE;
+}
+
+static uint64_t LoadLE(const uint8_t* data, int n_bytes) {
+  uint64_t value = 0;
+  while (n_bytes-- > 0) value = (value << 8) | data[n_bytes];
+  return value;
+}
+
+/* Returns the first seek table entry at the end of the stream and sets
+   |*count|; returns NULL if the stream does not end with a seek table. */
+static const uint8_t* FindSeekTable(size_t encoded_size,
+    const uint8_t* encoded_buffer, size_t* count) {
+  const uint8_t* tail;
+  size_t table_size;
+  /* Tail: segment count, signature, empty last metablock. */
+  if (encoded_size < BROTLI_SEEK_TABLE_TAIL_SIZE + 1 ||
+      encoded_buffer[encoded_size - 1] != 3) {
+    return NULL;
+  }
+  tail = &encoded_buffer[encoded_size - 1 - BROTLI_SEEK_TABLE_TAIL_SIZE];
+  if (LoadLE(tail + 4, 4) != BROTLI_SEEK_TABLE_SIGNATURE) return NULL;
+  *count = (size_t)LoadLE(tail, 4);
+  if (*count == 0 || *count > BROTLI_SEEK_TABLE_MAX_SEGMENTS) return NULL;
+  table_size = *count * BROTLI_SEEK_TABLE_ENTRY_SIZE;
+  if (table_size > (size_t)(tail - encoded_buffer)) return NULL;
+  return tail - table_size;
+}
+
+/* Reads |index|-th entry either from |segments| or from serialized |table|. */
+static void ReadSegment(const uint8_t* table,
+    const BrotliDecoderSegment* segments, size_t index,
+    BrotliDecoderSegment* segment) {
+  if (segments) {
+    *segment = segments[index];
+  } else {
+    const uint8_t* entry = table + index * BROTLI_SEEK_TABLE_ENTRY_SIZE;
+    segment->compressed_offset = LoadLE(entry, 8);
+    segment->uncompressed_offset = LoadLE(entry + 8, 8);
+  }
+}
+
+BROTLI_BOOL BrotliDecoderGetSeekTable(size_t encoded_size,
+    const uint8_t* encoded_buffer, size_t* num_segments,
+    BrotliDecoderSegment* segments) {
+  BrotliDecoderSegment previous = {0, 0};
+  size_t count;
+  size_t i;
+  const uint8_t* table =
+      FindSeekTable(encoded_size, encoded_buffer, &count);
+  if (!table || (segments && *num_segments < count)) return BROTLI_FALSE;
+  for (i = 0; i < count; ++i) {
+    BrotliDecoderSegment segment;
+    ReadSegment(table, NULL, i, &segment);
+    /* Offsets are strictly increasing, starting from 0. */
+    if (i == 0 ? (segment.compressed_offset != 0 ||
+                  segment.uncompressed_offset != 0) :
+        (segment.compressed_offset <= previous.compressed_offset ||
+         segment.uncompressed_offset <= previous.uncompressed_offset)) {
+      return BROTLI_FALSE;
+    }
+    if (segments) segments[i] = segment;
+    previous = segment;
+  }
+  *num_segments = count;
+  return BROTLI_TRUE;
+}
+
+BROTLI_BOOL BrotliDecoderSeek(BrotliDecoderState* s, size_t header_size,
+    const uint8_t* header, const BrotliDecoderSegment* segment,
+    uint64_t offset) {
+  size_t bit_pos = 0;
+  uint32_t window_bits;
+  BROTLI_BOOL large_window;
+  size_t position;
+  int max_backward_distance;
+  if (BrotliDecoderIsUsed(s) || offset < segment->uncompressed_offset ||
+      offset > (uint64_t)(~(size_t)0)) {
+    return BROTLI_FALSE;
+  }
+  s->output_start = (size_t)offset;
+  if (segment->compressed_offset == 0) {
+    /* The first segment starts with stream header; decode as usual. */
+    return TO_BROTLI_BOOL(segment->uncompressed_offset == 0);
+  }
+  if (!PeekWindowBits(header, header_size, &bit_pos, &window_bits,
+                      &large_window) ||
+      (large_window && !s->large_window)) {
+    return BROTLI_FALSE;
+  }
+  /* Segment is compressed as if preceded by |uncompressed_offset| bytes (see
+     BROTLI_PARAM_STREAM_OFFSET), so decoder position is set accordingly. Ring
+     buffer is allocated at full size and never shrunk. It is zeroed: two
+     bytes before the position are used as initial literal context, like in
+     the encoder, and backward references of a segment that is not actually
+     independent must not expose uninitialized memory. */
+  position = (size_t)segment->uncompressed_offset;
+  s->window_bits = window_bits;
+  s->large_window = large_window ? 1 : 0;
+  s->new_ringbuffer_size = 1 << window_bits;
+  if (!BrotliEnsureRingBuffer(s)) return BROTLI_FALSE;
+  s->pos = (int)(position & (size_t)s->ringbuffer_mask);
+  s->rb_roundtrips = position >> window_bits;
+  s->partial_pos_out = position;
+  memset(s->ringbuffer, 0, (size_t)s->ringbuffer_size);
+  max_backward_distance = (1 << window_bits) - BROTLI_WINDOW_GAP;
+  s->max_distance = position < (size_t)max_backward_distance ?
+      (int)position : max_backward_distance;
+  s->state = BROTLI_STATE_INITIALIZE;
+  return BROTLI_TRUE;
+}
+
+BrotliDecoderResult BrotliDecoderDecompressRange(size_t encoded_size,
+    const uint8_t* encoded_buffer, size_t num_segments,
+    const BrotliDecoderSegment* segments, uint64_t offset, size_t* length,
+    uint8_t* decoded_buffer) {
+  BrotliDecoderState s;
+  BrotliDecoderSegment segment;
+  BrotliDecoderResult result;
+  const uint8_t* table = NULL;
+  size_t available_in;
+  const uint8_t* next_in;
+  size_t available_out = *length;
+  uint8_t* next_out = decoded_buffer;
+  size_t lo = 0;
+  size_t hi = num_segments;
+  *length = 0;
+  if (!segments) {
+    table = FindSeekTable(encoded_size, encoded_buffer, &hi);
+    if (!table) return BROTLI_DECODER_RESULT_ERROR;
+  }
+  if (hi == 0) return BROTLI_DECODER_RESULT_ERROR;
+  /* Find the last segment that starts at or before |offset|. */
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    ReadSegment(table, segments, mid, &segment);
+    if (segment.uncompressed_offset <= offset) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  ReadSegment(table, segments, lo, &segment);
+  if (segment.compressed_offset >= encoded_size) {
+    return BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT;
+  }
+  if (!BrotliDecoderStateInit(&s, 0, 0, 0)) {
+    return BROTLI_DECODER_RESULT_ERROR;
+  }
+  s.large_window = 1;
+  if (!BrotliDecoderSeek(&s, encoded_size, encoded_buffer, &segment, offset)) {
+    BrotliDecoderStateCleanup(&s);
+    return BROTLI_DECODER_RESULT_ERROR;
+  }
+  /* Decoding goes on through the following segments until output is full. */
+  available_in = encoded_size - (size_t)segment.compressed_offset;
+  next_in = encoded_buffer + segment.compressed_offset;
+  result = BrotliDecoderDecompressStream(
+      &s, &available_in, &next_in, &available_out, &next_out, 0);
+  *length = (size_t)(next_out - decoded_buffer);
+  if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT) {
+    result = BROTLI_DECODER_RESULT_SUCCESS;
+  } else if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT &&
+      available_out == 0) {
+    result = BROTLI_DECODER_RESULT_SUCCESS;
+  }
+  BrotliDecoderStateCleanup(&s);
+  return result;
+}
+
 /* Invariant: input stream is never overconsumed:
     - invalid input implies that the whole stream is invalid -> any amount of
       input could be read and discarded
@@ -2227,6 +3037,13 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
         BROTLI_LOG_UINT(s->meta_block_remaining_len);
         BROTLI_LOG_UINT(s->is_metadata);
         BROTLI_LOG_UINT(s->is_uncompressed);
+        s->num_metablocks++;
+        if (s->is_metadata) {
+          s->num_metadata_blocks++;
+          s->metadata_bytes += (uint64_t)s->meta_block_remaining_len;
+        } else if (s->is_uncompressed) {
+          s->num_uncompressed_metablocks++;
+        }
         if (s->is_metadata || s->is_uncompressed) {
           if (!BrotliJumpToByteBoundary(br)) {
             result = BROTLI_FAILURE(BROTLI_DECODER_ERROR_FORMAT_PADDING_1);
@@ -2287,7 +3104,7 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
         uint32_t alphabet_size = s->num_block_types[s->loop_counter] + 2;
         int tree_offset = s->loop_counter * BROTLI_HUFFMAN_MAX_SIZE_258;
         result = ReadHuffmanCode(alphabet_size, alphabet_size,
-            &s->block_type_trees[tree_offset], NULL, s);
+            &s->block_type_trees[tree_offset], NULL, NULL, s);
         if (result != BROTLI_DECODER_SUCCESS) break;
         s->state = BROTLI_STATE_HUFFMAN_CODE_2;
       }
@@ -2297,7 +3114,7 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
         uint32_t alphabet_size = BROTLI_NUM_BLOCK_LEN_SYMBOLS;
         int tree_offset = s->loop_counter * BROTLI_HUFFMAN_MAX_SIZE_26;
         result = ReadHuffmanCode(alphabet_size, alphabet_size,
-            &s->block_len_trees[tree_offset], NULL, s);
+            &s->block_len_trees[tree_offset], NULL, NULL, s);
         if (result != BROTLI_DECODER_SUCCESS) break;
         s->state = BROTLI_STATE_HUFFMAN_CODE_3;
       }
@@ -2439,7 +3256,9 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
       /* Fall through. */
 
       case BROTLI_STATE_BEFORE_COMPRESSED_METABLOCK_BODY:
+        BuildLiteralPairTables(s);
         PrepareLiteralDecoding(s);
+        SelectCommandsShape(s);
         s->dist_context_map_slice = s->dist_context_map;
         s->htree_command = s->insert_copy_hgroup.htrees[0];
         if (!BrotliEnsureRingBuffer(s)) {
@@ -2505,6 +3324,7 @@ BrotliDecoderResult BrotliDecoderDecompressStream(
           result = BROTLI_FAILURE(BROTLI_DECODER_ERROR_FORMAT_BLOCK_LENGTH_2);
           break;
         }
+        BROTLI_DECODER_STATS_ADD(s, num_metablocks, 1);
         BrotliDecoderStateCleanupAfterMetablock(s);
         if (!s->is_last_metablock) {
           s->state = BROTLI_STATE_METABLOCK_BEGIN;
@@ -2596,6 +3416,29 @@ const char* BrotliDecoderErrorString(BrotliDecoderErrorCode c) {
   }
 }
 
+BROTLI_BOOL BrotliDecoderGetStats(
+    const BrotliDecoderState* s, BrotliDecoderStats* stats) {
+#if defined(BROTLI_DECODER_STATS)
+  *stats = s->stats;
+  stats->ring_buffer_wraps = s->rb_roundtrips;
+  return BROTLI_TRUE;
+#else  /* BROTLI_DECODER_STATS */
+  BROTLI_UNUSED(s);
+  memset(stats, 0, sizeof(*stats));
+  return BROTLI_FALSE;
+#endif  /* BROTLI_DECODER_STATS */
+}
+
+void BrotliDecoderGetStreamInfo(
+    const BrotliDecoderState* s, BrotliDecoderStreamInfo* info) {
+  info->window_bits = s->window_bits;
+  info->large_window = TO_BROTLI_BOOL(s->large_window);
+  info->num_metablocks = s->num_metablocks;
+  info->num_uncompressed_metablocks = s->num_uncompressed_metablocks;
+  info->num_metadata_blocks = s->num_metadata_blocks;
+  info->metadata_bytes = s->metadata_bytes;
+}
+
 uint32_t BrotliDecoderVersion() {
   return BROTLI_VERSION;
 }
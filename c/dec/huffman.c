@@ -334,6 +334,50 @@ uint32_t BrotliBuildSimpleHuffmanTable(HuffmanCode* table,
   return goal_size;
 }
 
+/* Decodes the symbol which code is a prefix of |key|. Returns code length;
+   the result is meaningful only if it does not exceed number of valid bits
+   in |key|, unknown high bits of |key| must be zero. */
+static BROTLI_INLINE uint32_t LookupSymbol(const HuffmanCode* table,
+    uint32_t root_bits, uint32_t key, uint16_t* symbol) {
+  uint32_t length;
+  BROTLI_HC_MARK_TABLE_FOR_FAST_LOAD(table);
+  BROTLI_HC_ADJUST_TABLE_INDEX(table, key & ((1u << root_bits) - 1));
+  length = BROTLI_HC_FAST_LOAD_BITS(table);
+  if (length > root_bits) {
+    uint32_t sub_bits = length - root_bits;
+    BROTLI_HC_ADJUST_TABLE_INDEX(table, BROTLI_HC_FAST_LOAD_VALUE(table) +
+        ((key >> root_bits) & ((1u << sub_bits) - 1)));
+    length = root_bits + BROTLI_HC_FAST_LOAD_BITS(table);
+  }
+  *symbol = (uint16_t)BROTLI_HC_FAST_LOAD_VALUE(table);
+  return length;
+}
+
+void BrotliBuildLiteralPairTable(HuffmanLiteralPair* pairs,
+                                 const HuffmanCode* table,
+                                 int root_bits) {
+  uint32_t key;
+  for (key = 0; key < BROTLI_LITERAL_PAIR_TABLE_SIZE; ++key) {
+    HuffmanLiteralPair* pair = &pairs[key];
+    uint16_t first;
+    uint16_t second = 0;
+    uint32_t first_bits =
+        LookupSymbol(table, (uint32_t)root_bits, key, &first);
+    uint32_t bits = 0xFF;
+    if (first_bits <= BROTLI_LITERAL_PAIR_TABLE_BITS) {
+      uint32_t second_bits = LookupSymbol(
+          table, (uint32_t)root_bits, key >> first_bits, &second);
+      if (first_bits + second_bits <= BROTLI_LITERAL_PAIR_TABLE_BITS) {
+        bits = first_bits + second_bits;
+      }
+    }
+    pair->first_bits = (uint8_t)first_bits;
+    pair->bits = (uint8_t)bits;
+    pair->literals[0] = (uint8_t)first;
+    pair->literals[1] = (uint8_t)second;
+  }
+}
+
 #if defined(__cplusplus) || defined(c_plusplus)
 }  /* extern "C" */
 #endif
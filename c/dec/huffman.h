@@ -110,6 +110,28 @@ BROTLI_INTERNAL uint32_t BrotliBuildHuffmanTable(HuffmanCode* root_table,
 BROTLI_INTERNAL uint32_t BrotliBuildSimpleHuffmanTable(HuffmanCode* table,
     int root_bits, uint16_t* symbols, uint32_t num_symbols);
 
+/* Literal pair tables are indexed by this many bits of input. */
+#define BROTLI_LITERAL_PAIR_TABLE_BITS 11
+#define BROTLI_LITERAL_PAIR_TABLE_SIZE (1 << BROTLI_LITERAL_PAIR_TABLE_BITS)
+#define BROTLI_LITERAL_PAIR_TABLE_MASK (BROTLI_LITERAL_PAIR_TABLE_SIZE - 1)
+
+/* Decodes up to two literals with a single lookup.
+   |first_bits| is the code length of the first literal; if it exceeds
+   BROTLI_LITERAL_PAIR_TABLE_BITS, the entry is unusable. |bits| is the total
+   code length of both literals; if it exceeds BROTLI_LITERAL_PAIR_TABLE_BITS,
+   only the first literal is decoded. */
+typedef struct {
+  uint8_t first_bits;
+  uint8_t bits;
+  uint8_t literals[2];
+} HuffmanLiteralPair;
+
+/* Builds literal pair table from a complete Huffman lookup table with
+   |root_bits| root table, as produced by BrotliBuildHuffmanTable or
+   BrotliBuildSimpleHuffmanTable. */
+BROTLI_INTERNAL void BrotliBuildLiteralPairTable(HuffmanLiteralPair* pairs,
+    const HuffmanCode* table, int root_bits);
+
 /* Contains a collection of Huffman trees with the same alphabet size. */
 /* alphabet_size_limit is needed due to simple codes, since
    log2(alphabet_size_max) could be greater than log2(alphabet_size_limit). */
@@ -7,6 +7,7 @@
 #include "./state.h"
 
 #include <stdlib.h>  /* free, malloc */
+#include <string.h>  /* memset */
 
 #include <brotli/types.h>
 #include "./huffman.h"
@@ -32,6 +33,7 @@ BROTLI_BOOL BrotliDecoderStateInit(BrotliDecoderState* s,
   BrotliInitBitReader(&s->br);
   s->state = BROTLI_STATE_UNINITED;
   s->large_window = 0;
+  s->validate_only = 0;
   s->substate_metablock_header = BROTLI_STATE_METABLOCK_HEADER_NONE;
   s->substate_uncompressed = BROTLI_STATE_UNCOMPRESSED_NONE;
   s->substate_decode_uint8 = BROTLI_STATE_DECODE_UINT8_NONE;
@@ -42,6 +44,7 @@ BROTLI_BOOL BrotliDecoderStateInit(BrotliDecoderState* s,
   s->pos = 0;
   s->rb_roundtrips = 0;
   s->partial_pos_out = 0;
+  s->output_start = 0;
 
   s->block_type_trees = NULL;
   s->block_len_trees = NULL;
@@ -55,6 +58,7 @@ BROTLI_BOOL BrotliDecoderStateInit(BrotliDecoderState* s,
   s->dist_context_map = NULL;
   s->context_map_slice = NULL;
   s->dist_context_map_slice = NULL;
+  s->literal_pair_tables = NULL;
 
   s->literal_hgroup.codes = NULL;
   s->literal_hgroup.htrees = NULL;
@@ -70,6 +74,10 @@ BROTLI_BOOL BrotliDecoderStateInit(BrotliDecoderState* s,
   s->canny_ringbuffer_allocation = 1;
 
   s->window_bits = 0;
+  s->num_metablocks = 0;
+  s->num_uncompressed_metablocks = 0;
+  s->num_metadata_blocks = 0;
+  s->metadata_bytes = 0;
   s->max_distance = 0;
   s->dist_rb[0] = 16;
   s->dist_rb[1] = 15;
@@ -81,6 +89,13 @@ BROTLI_BOOL BrotliDecoderStateInit(BrotliDecoderState* s,
 
   s->mtf_upper_bound = 63;
 
+  memset(s->huffman_cache, 0, sizeof(s->huffman_cache));
+  s->metablock_sequence = 0;
+
+#if defined(BROTLI_DECODER_STATS)
+  memset(&s->stats, 0, sizeof(s->stats));
+#endif
+
   s->dictionary = BrotliGetDictionary();
   s->transforms = BrotliGetTransforms();
 
@@ -89,6 +104,7 @@ BROTLI_BOOL BrotliDecoderStateInit(BrotliDecoderState* s,
 
 void BrotliDecoderStateMetablockBegin(BrotliDecoderState* s) {
   s->meta_block_remaining_len = 0;
+  s->metablock_sequence++;
   s->block_length[0] = 1U << 24;
   s->block_length[1] = 1U << 24;
   s->block_length[2] = 1U << 24;
@@ -106,6 +122,8 @@ void BrotliDecoderStateMetablockBegin(BrotliDecoderState* s) {
   s->dist_context_map = NULL;
   s->context_map_slice = NULL;
   s->literal_htree = NULL;
+  s->literal_pair_table = NULL;
+  s->literal_pair_tables = NULL;
   s->dist_context_map_slice = NULL;
   s->dist_htree_index = 0;
   s->context_lookup = NULL;
@@ -124,11 +142,18 @@ void BrotliDecoderStateCleanupAfterMetablock(BrotliDecoderState* s) {
   BROTLI_DECODER_FREE(s, s->literal_hgroup.htrees);
   BROTLI_DECODER_FREE(s, s->insert_copy_hgroup.htrees);
   BROTLI_DECODER_FREE(s, s->distance_hgroup.htrees);
+  BROTLI_DECODER_FREE(s, s->literal_pair_tables);
+  s->literal_pair_table = NULL;
 }
 
 void BrotliDecoderStateCleanup(BrotliDecoderState* s) {
+  size_t i;
   BrotliDecoderStateCleanupAfterMetablock(s);
 
+  for (i = 0; i < BROTLI_HUFFMAN_CACHE_SIZE; ++i) {
+    BROTLI_DECODER_FREE(s, s->huffman_cache[i].table);
+  }
+
   BROTLI_DECODER_FREE(s, s->ringbuffer);
   BROTLI_DECODER_FREE(s, s->block_type_trees);
 }
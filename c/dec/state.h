@@ -13,6 +13,7 @@
 #include "../common/dictionary.h"
 #include "../common/platform.h"
 #include "../common/transform.h"
+#include <brotli/decode.h>
 #include <brotli/types.h>
 #include "./bit_reader.h"
 #include "./huffman.h"
@@ -216,6 +217,8 @@ typedef struct BrotliMetablockHeaderArena {
   uint8_t code_length_code_lengths[BROTLI_CODE_LENGTH_CODES];
   /* Population counts for the code lengths. */
   uint16_t code_length_histo[16];
+  /* Description of the code being read; key for the Huffman table cache. */
+  uint16_t huffman_cache_key[1 + BROTLI_NUM_COMMAND_SYMBOLS];
 
   /* For HuffmanTreeGroupDecode. */
   int htree_index;
@@ -228,6 +231,22 @@ typedef struct BrotliMetablockHeaderArena {
   HuffmanCode context_map_table[BROTLI_HUFFMAN_MAX_SIZE_272];
 } BrotliMetablockHeaderArena;
 
+#define BROTLI_HUFFMAN_CACHE_SIZE 16
+
+/* Huffman table built for one of recent metablocks. */
+typedef struct BrotliHuffmanCacheEntry {
+  uint32_t hash;
+  /* Metablock sequence number when entry was last used, 0 for unused entry;
+     entries used by the current metablock are not evicted. */
+  uint32_t last_used;
+  uint32_t key_size;
+  /* 0 if the code was seen only once and the table is not stored yet. */
+  uint32_t table_size;
+  size_t capacity;
+  /* |table_size| table entries followed by |key_size| key items. */
+  HuffmanCode* table;
+} BrotliHuffmanCacheEntry;
+
 typedef struct BrotliMetablockBodyArena {
   uint8_t dist_extra_bits[544];
   uint32_t dist_offset[544];
@@ -278,6 +297,8 @@ struct BrotliDecoderStateStruct {
   /* This is true if the literal context map histogram type always matches the
      block type. It is then not needed to keep the context (faster decoding). */
   int trivial_literal_context;
+  /* Specialization of the command loop chosen for the current metablock. */
+  int commands_shape;
   /* Distance context is actual after command is decoded and before distance is
      computed. After distance computation it is used as a temporary variable. */
   int distance_context;
@@ -291,6 +312,9 @@ struct BrotliDecoderStateStruct {
   uint32_t num_dist_htrees;
   uint8_t* dist_context_map;
   HuffmanCode* literal_htree;
+  /* Literal pair table for |literal_htree|, or NULL if it was not built or
+     the current block type uses context modeling. */
+  const HuffmanLiteralPair* literal_pair_table;
   uint8_t dist_htree_index;
 
   int copy_length;
@@ -299,6 +323,7 @@ struct BrotliDecoderStateStruct {
   /* For partial write operations. */
   size_t rb_roundtrips;  /* how many times we went around the ring-buffer */
   size_t partial_pos_out;  /* how much output to the user in total */
+  size_t output_start;  /* output before this position is discarded */
 
   /* For InverseMoveToFrontTransform. */
   uint32_t mtf_upper_bound;
@@ -318,12 +343,15 @@ struct BrotliDecoderStateStruct {
   unsigned int should_wrap_ringbuffer : 1;
   unsigned int canny_ringbuffer_allocation : 1;
   unsigned int large_window : 1;
+  unsigned int validate_only : 1;
   unsigned int size_nibbles : 8;
   uint32_t window_bits;
 
   int new_ringbuffer_size;
 
   uint32_t num_literal_htrees;
+  /* Literal pair tables for each literal tree, or NULL. */
+  HuffmanLiteralPair* literal_pair_tables;
   uint8_t* context_map;
   uint8_t* context_modes;
 
@@ -332,10 +360,24 @@ struct BrotliDecoderStateStruct {
 
   uint32_t trivial_literal_contexts[8];  /* 256 bits */
 
+  /* Reuses Huffman tables across short metablocks. */
+  BrotliHuffmanCacheEntry huffman_cache[BROTLI_HUFFMAN_CACHE_SIZE];
+  uint32_t metablock_sequence;
+
   union {
     BrotliMetablockHeaderArena header;
     BrotliMetablockBodyArena body;
   } arena;
+
+  /* Stream layout counters, see BrotliDecoderGetStreamInfo. */
+  uint64_t num_metablocks;
+  uint64_t num_uncompressed_metablocks;
+  uint64_t num_metadata_blocks;
+  uint64_t metadata_bytes;
+
+#if defined(BROTLI_DECODER_STATS)
+  BrotliDecoderStats stats;
+#endif  /* BROTLI_DECODER_STATS */
 };
 
 typedef struct BrotliDecoderStateStruct BrotliDecoderStateInternal;
@@ -353,6 +395,14 @@ BROTLI_INTERNAL BROTLI_BOOL BrotliDecoderHuffmanTreeGroupInit(
 
 #define BROTLI_DECODER_ALLOC(S, L) S->alloc_func(S->memory_manager_opaque, L)
 
+/* Adds |VALUE| to the |FIELD| counter of decoder statistics. */
+#if defined(BROTLI_DECODER_STATS)
+#define BROTLI_DECODER_STATS_ADD(S, FIELD, VALUE) \
+  (S)->stats.FIELD += (uint64_t)(VALUE)
+#else
+#define BROTLI_DECODER_STATS_ADD(S, FIELD, VALUE)
+#endif
+
 #define BROTLI_DECODER_FREE(S, X) {          \
   S->free_func(S->memory_manager_opaque, X); \
   X = NULL;                                  \
@@ -17,6 +17,7 @@
 #include "./dictionary_hash.h"
 #include "./memory.h"
 #include "./quality.h"
+#include "./stats.h"
 
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
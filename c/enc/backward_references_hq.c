@@ -22,6 +22,7 @@
 #include "./params.h"
 #include "./prefix.h"
 #include "./quality.h"
+#include "./stats.h"
 
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
@@ -688,6 +689,8 @@ size_t BrotliZopfliComputeShortestPath(MemoryManager* m, size_t num_bytes,
         &params->dictionary,
         ringbuffer, ringbuffer_mask, pos, num_bytes - i, max_distance,
         dictionary_start + gap, params, &matches[lz_matches_offset]);
+    BROTLI_STATS_ONLY(++hasher->common.num_probes;)
+    BROTLI_STATS_ONLY(if (num_matches > 0) ++hasher->common.num_hits;)
     if (num_matches > 0 &&
         BackwardMatchLength(&matches[num_matches - 1]) > max_zopfli_len) {
       matches[0] = matches[num_matches - 1];
@@ -781,6 +784,8 @@ void BrotliCreateHqZopfliBackwardReferences(MemoryManager* m, size_t num_bytes,
         ringbuffer, ringbuffer_mask, pos, max_length,
         max_distance, dictionary_start + gap, params,
         &matches[cur_match_pos + shadow_matches]);
+    BROTLI_STATS_ONLY(++hasher->common.num_probes;)
+    BROTLI_STATS_ONLY(if (num_found_matches > 0) ++hasher->common.num_hits;)
     cur_match_end = cur_match_pos + num_found_matches;
     for (j = cur_match_pos; j + 1 < cur_match_end; ++j) {
       BROTLI_DCHECK(BackwardMatchLength(&matches[j]) <=
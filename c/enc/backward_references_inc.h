@@ -50,9 +50,11 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
     FN(FindLongestMatch)(privat, &params->dictionary,
         ringbuffer, ringbuffer_mask, dist_cache, position, max_length,
         max_distance, dictionary_start + gap, params->dist.max_distance, &sr);
+    BROTLI_STATS_ONLY(++hasher->common.num_probes;)
     if (sr.score > kMinScore) {
       /* Found a match. Let's look for something even better ahead. */
       int delayed_backward_references_in_row = 0;
+      BROTLI_STATS_ONLY(++hasher->common.num_hits;)
       --max_length;
       for (;; --max_length) {
         const score_t cost_diff_lazy = 175;
@@ -70,6 +72,8 @@ static BROTLI_NOINLINE void EXPORT_FN(CreateBackwardReferences)(
             ringbuffer, ringbuffer_mask, dist_cache, position + 1, max_length,
             max_distance, dictionary_start + gap, params->dist.max_distance,
             &sr2);
+        BROTLI_STATS_ONLY(++hasher->common.num_probes;)
+        BROTLI_STATS_ONLY(if (sr2.score > kMinScore) ++hasher->common.num_hits;)
         if (sr2.score >= sr.score + cost_diff_lazy) {
           /* Ok, let's just write one byte for now and start a match from the
              next byte. */
@@ -31,6 +31,7 @@
 #include "./prefix.h"
 #include "./quality.h"
 #include "./ringbuffer.h"
+#include "./stats.h"
 #include "./utf8_util.h"
 #include "./write_bits.h"
 
@@ -40,6 +41,13 @@ extern "C" {
 
 #define COPY_ARRAY(dst, src) memcpy(dst, src, sizeof(src));
 
+/* Hashers may read up to 7 bytes past the end of the processed range; the ring
+   buffer has zeroed slack for that, caller-owned input does not. */
+static const size_t kOneShotInputSlack = 7;
+
+/* One-shot input is referenced without wrapping; see WrapPosition. */
+#define BROTLI_MAX_ONE_SHOT_INPUT_SIZE (((size_t)3 << 30) - 1)
+
 typedef enum BrotliEncoderStreamState {
   /* Default state. */
   BROTLI_STREAM_PROCESSING = 0,
@@ -68,7 +76,13 @@ typedef struct BrotliEncoderStateStruct {
   MemoryManager memory_manager_;
 
   uint64_t input_pos_;
+  /* Input consumed by BrotliEncoderCompressStream. */
+  uint64_t stream_input_size_;
   RingBuffer ringbuffer_;
+  /* Caller-owned input of one-shot compression; when set, it is hashed and
+     referenced in place and the ring buffer is not used. */
+  const uint8_t* one_shot_input_;
+  size_t one_shot_input_size_;
   size_t cmd_alloc_size_;
   Command* commands_;
   size_t num_commands_;
@@ -126,6 +140,20 @@ typedef struct BrotliEncoderStateStruct {
 
   BROTLI_BOOL is_last_block_emitted_;
   BROTLI_BOOL is_initialized_;
+
+  /* Seekable stream: uncompressed offset of the current segment, and pairs of
+     compressed / uncompressed segment offsets collected so far. */
+  uint64_t segment_start_;
+  uint64_t* seek_table_;
+  size_t seek_table_size_;
+  size_t seek_table_capacity_;
+  /* Serialized seek table, while it is emitted as metadata block. */
+  uint8_t* seek_table_block_;
+  BROTLI_BOOL is_seek_table_emitted_;
+
+#if defined(BROTLI_ENCODER_STATS)
+  BrotliEncoderStats stats_;
+#endif  /* BROTLI_ENCODER_STATS */
 } BrotliEncoderStateStruct;
 
 static size_t InputBlockSize(BrotliEncoderState* s) {
@@ -191,6 +219,14 @@ BROTLI_BOOL BrotliEncoderSetParameter(
       state->params.stream_offset = value;
       return BROTLI_TRUE;
 
+    case BROTLI_PARAM_CONTENT_SIZE:
+      state->params.content_size = value;
+      return BROTLI_TRUE;
+
+    case BROTLI_PARAM_SEGMENT_SIZE:
+      state->params.segment_size = value;
+      return BROTLI_TRUE;
+
     default: return BROTLI_FALSE;
   }
 }
@@ -572,6 +608,7 @@ static void WriteMetaBlockInternal(MemoryManager* m,
   uint8_t last_bytes_bits;
   ContextLut literal_context_lut = BROTLI_CONTEXT_LUT(literal_context_mode);
   BrotliEncoderParams block_params = *params;
+  BROTLI_STATS_ONLY(uint64_t stage_start;)
 
   if (bytes == 0) {
     /* Write the ISLAST and ISEMPTY bits. */
@@ -595,20 +632,25 @@ static void WriteMetaBlockInternal(MemoryManager* m,
   last_bytes = (uint16_t)((storage[1] << 8) | storage[0]);
   last_bytes_bits = (uint8_t)(*storage_ix);
   if (params->quality <= MAX_QUALITY_FOR_STATIC_ENTROPY_CODES) {
+    BROTLI_STATS_ONLY(stage_start = BrotliStatsNow();)
     BrotliStoreMetaBlockFast(m, data, wrapped_last_flush_pos,
                              bytes, mask, is_last, params,
                              commands, num_commands,
                              storage_ix, storage);
     if (BROTLI_IS_OOM(m)) return;
+    BROTLI_STATS_ADD_TIME(m->stats, metablock_store_ns, stage_start);
   } else if (params->quality < MIN_QUALITY_FOR_BLOCK_SPLIT) {
+    BROTLI_STATS_ONLY(stage_start = BrotliStatsNow();)
     BrotliStoreMetaBlockTrivial(m, data, wrapped_last_flush_pos,
                                 bytes, mask, is_last, params,
                                 commands, num_commands,
                                 storage_ix, storage);
     if (BROTLI_IS_OOM(m)) return;
+    BROTLI_STATS_ADD_TIME(m->stats, metablock_store_ns, stage_start);
   } else {
     MetaBlockSplit mb;
     InitMetaBlockSplit(&mb);
+    BROTLI_STATS_ONLY(stage_start = BrotliStatsNow();)
     if (params->quality < MIN_QUALITY_FOR_HQ_BLOCK_SPLITTING) {
       size_t num_literal_contexts = 1;
       const uint32_t* literal_context_map = NULL;
@@ -636,6 +678,8 @@ static void WriteMetaBlockInternal(MemoryManager* m,
          for "Large Window Brotli" (32-bit). */
       BrotliOptimizeHistograms(block_params.dist.alphabet_size_limit, &mb);
     }
+    BROTLI_STATS_ADD_TIME(m->stats, metablock_build_ns, stage_start);
+    BROTLI_STATS_ONLY(stage_start = BrotliStatsNow();)
     BrotliStoreMetaBlock(m, data, wrapped_last_flush_pos, bytes, mask,
                          prev_byte, prev_byte2,
                          is_last,
@@ -645,6 +689,7 @@ static void WriteMetaBlockInternal(MemoryManager* m,
                          &mb,
                          storage_ix, storage);
     if (BROTLI_IS_OOM(m)) return;
+    BROTLI_STATS_ADD_TIME(m->stats, metablock_store_ns, stage_start);
     DestroyMetaBlockSplit(m, &mb);
   }
   if (bytes + 4 < (*storage_ix >> 3)) {
@@ -685,6 +730,55 @@ static void ChooseDistanceParams(BrotliEncoderParams* params) {
       params, distance_postfix_bits, num_direct_distance_codes);
 }
 
+/* Dumps remaining output bits and metadata header to |header|.
+   Returns number of produced bytes.
+   REQUIRED: |header| should be 8-byte aligned and at least 16 bytes long.
+   REQUIRED: |block_size| <= (1 << 24). */
+static size_t WriteMetadataHeader(
+    BrotliEncoderState* s, const size_t block_size, uint8_t* header) {
+  size_t storage_ix;
+  storage_ix = s->last_bytes_bits_;
+  header[0] = (uint8_t)s->last_bytes_;
+  header[1] = (uint8_t)(s->last_bytes_ >> 8);
+  s->last_bytes_ = 0;
+  s->last_bytes_bits_ = 0;
+
+  BrotliWriteBits(1, 0, &storage_ix, header);
+  BrotliWriteBits(2, 3, &storage_ix, header);
+  BrotliWriteBits(1, 0, &storage_ix, header);
+  if (block_size == 0) {
+    BrotliWriteBits(2, 0, &storage_ix, header);
+  } else {
+    uint32_t nbits = (block_size == 1) ? 0 :
+        (Log2FloorNonZero((uint32_t)block_size - 1) + 1);
+    uint32_t nbytes = (nbits + 7) / 8;
+    BrotliWriteBits(2, nbytes, &storage_ix, header);
+    BrotliWriteBits(8 * nbytes, block_size - 1, &storage_ix, header);
+  }
+  return (storage_ix + 7u) >> 3;
+}
+
+/* Puts stream header and content size metadata block to |tiny_buf_|. */
+static void WriteContentSizeBlock(BrotliEncoderState* s) {
+  uint8_t* header = s->tiny_buf_.u8;
+  size_t header_size =
+      WriteMetadataHeader(s, BROTLI_CONTENT_SIZE_BLOCK_SIZE, header);
+  uint64_t payload = s->params.content_size;
+  size_t i;
+  BROTLI_DCHECK(header_size + BROTLI_CONTENT_SIZE_BLOCK_SIZE <=
+      sizeof(s->tiny_buf_));
+  for (i = 0; i < 4; ++i) {
+    header[header_size + i] =
+        (uint8_t)(BROTLI_CONTENT_SIZE_SIGNATURE >> (8 * i));
+  }
+  for (i = 4; i < BROTLI_CONTENT_SIZE_BLOCK_SIZE; ++i) {
+    header[header_size + i] = (uint8_t)payload;
+    payload >>= 8;
+  }
+  s->next_out_ = header;
+  s->available_out_ = header_size + BROTLI_CONTENT_SIZE_BLOCK_SIZE;
+}
+
 static BROTLI_BOOL EnsureInitialized(BrotliEncoderState* s) {
   if (BROTLI_IS_OOM(&s->memory_manager_)) return BROTLI_FALSE;
   if (s->is_initialized_) return BROTLI_TRUE;
@@ -695,6 +789,12 @@ static BROTLI_BOOL EnsureInitialized(BrotliEncoderState* s) {
   s->remaining_metadata_bytes_ = BROTLI_UINT32_MAX;
 
   SanitizeParams(&s->params);
+  if (s->params.size_hint == 0) {
+    s->params.size_hint = BROTLI_MIN(size_t, s->params.content_size, 1u << 30);
+  }
+  if (s->params.segment_size != 0) {
+    s->params.size_hint = BROTLI_MIN(size_t, s->params.segment_size, 1u << 30);
+  }
   s->params.lgblock = ComputeLgBlock(&s->params);
   ChooseDistanceParams(&s->params);
 
@@ -720,6 +820,7 @@ static BROTLI_BOOL EnsureInitialized(BrotliEncoderState* s) {
     if (s->params.stream_offset == 0) {
       EncodeWindowBits(lgwin, s->params.large_window,
                        &s->last_bytes_, &s->last_bytes_bits_);
+      if (s->params.content_size != 0) WriteContentSizeBlock(s);
     } else {
       /* Bigger values have the same effect, but could cause overflows. */
       s->params.stream_offset = BROTLI_MIN(size_t,
@@ -744,6 +845,8 @@ static void BrotliEncoderInitParams(BrotliEncoderParams* params) {
   params->lgblock = 0;
   params->stream_offset = 0;
   params->size_hint = 0;
+  params->content_size = 0;
+  params->segment_size = 0;
   params->disable_literal_context_modeling = BROTLI_FALSE;
   BrotliInitEncoderDictionary(&params->dictionary);
   params->dist.distance_postfix_bits = 0;
@@ -757,6 +860,9 @@ static void BrotliEncoderInitParams(BrotliEncoderParams* params) {
 static void BrotliEncoderInitState(BrotliEncoderState* s) {
   BrotliEncoderInitParams(&s->params);
   s->input_pos_ = 0;
+  s->stream_input_size_ = 0;
+  s->one_shot_input_ = NULL;
+  s->one_shot_input_size_ = 0;
   s->num_commands_ = 0;
   s->num_literals_ = 0;
   s->last_insert_len_ = 0;
@@ -778,6 +884,12 @@ static void BrotliEncoderInitState(BrotliEncoderState* s) {
   s->stream_state_ = BROTLI_STREAM_PROCESSING;
   s->is_last_block_emitted_ = BROTLI_FALSE;
   s->is_initialized_ = BROTLI_FALSE;
+  s->segment_start_ = 0;
+  s->seek_table_ = NULL;
+  s->seek_table_size_ = 0;
+  s->seek_table_capacity_ = 0;
+  s->seek_table_block_ = NULL;
+  s->is_seek_table_emitted_ = BROTLI_FALSE;
 
   RingBufferInit(&s->ringbuffer_);
 
@@ -809,6 +921,10 @@ BrotliEncoderState* BrotliEncoderCreateInstance(
   BrotliInitMemoryManager(
       &state->memory_manager_, alloc_func, free_func, opaque);
   BrotliEncoderInitState(state);
+#if defined(BROTLI_ENCODER_STATS)
+  memset(&state->stats_, 0, sizeof(state->stats_));
+  state->memory_manager_.stats = &state->stats_;
+#endif  /* BROTLI_ENCODER_STATS */
   return state;
 }
 
@@ -825,6 +941,8 @@ static void BrotliEncoderCleanupState(BrotliEncoderState* s) {
   BROTLI_FREE(m, s->large_table_);
   BROTLI_FREE(m, s->command_buf_);
   BROTLI_FREE(m, s->literal_buf_);
+  BROTLI_FREE(m, s->seek_table_);
+  BROTLI_FREE(m, s->seek_table_block_);
 }
 
 /* Deinitializes and frees BrotliEncoderState instance. */
@@ -902,6 +1020,17 @@ static void CopyInputToRingBuffer(BrotliEncoderState* s,
   }
 }
 
+/* Returns the data the backward references and metablocks are built from:
+   either the ring buffer, or the one-shot input addressed with flat mask. */
+static const uint8_t* GetInputData(BrotliEncoderState* s, uint32_t* mask) {
+  if (s->one_shot_input_) {
+    *mask = BROTLI_UINT32_MAX;
+    return s->one_shot_input_;
+  }
+  *mask = s->ringbuffer_.mask_;
+  return s->ringbuffer_.buffer_;
+}
+
 /* Marks all input as processed.
    Returns true if position wrapping occurs. */
 static BROTLI_BOOL UpdateLastProcessedPos(BrotliEncoderState* s) {
@@ -914,8 +1043,8 @@ static BROTLI_BOOL UpdateLastProcessedPos(BrotliEncoderState* s) {
 static void ExtendLastCommand(BrotliEncoderState* s, uint32_t* bytes,
                               uint32_t* wrapped_last_processed_pos) {
   Command* last_command = &s->commands_[s->num_commands_ - 1];
-  const uint8_t* data = s->ringbuffer_.buffer_;
-  const uint32_t mask = s->ringbuffer_.mask_;
+  uint32_t mask;
+  const uint8_t* data = GetInputData(s, &mask);
   uint64_t max_backward_distance =
       (((uint64_t)1) << s->params.lgwin) - BROTLI_WINDOW_GAP;
   uint64_t last_copy_len = last_command->copy_len_ & 0x1FFFFFF;
@@ -963,14 +1092,16 @@ static BROTLI_BOOL EncodeData(
   const uint64_t delta = UnprocessedInputSize(s);
   uint32_t bytes = (uint32_t)delta;
   uint32_t wrapped_last_processed_pos = WrapPosition(s->last_processed_pos_);
-  uint8_t* data;
+  uint32_t unhashed_tail = 0;
+  BROTLI_BOOL stitch_hasher = BROTLI_TRUE;
+  const uint8_t* data;
   uint32_t mask;
   MemoryManager* m = &s->memory_manager_;
   ContextType literal_context_mode;
   ContextLut literal_context_lut;
+  BROTLI_STATS_ONLY(uint64_t stage_start;)
 
-  data = s->ringbuffer_.buffer_;
-  mask = s->ringbuffer_.mask_;
+  data = GetInputData(s, &mask);
 
   /* Adding more blocks after "last" block is forbidden. */
   if (s->is_last_block_emitted_) return BROTLI_FALSE;
@@ -979,6 +1110,7 @@ static BROTLI_BOOL EncodeData(
   if (delta > InputBlockSize(s)) {
     return BROTLI_FALSE;
   }
+  BROTLI_STATS_ADD(m->stats, bytes_in, delta);
   if (s->params.quality == FAST_TWO_PASS_COMPRESSION_QUALITY &&
       !s->command_buf_) {
     s->command_buf_ =
@@ -1010,6 +1142,7 @@ static BROTLI_BOOL EncodeData(
     storage[1] = (uint8_t)(s->last_bytes_ >> 8);
     table = GetHashTable(s, s->params.quality, bytes, &table_size);
     if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+    BROTLI_STATS_ONLY(stage_start = BrotliStatsNow();)
     if (s->params.quality == FAST_ONE_PASS_COMPRESSION_QUALITY) {
       BrotliCompressFragmentFast(
           m, &data[wrapped_last_processed_pos & mask],
@@ -1028,6 +1161,7 @@ static BROTLI_BOOL EncodeData(
           &storage_ix, storage);
       if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
     }
+    BROTLI_STATS_ADD_TIME(m->stats, fragment_ns, stage_start);
     s->last_bytes_ = (uint16_t)(storage[storage_ix >> 3]);
     s->last_bytes_bits_ = storage_ix & 7u;
     UpdateLastProcessedPos(s);
@@ -1055,8 +1189,25 @@ static BROTLI_BOOL EncodeData(
     }
   }
 
-  InitOrStitchToPreviousBlock(m, &s->hasher_, data, mask, &s->params,
-      wrapped_last_processed_pos, bytes, is_last);
+  if (s->one_shot_input_) {
+    /* Bytes too close to the end of one-shot input are not hashed; they are
+       appended to the pending insert as literals. */
+    const uint64_t hashable_end =
+        s->one_shot_input_size_ > kOneShotInputSlack ?
+        s->one_shot_input_size_ - kOneShotInputSlack : 0;
+    if (s->input_pos_ > hashable_end) {
+      const uint64_t excess = s->input_pos_ - hashable_end;
+      unhashed_tail = excess < bytes ? (uint32_t)excess : bytes;
+      bytes -= unhashed_tail;
+    }
+    /* Stitching hashes the last bytes of the previous block. */
+    stitch_hasher = TO_BROTLI_BOOL(s->last_processed_pos_ <= hashable_end);
+  }
+
+  if (stitch_hasher) {
+    InitOrStitchToPreviousBlock(m, &s->hasher_, data, mask, &s->params,
+        wrapped_last_processed_pos, bytes, is_last);
+  }
 
   literal_context_mode = ChooseContextMode(
       &s->params, data, WrapPosition(s->last_flush_pos_),
@@ -1069,6 +1220,8 @@ static BROTLI_BOOL EncodeData(
     ExtendLastCommand(s, &bytes, &wrapped_last_processed_pos);
   }
 
+  BROTLI_STATS_ONLY(stage_start = BrotliStatsNow();)
+
   if (s->params.quality == ZOPFLIFICATION_QUALITY) {
     BROTLI_DCHECK(s->params.hasher.type == 10);
     BrotliCreateZopfliBackwardReferences(m, bytes, wrapped_last_processed_pos,
@@ -1092,6 +1245,8 @@ static BROTLI_BOOL EncodeData(
         &s->last_insert_len_, &s->commands_[s->num_commands_],
         &s->num_commands_, &s->num_literals_);
   }
+  BROTLI_STATS_ADD_TIME(m->stats, backward_references_ns, stage_start);
+  s->last_insert_len_ += unhashed_tail;
 
   {
     const size_t max_length = MaxMetablockSize(&s->params);
@@ -1150,6 +1305,9 @@ static BROTLI_BOOL EncodeData(
         s->num_literals_, s->num_commands_, s->commands_, s->saved_dist_cache_,
         s->dist_cache_, &storage_ix, storage);
     if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
+    BROTLI_STATS_ADD(m->stats, num_metablocks, 1);
+    BROTLI_STATS_ADD(m->stats, num_commands, s->num_commands_);
+    BROTLI_STATS_ADD(m->stats, num_literals, s->num_literals_);
     s->last_bytes_ = (uint16_t)(storage[storage_ix >> 3]);
     s->last_bytes_bits_ = storage_ix & 7u;
     s->last_flush_pos_ = s->input_pos_;
@@ -1173,34 +1331,6 @@ static BROTLI_BOOL EncodeData(
   }
 }
 
-/* Dumps remaining output bits and metadata header to |header|.
-   Returns number of produced bytes.
-   REQUIRED: |header| should be 8-byte aligned and at least 16 bytes long.
-   REQUIRED: |block_size| <= (1 << 24). */
-static size_t WriteMetadataHeader(
-    BrotliEncoderState* s, const size_t block_size, uint8_t* header) {
-  size_t storage_ix;
-  storage_ix = s->last_bytes_bits_;
-  header[0] = (uint8_t)s->last_bytes_;
-  header[1] = (uint8_t)(s->last_bytes_ >> 8);
-  s->last_bytes_ = 0;
-  s->last_bytes_bits_ = 0;
-
-  BrotliWriteBits(1, 0, &storage_ix, header);
-  BrotliWriteBits(2, 3, &storage_ix, header);
-  BrotliWriteBits(1, 0, &storage_ix, header);
-  if (block_size == 0) {
-    BrotliWriteBits(2, 0, &storage_ix, header);
-  } else {
-    uint32_t nbits = (block_size == 1) ? 0 :
-        (Log2FloorNonZero((uint32_t)block_size - 1) + 1);
-    uint32_t nbytes = (nbits + 7) / 8;
-    BrotliWriteBits(2, nbytes, &storage_ix, header);
-    BrotliWriteBits(8 * nbytes, block_size - 1, &storage_ix, header);
-  }
-  return (storage_ix + 7u) >> 3;
-}
-
 static BROTLI_BOOL BrotliCompressBufferQuality10(
     int lgwin, size_t input_size, const uint8_t* input_buffer,
     size_t* encoded_size, uint8_t* encoded_buffer) {
@@ -1423,6 +1553,46 @@ oom:
   return BROTLI_FALSE;
 }
 
+/* Compresses the whole |input_buffer| with the state |s| without copying it to
+   the ring buffer: blocks are fed to EncodeData directly from the caller's
+   buffer, which stays referenced until compression is over.
+   REQUIRED: quality >= 2, |input_size| <= BROTLI_MAX_ONE_SHOT_INPUT_SIZE. */
+static BROTLI_BOOL BrotliCompressBufferInPlace(BrotliEncoderState* s,
+    size_t input_size, const uint8_t* input_buffer,
+    size_t* encoded_size, uint8_t* encoded_buffer) {
+  const size_t max_out_size = *encoded_size;
+  size_t total_out_size = 0;
+  if (!EnsureInitialized(s)) return BROTLI_FALSE;
+  BROTLI_DCHECK(s->params.quality > FAST_TWO_PASS_COMPRESSION_QUALITY);
+  BROTLI_DCHECK(input_size <= BROTLI_MAX_ONE_SHOT_INPUT_SIZE);
+  s->one_shot_input_ = input_buffer;
+  s->one_shot_input_size_ = input_size;
+
+  while (!s->is_last_block_emitted_) {
+    const size_t block_size = BROTLI_MIN(size_t,
+        input_size - (size_t)s->input_pos_, InputBlockSize(s));
+    const BROTLI_BOOL is_last =
+        TO_BROTLI_BOOL(s->input_pos_ + block_size == input_size);
+    size_t out_size = 0;
+    uint8_t* output = NULL;
+    s->input_pos_ += block_size;
+    if (!EncodeData(s, is_last, BROTLI_FALSE, &out_size, &output)) {
+      return BROTLI_FALSE;
+    }
+    if (out_size > max_out_size - total_out_size) return BROTLI_FALSE;
+    if (out_size != 0) {
+      memcpy(&encoded_buffer[total_out_size], output, out_size);
+      total_out_size += out_size;
+      s->total_out_ += out_size;
+    }
+  }
+
+  s->one_shot_input_ = NULL;
+  s->stream_state_ = BROTLI_STREAM_FINISHED;
+  *encoded_size = total_out_size;
+  return BROTLI_TRUE;
+}
+
 size_t BrotliEncoderMaxCompressedSize(size_t input_size) {
   /* [window bits / empty metadata] + N * [uncompressed] + [last empty] */
   size_t num_large_blocks = input_size >> 14;
@@ -1516,8 +1686,16 @@ BROTLI_BOOL BrotliEncoderCompress(
     if (lgwin > BROTLI_MAX_WINDOW_BITS) {
       BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, BROTLI_TRUE);
     }
-    result = BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
-        &available_in, &next_in, &available_out, &next_out, &total_out);
+    if (quality > FAST_TWO_PASS_COMPRESSION_QUALITY &&
+        input_size <= BROTLI_MAX_ONE_SHOT_INPUT_SIZE) {
+      /* Hash and reference the input in place, skipping the ring buffer. */
+      total_out = available_out;
+      result = BrotliCompressBufferInPlace(
+          s, input_size, input_buffer, &total_out, next_out);
+    } else {
+      result = BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+          &available_in, &next_in, &available_out, &next_out, &total_out);
+    }
     if (!BrotliEncoderIsFinished(s)) result = 0;
     *encoded_size = total_out;
     BrotliEncoderDestroyInstance(s);
@@ -1658,6 +1836,7 @@ static BROTLI_BOOL BrotliEncoderCompressStreamFast(
       size_t storage_ix = s->last_bytes_bits_;
       size_t table_size;
       int* table;
+      BROTLI_STATS_ONLY(uint64_t stage_start;)
 
       if (force_flush && block_size == 0) {
         s->stream_state_ = BROTLI_STREAM_FLUSH_REQUESTED;
@@ -1675,6 +1854,7 @@ static BROTLI_BOOL BrotliEncoderCompressStreamFast(
       table = GetHashTable(s, s->params.quality, block_size, &table_size);
       if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
 
+      BROTLI_STATS_ONLY(stage_start = BrotliStatsNow();)
       if (s->params.quality == FAST_ONE_PASS_COMPRESSION_QUALITY) {
         BrotliCompressFragmentFast(m, *next_in, block_size, is_last, table,
             table_size, s->cmd_depths_, s->cmd_bits_, &s->cmd_code_numbits_,
@@ -1686,6 +1866,8 @@ static BROTLI_BOOL BrotliEncoderCompressStreamFast(
             &storage_ix, storage);
         if (BROTLI_IS_OOM(m)) return BROTLI_FALSE;
       }
+      BROTLI_STATS_ADD_TIME(m->stats, fragment_ns, stage_start);
+      BROTLI_STATS_ADD(m->stats, bytes_in, block_size);
       *next_in += block_size;
       *available_in -= block_size;
       if (inplace) {
@@ -1799,7 +1981,7 @@ static void UpdateSizeHint(BrotliEncoderState* s, size_t available_in) {
   }
 }
 
-BROTLI_BOOL BrotliEncoderCompressStream(
+static BROTLI_BOOL CompressStream(
     BrotliEncoderState* s, BrotliEncoderOperation op, size_t* available_in,
     const uint8_t** next_in, size_t* available_out,uint8_t** next_out,
     size_t* total_out) {
@@ -1888,6 +2070,196 @@ BROTLI_BOOL BrotliEncoderCompressStream(
   return BROTLI_TRUE;
 }
 
+static BROTLI_BOOL AppendSeekTableEntry(BrotliEncoderState* s,
+    uint64_t compressed_offset, uint64_t uncompressed_offset) {
+  MemoryManager* m = &s->memory_manager_;
+  if (s->seek_table_size_ >= 2 * BROTLI_SEEK_TABLE_MAX_SEGMENTS) {
+    return BROTLI_FALSE;
+  }
+  BROTLI_ENSURE_CAPACITY(m, uint64_t, s->seek_table_, s->seek_table_capacity_,
+      s->seek_table_size_ + 2);
+  if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(s->seek_table_)) return BROTLI_FALSE;
+  s->seek_table_[s->seek_table_size_++] = compressed_offset;
+  s->seek_table_[s->seek_table_size_++] = uncompressed_offset;
+  return BROTLI_TRUE;
+}
+
+/* Resets compression state, so that the next segment is compressed like by a
+   fresh instance with BROTLI_PARAM_STREAM_OFFSET set to |segment_start_|.
+   Current segment MUST be flushed and all its output pushed. */
+static BROTLI_BOOL StartNextSegment(BrotliEncoderState* s) {
+  MemoryManager* m = &s->memory_manager_;
+  RingBufferFree(m, &s->ringbuffer_);
+  RingBufferInit(&s->ringbuffer_);
+  HasherReset(&s->hasher_);
+  s->input_pos_ = 0;
+  s->num_commands_ = 0;
+  s->num_literals_ = 0;
+  s->last_insert_len_ = 0;
+  s->last_flush_pos_ = 0;
+  s->last_processed_pos_ = 0;
+  s->prev_byte_ = 0;
+  s->prev_byte2_ = 0;
+  s->params.stream_offset = (s->segment_start_ < (1u << 30)) ?
+      (size_t)s->segment_start_ : (1u << 30);
+  s->is_initialized_ = BROTLI_FALSE;
+  return EnsureInitialized(s);
+}
+
+/* Emits seek table metadata block; sets |is_seek_table_emitted_| when the
+   whole block is pushed to output. */
+static BROTLI_BOOL EmitSeekTable(BrotliEncoderState* s,
+    size_t* available_out, uint8_t** next_out, size_t* total_out) {
+  const size_t block_size = s->seek_table_size_ * 8 +
+      BROTLI_SEEK_TABLE_TAIL_SIZE;
+  size_t available_in;
+  const uint8_t* next_in;
+  if (!s->seek_table_block_) {
+    MemoryManager* m = &s->memory_manager_;
+    uint8_t* block = BROTLI_ALLOC(m, uint8_t, block_size);
+    size_t i;
+    size_t j;
+    if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(block)) return BROTLI_FALSE;
+    for (i = 0; i < s->seek_table_size_; ++i) {
+      uint64_t value = s->seek_table_[i];
+      for (j = 0; j < 8; ++j) {
+        block[8 * i + j] = (uint8_t)value;
+        value >>= 8;
+      }
+    }
+    for (j = 0; j < 4; ++j) {
+      block[block_size - 8 + j] =
+          (uint8_t)((s->seek_table_size_ / 2) >> (8 * j));
+      block[block_size - 4 + j] =
+          (uint8_t)(BROTLI_SEEK_TABLE_SIGNATURE >> (8 * j));
+    }
+    s->seek_table_block_ = block;
+  }
+  available_in = (s->remaining_metadata_bytes_ == BROTLI_UINT32_MAX) ?
+      block_size : s->remaining_metadata_bytes_;
+  next_in = s->seek_table_block_ + (block_size - available_in);
+  if (!CompressStream(s, BROTLI_OPERATION_EMIT_METADATA, &available_in,
+      &next_in, available_out, next_out, total_out)) {
+    return BROTLI_FALSE;
+  }
+  if (s->stream_state_ == BROTLI_STREAM_PROCESSING &&
+      !BrotliEncoderHasMoreOutput(s)) {
+    BROTLI_FREE(&s->memory_manager_, s->seek_table_block_);
+    s->is_seek_table_emitted_ = BROTLI_TRUE;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Seekable stream workflow: input is cut into segments; each segment is
+   flushed before the next one is started. On finish, the last segment is
+   flushed, then seek table and empty last metablock are emitted. */
+static BROTLI_BOOL CompressStreamSegmented(
+    BrotliEncoderState* s, BrotliEncoderOperation op, size_t* available_in,
+    const uint8_t** next_in, size_t* available_out, uint8_t** next_out,
+    size_t* total_out) {
+  if (s->seek_table_size_ == 0 && !AppendSeekTableEntry(s, 0, 0)) {
+    return BROTLI_FALSE;
+  }
+  while (BROTLI_TRUE) {
+    const uint64_t segment_end = s->segment_start_ + s->params.segment_size;
+    BrotliEncoderOperation segment_op = op;
+    size_t segment_input;
+    size_t available;
+
+    if (s->is_seek_table_emitted_) {
+      if (*available_in != 0) return BROTLI_FALSE;
+      return CompressStream(s, BROTLI_OPERATION_FINISH, available_in, next_in,
+          available_out, next_out, total_out);
+    }
+    if (s->seek_table_block_) {
+      if (*available_in != 0) return BROTLI_FALSE;
+      if (!EmitSeekTable(s, available_out, next_out, total_out)) {
+        return BROTLI_FALSE;
+      }
+      if (!s->is_seek_table_emitted_) return BROTLI_TRUE;
+      continue;
+    }
+
+    if (s->stream_input_size_ == segment_end && *available_in != 0) {
+      size_t zero = 0;
+      if (!CompressStream(s, BROTLI_OPERATION_FLUSH, &zero, next_in,
+          available_out, next_out, total_out)) {
+        return BROTLI_FALSE;
+      }
+      if (s->stream_state_ != BROTLI_STREAM_PROCESSING ||
+          BrotliEncoderHasMoreOutput(s)) {
+        return BROTLI_TRUE;
+      }
+      if (!AppendSeekTableEntry(s, s->total_out_, segment_end)) {
+        return BROTLI_FALSE;
+      }
+      s->segment_start_ = segment_end;
+      if (!StartNextSegment(s)) return BROTLI_FALSE;
+      continue;
+    }
+
+    segment_input = *available_in;
+    if (segment_input > segment_end - s->stream_input_size_) {
+      segment_input = (size_t)(segment_end - s->stream_input_size_);
+    }
+    if (segment_input != *available_in) {
+      segment_op = BROTLI_OPERATION_PROCESS;
+    } else if (op == BROTLI_OPERATION_FINISH) {
+      /* Last metablock is emitted after seek table. */
+      segment_op = BROTLI_OPERATION_FLUSH;
+    }
+    available = segment_input;
+    if (!CompressStream(s, segment_op, &available, next_in,
+        available_out, next_out, total_out)) {
+      return BROTLI_FALSE;
+    }
+    s->stream_input_size_ += segment_input - available;
+    *available_in -= segment_input - available;
+    if (available != 0) return BROTLI_TRUE;
+    if (*available_in != 0) continue;
+
+    if (op != BROTLI_OPERATION_FINISH ||
+        s->stream_state_ != BROTLI_STREAM_PROCESSING ||
+        BrotliEncoderHasMoreOutput(s)) {
+      return BROTLI_TRUE;
+    }
+    if (!EmitSeekTable(s, available_out, next_out, total_out)) {
+      return BROTLI_FALSE;
+    }
+    if (!s->is_seek_table_emitted_) return BROTLI_TRUE;
+  }
+}
+
+BROTLI_BOOL BrotliEncoderCompressStream(
+    BrotliEncoderState* s, BrotliEncoderOperation op, size_t* available_in,
+    const uint8_t** next_in, size_t* available_out,uint8_t** next_out,
+    size_t* total_out) {
+  size_t input_size = *available_in;
+  BROTLI_BOOL result;
+  if (op == BROTLI_OPERATION_EMIT_METADATA) {
+    return CompressStream(
+        s, op, available_in, next_in, available_out, next_out, total_out);
+  }
+  /* Declared content size is emitted before the data, so the input must not
+     deviate from it. */
+  if (s->params.content_size != 0) {
+    uint64_t expected = s->stream_input_size_ + input_size;
+    if (expected > s->params.content_size) return BROTLI_FALSE;
+    if (op == BROTLI_OPERATION_FINISH &&
+        expected != s->params.content_size) {
+      return BROTLI_FALSE;
+    }
+  }
+  if (s->params.segment_size != 0) {
+    return CompressStreamSegmented(
+        s, op, available_in, next_in, available_out, next_out, total_out);
+  }
+  result = CompressStream(
+      s, op, available_in, next_in, available_out, next_out, total_out);
+  s->stream_input_size_ += input_size - *available_in;
+  return result;
+}
+
 BROTLI_BOOL BrotliEncoderIsFinished(BrotliEncoderState* s) {
   return TO_BROTLI_BOOL(s->stream_state_ == BROTLI_STREAM_FINISHED &&
       !BrotliEncoderHasMoreOutput(s));
@@ -1916,6 +2288,21 @@ const uint8_t* BrotliEncoderTakeOutput(BrotliEncoderState* s, size_t* size) {
   return result;
 }
 
+BROTLI_BOOL BrotliEncoderGetStats(
+    const BrotliEncoderState* s, BrotliEncoderStats* stats) {
+#if defined(BROTLI_ENCODER_STATS)
+  *stats = s->stats_;
+  stats->bytes_out = s->total_out_;
+  stats->hasher_probes = s->hasher_.common.num_probes;
+  stats->hasher_hits = s->hasher_.common.num_hits;
+  return BROTLI_TRUE;
+#else  /* BROTLI_ENCODER_STATS */
+  BROTLI_UNUSED(s);
+  memset(stats, 0, sizeof(*stats));
+  return BROTLI_FALSE;
+#endif  /* BROTLI_ENCODER_STATS */
+}
+
 uint32_t BrotliEncoderVersion(void) {
   return BROTLI_VERSION;
 }
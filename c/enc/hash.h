@@ -38,6 +38,12 @@ typedef struct {
 
   /* False if hasher needs to be "prepared" before use. */
   BROTLI_BOOL is_prepared_;
+
+#if defined(BROTLI_ENCODER_STATS)
+  /* Match searches, and searches that found a match; never reset. */
+  size_t num_probes;
+  size_t num_hits;
+#endif  /* BROTLI_ENCODER_STATS */
 } HasherCommon;
 
 #define score_t size_t
@@ -392,6 +398,10 @@ typedef struct {
 /* MUST be invoked before any other method. */
 static BROTLI_INLINE void HasherInit(Hasher* hasher) {
   hasher->common.extra = NULL;
+#if defined(BROTLI_ENCODER_STATS)
+  hasher->common.num_probes = 0;
+  hasher->common.num_hits = 0;
+#endif  /* BROTLI_ENCODER_STATS */
 }
 
 static BROTLI_INLINE void DestroyHasher(MemoryManager* m, Hasher* hasher) {
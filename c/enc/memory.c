@@ -39,6 +39,9 @@ void BrotliInitMemoryManager(
     m->free_func = free_func;
     m->opaque = opaque;
   }
+#if defined(BROTLI_ENCODER_STATS)
+  m->stats = NULL;
+#endif  /* BROTLI_ENCODER_STATS */
 #if !defined(BROTLI_ENCODER_EXIT_ON_OOM)
   m->is_oom = BROTLI_FALSE;
   m->perm_allocated = 0;
@@ -27,6 +27,10 @@ typedef struct MemoryManager {
   brotli_alloc_func alloc_func;
   brotli_free_func free_func;
   void* opaque;
+#if defined(BROTLI_ENCODER_STATS)
+  /* Statistics of the owning encoder, or NULL; see stats.h. */
+  struct BrotliEncoderStats* stats;
+#endif  /* BROTLI_ENCODER_STATS */
 #if !defined(BROTLI_ENCODER_EXIT_ON_OOM)
   BROTLI_BOOL is_oom;
   size_t perm_allocated;
@@ -20,6 +20,7 @@
 #include "./histogram.h"
 #include "./memory.h"
 #include "./quality.h"
+#include "./stats.h"
 
 #if defined(__cplusplus) || defined(c_plusplus)
 extern "C" {
@@ -149,6 +150,7 @@ void BrotliBuildMetaBlock(MemoryManager* m,
   double best_dist_cost = 1e99;
   BrotliEncoderParams orig_params = *params;
   BrotliEncoderParams new_params = *params;
+  BROTLI_STATS_ONLY(uint64_t clustering_start;)
 
   for (npostfix = 0; npostfix <= BROTLI_MAX_NPOSTFIX; npostfix++) {
     for (; ndirect_msb < 16; ndirect_msb++) {
@@ -242,10 +244,12 @@ void BrotliBuildMetaBlock(MemoryManager* m,
       BROTLI_ALLOC(m, HistogramLiteral, mb->literal_histograms_size);
   if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(mb->literal_histograms)) return;
 
+  BROTLI_STATS_ONLY(clustering_start = BrotliStatsNow();)
   BrotliClusterHistogramsLiteral(m, literal_histograms, literal_histograms_size,
       kMaxNumberOfHistograms, mb->literal_histograms,
       &mb->literal_histograms_size, mb->literal_context_map);
   if (BROTLI_IS_OOM(m)) return;
+  BROTLI_STATS_ADD_TIME(m->stats, clustering_ns, clustering_start);
   BROTLI_FREE(m, literal_histograms);
 
   if (params->disable_literal_context_modeling) {
@@ -273,6 +277,7 @@ void BrotliBuildMetaBlock(MemoryManager* m,
       BROTLI_ALLOC(m, HistogramDistance, mb->distance_histograms_size);
   if (BROTLI_IS_OOM(m) || BROTLI_IS_NULL(mb->distance_histograms)) return;
 
+  BROTLI_STATS_ONLY(clustering_start = BrotliStatsNow();)
   BrotliClusterHistogramsDistance(m, distance_histograms,
                                   mb->distance_context_map_size,
                                   kMaxNumberOfHistograms,
@@ -280,6 +285,7 @@ void BrotliBuildMetaBlock(MemoryManager* m,
                                   &mb->distance_histograms_size,
                                   mb->distance_context_map);
   if (BROTLI_IS_OOM(m)) return;
+  BROTLI_STATS_ADD_TIME(m->stats, clustering_ns, clustering_start);
   BROTLI_FREE(m, distance_histograms);
 }
 
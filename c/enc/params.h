@@ -36,6 +36,8 @@ typedef struct BrotliEncoderParams {
   int lgblock;
   size_t stream_offset;
   size_t size_hint;
+  size_t content_size;
+  size_t segment_size;
   BROTLI_BOOL disable_literal_context_modeling;
   BROTLI_BOOL large_window;
   BrotliHasherParams hasher;
@@ -0,0 +1,62 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Opt-in encoder instrumentation for BrotliEncoderGetStats.
+   Unless BROTLI_ENCODER_STATS is defined, all macros expand to nothing. */
+
+#ifndef BROTLI_ENC_STATS_H_
+#define BROTLI_ENC_STATS_H_
+
+#include "../common/platform.h"
+#include <brotli/encode.h>
+#include <brotli/types.h>
+
+#if defined(BROTLI_ENCODER_STATS)
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+/* Returns monotonic time in nanoseconds. */
+static BROTLI_INLINE uint64_t BrotliStatsNow(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)((double)counter.QuadPart * 1e9 /
+                    (double)frequency.QuadPart);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/* Keeps |X| (declarations or statements) only in instrumented builds. */
+#define BROTLI_STATS_ONLY(X) X
+
+/* Adds |VALUE| to the |FIELD| counter of |STATS|; |STATS| may be NULL. */
+#define BROTLI_STATS_ADD(STATS, FIELD, VALUE)                   \
+  do {                                                          \
+    if (STATS) (STATS)->FIELD += (uint64_t)(VALUE);             \
+  } while (0)
+
+/* Adds the time elapsed since |START| to the |FIELD| timer of |STATS|. */
+#define BROTLI_STATS_ADD_TIME(STATS, FIELD, START) \
+  BROTLI_STATS_ADD(STATS, FIELD, BrotliStatsNow() - (START))
+
+#else  /* BROTLI_ENCODER_STATS */
+
+#define BROTLI_STATS_ONLY(X)
+#define BROTLI_STATS_ADD(STATS, FIELD, VALUE)
+#define BROTLI_STATS_ADD_TIME(STATS, FIELD, START)
+
+#endif  /* BROTLI_ENCODER_STATS */
+
+#endif  /* BROTLI_ENC_STATS_H_ */
@@ -139,7 +139,18 @@ typedef enum BrotliDecoderParameter {
   /**
    * Flag that determines if "Large Window Brotli" is used.
    */
-  BROTLI_DECODER_PARAM_LARGE_WINDOW = 1
+  BROTLI_DECODER_PARAM_LARGE_WINDOW = 1,
+  /**
+   * Flag that enables validate-only mode.
+   *
+   * Stream is fully parsed and checked, but decoded data is discarded instead
+   * of being written to @p next_out; output buffer is never used, and decoding
+   * never stops with ::BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT. @p total_out
+   * still reports the size of decoded data. Data referenced by backward
+   * references and literal context modeling still has to be kept in the ring
+   * buffer, so memory usage is bounded by window size.
+   */
+  BROTLI_DECODER_PARAM_VALIDATE_ONLY = 2
 } BrotliDecoderParameter;
 
 /**
@@ -205,6 +216,143 @@ BROTLI_DEC_API BrotliDecoderResult BrotliDecoderDecompress(
     size_t* decoded_size,
     uint8_t decoded_buffer[BROTLI_ARRAY_PARAM(*decoded_size)]);
 
+/**
+ * Calculates the decompressed size of the data without storing it.
+ *
+ * The stream is decoded in ::BROTLI_DECODER_PARAM_VALIDATE_ONLY mode, so no
+ * output buffer is needed, and the result can be used to allocate one for
+ * ::BrotliDecoderDecompress.
+ *
+ * If the input is truncated, @p *decoded_size is set to the amount of data
+ * covered by the metablock headers present in the input, i.e. the data
+ * already decoded plus the rest of the metablock being decoded. This bound
+ * holds for any continuation of the input that does not add metablocks.
+ *
+ * @param encoded_size size of @p encoded_buffer
+ * @param encoded_buffer compressed data buffer with at least @p encoded_size
+ *        addressable bytes
+ * @param[out] decoded_size decompressed size, or its bound (see above)
+ * @returns ::BROTLI_DECODER_RESULT_ERROR if input is corrupted, or memory
+ *          allocation failed; @p *decoded_size is set to @c 0
+ * @returns ::BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT if input is truncated
+ * @returns ::BROTLI_DECODER_RESULT_SUCCESS if @p *decoded_size is exact
+ */
+BROTLI_DEC_API BrotliDecoderResult BrotliDecoderDecompressedSize(
+    size_t encoded_size,
+    const uint8_t encoded_buffer[BROTLI_ARRAY_PARAM(encoded_size)],
+    size_t* decoded_size);
+
+/**
+ * Reads the content size recorded by the encoder.
+ *
+ * Looks for the content size metadata block, emitted by the encoder when
+ * ::BROTLI_PARAM_CONTENT_SIZE is set, right after the stream header. Only the
+ * first few bytes of the stream are inspected; nothing is decoded.
+ *
+ * @param encoded_size size of @p encoded_buffer
+ * @param encoded_buffer beginning of the compressed stream; 20 bytes are
+ *        enough to cover the content size block
+ * @param[out] content_size uncompressed size of the stream
+ * @returns ::BROTLI_FALSE if the stream does not start with a content size
+ *          block, or @p encoded_buffer is too short to contain it
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_DEC_API BROTLI_BOOL BrotliDecoderPeekContentSize(
+    size_t encoded_size,
+    const uint8_t encoded_buffer[BROTLI_ARRAY_PARAM(encoded_size)],
+    uint64_t* content_size);
+
+/** Seek table entry of a seekable stream. */
+typedef struct BrotliDecoderSegment {
+  /** Offset of the segment in the compressed stream. */
+  uint64_t compressed_offset;
+  /** Offset of the segment data in the decompressed stream. */
+  uint64_t uncompressed_offset;
+} BrotliDecoderSegment;
+
+/**
+ * Reads the seek table of a seekable stream.
+ *
+ * Seek table is a metadata block at the end of the stream, emitted by the
+ * encoder when ::BROTLI_PARAM_SEGMENT_SIZE is set. Only the tail of the stream
+ * is inspected; nothing is decoded.
+ *
+ * @param encoded_size size of @p encoded_buffer
+ * @param encoded_buffer end of the compressed stream, that contains the whole
+ *        seek table block; offsets are relative to the beginning of the stream
+ *        anyway
+ * @param[in, out] num_segments @b in: capacity of @p segments; @b out: number
+ *        of segments in the stream
+ * @param[out] segments seek table entries, in the stream order; the first
+ *        entry is always the beginning of the stream; if @c NULL, only
+ *        @p *num_segments is set
+ * @returns ::BROTLI_FALSE if the stream does not end with a valid seek table,
+ *          or @p segments is too small to hold it
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_DEC_API BROTLI_BOOL BrotliDecoderGetSeekTable(
+    size_t encoded_size,
+    const uint8_t encoded_buffer[BROTLI_ARRAY_PARAM(encoded_size)],
+    size_t* num_segments, BrotliDecoderSegment* segments);
+
+/**
+ * Prepares a fresh decoder instance to decode a seekable stream from the
+ * given segment.
+ *
+ * After this call the input for ::BrotliDecoderDecompressStream should start
+ * at @p segment->compressed_offset. Decoded data before @p offset is
+ * discarded, so the first output byte is the one at @p offset of the
+ * decompressed stream; @c total_out still counts from the beginning of the
+ * stream. Decoding continues until the end of the stream, or until the
+ * client stops.
+ *
+ * @param state fresh decoder instance
+ * @param header_size size of @p header
+ * @param header beginning of the compressed stream; 2 bytes are enough to
+ *        read the window size
+ * @param segment seek table entry, see ::BrotliDecoderGetSeekTable
+ * @param offset position in the decompressed stream to start output from; it
+ *        should not be less than @p segment->uncompressed_offset
+ * @returns ::BROTLI_FALSE if instance is already used, header is invalid,
+ *          arguments are inconsistent, or memory allocation failed
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_DEC_API BROTLI_BOOL BrotliDecoderSeek(BrotliDecoderState* state,
+    size_t header_size, const uint8_t header[BROTLI_ARRAY_PARAM(header_size)],
+    const BrotliDecoderSegment* segment, uint64_t offset);
+
+/**
+ * Decompresses a range of a seekable stream.
+ *
+ * Only the segments that cover the requested range are decoded: decoding
+ * starts at the last segment that begins at or before @p offset and stops as
+ * soon as the output buffer is full. Large window streams are supported.
+ *
+ * @param encoded_size size of @p encoded_buffer
+ * @param encoded_buffer the whole compressed stream
+ * @param num_segments number of entries in @p segments
+ * @param segments seek table, see ::BrotliDecoderGetSeekTable; could be kept
+ *        apart from the stream; if @c NULL, the table embedded in the stream
+ *        is used
+ * @param offset position of the range in the decompressed stream
+ * @param[in, out] length @b in: size of the range; @b out: number of bytes
+ *        written to @p decoded_buffer; less than requested if the stream
+ *        ends before the end of the range
+ * @param[out] decoded_buffer buffer for the range data, with at least
+ *        @p *length addressable bytes
+ * @returns ::BROTLI_DECODER_RESULT_ERROR if input is corrupted, there is no
+ *          seek table, or memory allocation failed
+ * @returns ::BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT if input is truncated
+ *          before the end of the range
+ * @returns ::BROTLI_DECODER_RESULT_SUCCESS otherwise
+ */
+BROTLI_DEC_API BrotliDecoderResult BrotliDecoderDecompressRange(
+    size_t encoded_size,
+    const uint8_t encoded_buffer[BROTLI_ARRAY_PARAM(encoded_size)],
+    size_t num_segments, const BrotliDecoderSegment* segments,
+    uint64_t offset, size_t* length,
+    uint8_t decoded_buffer[BROTLI_ARRAY_PARAM(*length)]);
+
 /**
  * Decompresses the input stream to the output stream.
  *
@@ -330,6 +478,86 @@ BROTLI_DEC_API BrotliDecoderErrorCode BrotliDecoderGetErrorCode(
  */
 BROTLI_DEC_API const char* BrotliDecoderErrorString(BrotliDecoderErrorCode c);
 
+/**
+ * Decoder statistics.
+ *
+ * Filled by ::BrotliDecoderGetStats. Counters are accumulated over the
+ * lifetime of the decoder instance. Average copy length is
+ * @c copy_bytes / @c num_copies.
+ */
+typedef struct BrotliDecoderStats {
+  /** Number of decoded metablocks, including metadata and empty ones. */
+  uint64_t num_metablocks;
+  /** Number of Huffman tables built for literal, command and distance codes. */
+  uint64_t huffman_tables;
+  /** Total number of entries in built Huffman tables. */
+  uint64_t huffman_table_entries;
+  /** Number of Huffman tables reused from earlier metablocks. */
+  uint64_t huffman_cache_hits;
+  /** Number of literal, command and distance block switches. */
+  uint64_t block_switches;
+  /** Number of bytes produced from literals. */
+  uint64_t literal_bytes;
+  /** Number of bytes produced by backward reference copies. */
+  uint64_t copy_bytes;
+  /** Number of backward reference copies. */
+  uint64_t num_copies;
+  /** Number of bytes produced from static dictionary references. */
+  uint64_t dictionary_bytes;
+  /** Number of times output position wrapped around the ring buffer. */
+  uint64_t ring_buffer_wraps;
+  /** Number of uncompressed metablock bytes copied directly to output. */
+  uint64_t passthrough_bytes;
+} BrotliDecoderStats;
+
+/**
+ * Retrieves statistics collected by decoder instance.
+ *
+ * Statistics are collected only if the library is compiled with
+ * @c BROTLI_DECODER_STATS defined; otherwise there is no instrumentation
+ * overhead and this function zeroes @p stats and returns ::BROTLI_FALSE.
+ *
+ * @param state decoder instance
+ * @param[out] stats statistics gathered so far
+ * @returns ::BROTLI_FALSE if statistics are not compiled in
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_DEC_API BROTLI_BOOL BrotliDecoderGetStats(
+    const BrotliDecoderState* state, BrotliDecoderStats* stats);
+
+/**
+ * Stream layout, as seen by the decoder so far.
+ *
+ * Unlike ::BrotliDecoderStats, this information is always collected; it is
+ * updated once per metablock header.
+ */
+typedef struct BrotliDecoderStreamInfo {
+  /** Window size (log2); @c 0 until the stream header is decoded. */
+  uint32_t window_bits;
+  /** ::BROTLI_TRUE if the stream uses large window brotli bitstream. */
+  BROTLI_BOOL large_window;
+  /** Number of decoded metablock headers, including metadata and empty ones. */
+  uint64_t num_metablocks;
+  /** Number of uncompressed metablocks. */
+  uint64_t num_uncompressed_metablocks;
+  /** Number of metadata blocks. */
+  uint64_t num_metadata_blocks;
+  /** Total size of metadata block payloads. */
+  uint64_t metadata_bytes;
+} BrotliDecoderStreamInfo;
+
+/**
+ * Retrieves the layout of the stream decoded so far.
+ *
+ * Combined with ::BROTLI_DECODER_PARAM_VALIDATE_ONLY this allows inspecting a
+ * stream without producing output.
+ *
+ * @param state decoder instance
+ * @param[out] info stream layout
+ */
+BROTLI_DEC_API void BrotliDecoderGetStreamInfo(
+    const BrotliDecoderState* state, BrotliDecoderStreamInfo* info);
+
 /**
  * Gets a decoder library version.
  *
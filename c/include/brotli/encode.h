@@ -217,7 +217,42 @@ typedef enum BrotliEncoderParameter {
    * maximal window size have the same effect. Values greater than 2**30 are not
    * allowed.
    */
-  BROTLI_PARAM_STREAM_OFFSET = 9
+  BROTLI_PARAM_STREAM_OFFSET = 9,
+  /**
+   * Exact total input size for all ::BrotliEncoderCompressStream calls.
+   *
+   * If set, the uncompressed size is recorded in a metadata block at the
+   * beginning of the stream, and can be read with
+   * ::BrotliDecoderPeekContentSize. Decoders that do not look for it skip the
+   * block like any other metadata. Compression fails if the actual input size
+   * differs from this value.
+   *
+   * The block payload is 4 bytes of signature "BRSZ" followed by the size as
+   * 64-bit little-endian integer. Readers should ignore any bytes after that.
+   *
+   * The default value is 0, which means that the size is not recorded.
+   * The block is not emitted if ::BROTLI_PARAM_STREAM_OFFSET is set.
+   */
+  BROTLI_PARAM_CONTENT_SIZE = 10,
+  /**
+   * Size of independently decodable segments of seekable stream.
+   *
+   * If set, input is cut into segments of this size. Each segment starts at
+   * byte boundary and is compressed like a separate encoder instance
+   * with ::BROTLI_PARAM_STREAM_OFFSET set to the segment offset would do,
+   * i.e. without references to the data of previous segments. Size hint is
+   * set to the segment size. When stream is finished, the offsets of segments
+   * are recorded in a seek table metadata block at the end of the stream; it
+   * can be read with ::BrotliDecoderGetSeekTable, and decoding could be
+   * started from any segment with ::BrotliDecoderSeek. Decoders that do not
+   * look for it skip the block like any other metadata.
+   *
+   * Streams could not have more than 1048575 segments; compression fails if
+   * input is longer.
+   *
+   * The default value is 0, which means that stream is not segmented.
+   */
+  BROTLI_PARAM_SEGMENT_SIZE = 11
 } BrotliEncoderParameter;
 
 /**
@@ -434,6 +469,59 @@ BROTLI_ENC_API const uint8_t* BrotliEncoderTakeOutput(
     BrotliEncoderState* state, size_t* size);
 
 
+/**
+ * Encoder statistics.
+ *
+ * Filled by ::BrotliEncoderGetStats. Times are measured with a monotonic clock
+ * and accumulated over the lifetime of the encoder instance. Stage timers and
+ * metablock counters cover qualities 2 and above, where input passes through
+ * separate backward reference search, metablock building and storing stages.
+ */
+typedef struct BrotliEncoderStats {
+  /** Nanoseconds spent in backward reference (match) search. */
+  uint64_t backward_references_ns;
+  /**
+   * Nanoseconds spent in block splitting and context modeling; includes
+   * @c clustering_ns.
+   */
+  uint64_t metablock_build_ns;
+  /** Nanoseconds spent in histogram clustering. */
+  uint64_t clustering_ns;
+  /** Nanoseconds spent in entropy coding and bit emission of metablocks. */
+  uint64_t metablock_store_ns;
+  /** Nanoseconds spent in quality 0 and 1 fragment compressors. */
+  uint64_t fragment_ns;
+  /** Number of input bytes compressed. */
+  uint64_t bytes_in;
+  /** Number of compressed bytes handed out to the caller. */
+  uint64_t bytes_out;
+  /** Number of insert-and-copy commands in emitted metablocks. */
+  uint64_t num_commands;
+  /** Number of literals in emitted metablocks. */
+  uint64_t num_literals;
+  /** Number of emitted metablocks. */
+  uint64_t num_metablocks;
+  /** Number of hash table lookups made by backward reference search. */
+  uint64_t hasher_probes;
+  /** Number of hash table lookups that found a usable match. */
+  uint64_t hasher_hits;
+} BrotliEncoderStats;
+
+/**
+ * Retrieves statistics collected by encoder instance.
+ *
+ * Statistics are collected only if the library is compiled with
+ * @c BROTLI_ENCODER_STATS defined; otherwise there is no instrumentation
+ * overhead and this function zeroes @p stats and returns ::BROTLI_FALSE.
+ *
+ * @param state encoder instance
+ * @param[out] stats statistics gathered so far
+ * @returns ::BROTLI_FALSE if statistics are not compiled in
+ * @returns ::BROTLI_TRUE otherwise
+ */
+BROTLI_ENC_API BROTLI_BOOL BrotliEncoderGetStats(
+    const BrotliEncoderState* state, BrotliEncoderStats* stats);
+
 /**
  * Gets an encoder library version.
  *
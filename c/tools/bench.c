@@ -0,0 +1,612 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Compression and decompression throughput benchmark for Brotli library.
+
+   Every file of the corpus is compressed and decompressed with each
+   requested combination of quality, window and mode. The first run of every
+   combination starts with empty allocation pool ("cold"); subsequent runs
+   recycle memory blocks released by the previous encoder / decoder instances,
+   so they measure steady-state cost without allocation and page-fault
+   overhead. The pool also counts bytes held by encoder / decoder instances;
+   the reported peak is measured per combination, not for the whole process,
+   and excludes the corpus buffers owned by the benchmark itself. */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#include "./bench_util.h"
+
+#if !defined(_WIN32)
+#include <dirent.h>
+#else
+#include <windows.h>
+#endif  /* WIN32 */
+
+#if !defined(BROTLI_BENCH_DEFAULT_CORPUS)
+#define BROTLI_BENCH_DEFAULT_CORPUS "tests/testdata"
+#endif
+
+#define DEFAULT_REPETITIONS 5
+#define MAX_FILES 1024
+#define MAX_POOL_BLOCKS 256
+/* Every block is prefixed with its size; keeps 16-byte payload alignment. */
+#define BLOCK_HEADER_SIZE 16
+#define MAX_PATH_LENGTH 4096
+
+typedef struct {
+  char* path;
+  uint8_t* data;
+  size_t size;
+  uint8_t* compressed;
+  size_t compressed_capacity;
+  size_t compressed_size;
+  uint8_t* decompressed;
+} CorpusFile;
+
+/* Allocator that keeps released blocks for reuse by next instances and
+   tracks the peak number of bytes in use. */
+typedef struct {
+  void* blocks[MAX_POOL_BLOCKS];
+  size_t sizes[MAX_POOL_BLOCKS];
+  BROTLI_BOOL in_use[MAX_POOL_BLOCKS];
+  size_t num_blocks;
+  size_t used_bytes;
+  size_t peak_bytes;
+} BlockPool;
+
+typedef struct {
+  double cold_ns;
+  double min_ns;
+  double p50_ns;
+  double p90_ns;
+  double p99_ns;
+} Timings;
+
+typedef struct {
+  /* Parameters */
+  int min_quality;
+  int max_quality;
+  int min_lgwin;
+  int max_lgwin;
+  BROTLI_BOOL modes[3];
+  int repetitions;
+  const char* json_path;
+
+  /* Corpus */
+  CorpusFile files[MAX_FILES];
+  size_t num_files;
+  size_t total_size;
+
+  /* Inner state */
+  BlockPool pool;
+  double* samples;
+  FILE* json;
+  BROTLI_BOOL json_first_result;
+} Context;
+
+static const char* kModeNames[3] = {"generic", "text", "font"};
+
+static void PoolCount(BlockPool* pool, size_t size) {
+  pool->used_bytes += size;
+  if (pool->used_bytes > pool->peak_bytes) pool->peak_bytes = pool->used_bytes;
+}
+
+static void* PoolAlloc(void* opaque, size_t size) {
+  BlockPool* pool = (BlockPool*)opaque;
+  size_t i;
+  uint8_t* block;
+  for (i = 0; i < pool->num_blocks; ++i) {
+    if (!pool->in_use[i] && pool->sizes[i] == size) {
+      pool->in_use[i] = BROTLI_TRUE;
+      PoolCount(pool, size);
+      return (uint8_t*)pool->blocks[i] + BLOCK_HEADER_SIZE;
+    }
+  }
+  if (size > ~(size_t)0 - BLOCK_HEADER_SIZE) return NULL;
+  block = (uint8_t*)malloc(size + BLOCK_HEADER_SIZE);
+  if (!block) return NULL;
+  memcpy(block, &size, sizeof(size));
+  if (pool->num_blocks < MAX_POOL_BLOCKS) {
+    pool->blocks[pool->num_blocks] = block;
+    pool->sizes[pool->num_blocks] = size;
+    pool->in_use[pool->num_blocks] = BROTLI_TRUE;
+    pool->num_blocks++;
+  }
+  PoolCount(pool, size);
+  return block + BLOCK_HEADER_SIZE;
+}
+
+static void PoolFree(void* opaque, void* address) {
+  BlockPool* pool = (BlockPool*)opaque;
+  uint8_t* block;
+  size_t size;
+  size_t i;
+  if (!address) return;
+  block = (uint8_t*)address - BLOCK_HEADER_SIZE;
+  memcpy(&size, block, sizeof(size));
+  pool->used_bytes -= size;
+  for (i = 0; i < pool->num_blocks; ++i) {
+    if (pool->blocks[i] == block) {
+      pool->in_use[i] = BROTLI_FALSE;
+      return;
+    }
+  }
+  free(block);
+}
+
+/* Releases all cached blocks; next run starts with cold allocations. */
+static void PoolRelease(BlockPool* pool) {
+  size_t i;
+  for (i = 0; i < pool->num_blocks; ++i) free(pool->blocks[i]);
+  pool->num_blocks = 0;
+  pool->peak_bytes = pool->used_bytes;
+}
+
+/* Parses "A" or "A-B" range of decimal numbers within [low, high]. */
+static BROTLI_BOOL ParseRange(const char* s, int low, int high,
+                              int* from, int* to) {
+  char* end;
+  long a = strtol(s, &end, 10);
+  long b = a;
+  if (end == s) return BROTLI_FALSE;
+  if (*end == '-') {
+    const char* second = end + 1;
+    b = strtol(second, &end, 10);
+    if (end == second) return BROTLI_FALSE;
+  }
+  if (*end != 0 || a < low || b > high || a > b) return BROTLI_FALSE;
+  *from = (int)a;
+  *to = (int)b;
+  return BROTLI_TRUE;
+}
+
+/* Parses comma-separated list of mode names. */
+static BROTLI_BOOL ParseModes(const char* s, BROTLI_BOOL* modes) {
+  int i;
+  for (i = 0; i < 3; ++i) modes[i] = BROTLI_FALSE;
+  while (*s) {
+    size_t len = strcspn(s, ",");
+    BROTLI_BOOL found = BROTLI_FALSE;
+    for (i = 0; i < 3; ++i) {
+      if (len == strlen(kModeNames[i]) &&
+          strncmp(s, kModeNames[i], len) == 0) {
+        modes[i] = BROTLI_TRUE;
+        found = BROTLI_TRUE;
+      }
+    }
+    if (!found) return BROTLI_FALSE;
+    s += len;
+    if (*s == ',') s++;
+  }
+  return BROTLI_TRUE;
+}
+
+static void PrintHelp(const char* name, BROTLI_BOOL error) {
+  FILE* media = error ? stderr : stdout;
+  fprintf(media,
+"Usage: %s [OPTION]... [FILE|DIR]...\n",
+          name);
+  fprintf(media,
+"Options:\n"
+"  -q A[-B]        quality range (default: %d-%d)\n"
+"  -w A[-B]        LZ77 window range (default: %d-%d)\n",
+          BROTLI_MIN_QUALITY, BROTLI_MAX_QUALITY,
+          BROTLI_MIN_WINDOW_BITS, BROTLI_MAX_WINDOW_BITS);
+  fprintf(media,
+"  -m MODES        comma-separated list of generic, text, font\n"
+"                  (default: all)\n"
+"  -r NUM          steady-state repetitions (default: %d)\n"
+"  -j FILE         write results as JSON to FILE\n"
+"  -h              display this help and exit\n",
+          DEFAULT_REPETITIONS);
+  fprintf(media,
+"Directories are scanned non-recursively; files with '.compressed' in name\n"
+"are skipped there. With no FILE or DIR, '%s' is used.\n"
+"Throughput is reported in MB/s (10^6 bytes per second) over the corpus.\n"
+"Peak memory is the largest amount allocated by encoder or decoder instances\n"
+"of one combination.\n",
+          BROTLI_BENCH_DEFAULT_CORPUS);
+}
+
+static void FreeFile(CorpusFile* file) {
+  free(file->path);
+  free(file->data);
+  free(file->compressed);
+  free(file->decompressed);
+}
+
+static BROTLI_BOOL AddFile(Context* context, const char* path) {
+  CorpusFile* file;
+  FILE* f;
+  long size;
+  if (context->num_files == MAX_FILES) {
+    fprintf(stderr, "too many files in corpus\n");
+    return BROTLI_FALSE;
+  }
+  f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "failed to open input file [%s]: %s\n",
+            path, strerror(errno));
+    return BROTLI_FALSE;
+  }
+  file = &context->files[context->num_files];
+  if (fseek(f, 0L, SEEK_END) != 0 || (size = ftell(f)) < 0 ||
+      fseek(f, 0L, SEEK_SET) != 0) {
+    fprintf(stderr, "failed to get size of [%s]\n", path);
+    fclose(f);
+    return BROTLI_FALSE;
+  }
+  file->size = (size_t)size;
+  file->path = (char*)malloc(strlen(path) + 1);
+  file->data = (uint8_t*)malloc(file->size + 1);
+  /* Streaming output may exceed one-shot bound by a few bytes. */
+  file->compressed_capacity =
+      BrotliEncoderMaxCompressedSize(file->size) + 1024;
+  file->compressed = (uint8_t*)malloc(file->compressed_capacity);
+  file->decompressed = (uint8_t*)malloc(file->size + 1);
+  if (!file->path || !file->data || !file->compressed ||
+      !file->decompressed) {
+    fprintf(stderr, "out of memory\n");
+    fclose(f);
+    FreeFile(file);
+    return BROTLI_FALSE;
+  }
+  strcpy(file->path, path);
+  if (fread(file->data, 1, file->size, f) != file->size) {
+    fprintf(stderr, "failed to read input file [%s]\n", path);
+    fclose(f);
+    FreeFile(file);
+    return BROTLI_FALSE;
+  }
+  fclose(f);
+  file->compressed_size = 0;
+  context->num_files++;
+  context->total_size += file->size;
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL AddDirectory(Context* context, const char* dir) {
+  char path[MAX_PATH_LENGTH];
+#if defined(_WIN32)
+  WIN32_FIND_DATAA entry;
+  HANDLE handle;
+  snprintf(path, sizeof(path), "%s\\*", dir);
+  handle = FindFirstFileA(path, &entry);
+  if (handle == INVALID_HANDLE_VALUE) {
+    fprintf(stderr, "failed to open directory [%s]\n", dir);
+    return BROTLI_FALSE;
+  }
+  do {
+    if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+    if (strstr(entry.cFileName, ".compressed")) continue;
+    snprintf(path, sizeof(path), "%s\\%s", dir, entry.cFileName);
+    if (!AddFile(context, path)) {
+      FindClose(handle);
+      return BROTLI_FALSE;
+    }
+  } while (FindNextFileA(handle, &entry));
+  FindClose(handle);
+#else
+  DIR* d = opendir(dir);
+  struct dirent* entry;
+  struct stat statbuf;
+  if (!d) {
+    fprintf(stderr, "failed to open directory [%s]: %s\n",
+            dir, strerror(errno));
+    return BROTLI_FALSE;
+  }
+  while ((entry = readdir(d)) != NULL) {
+    if (strstr(entry->d_name, ".compressed")) continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    if (stat(path, &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) continue;
+    if (!AddFile(context, path)) {
+      closedir(d);
+      return BROTLI_FALSE;
+    }
+  }
+  closedir(d);
+#endif
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL AddPath(Context* context, const char* path) {
+  struct stat statbuf;
+  if (stat(path, &statbuf) != 0) {
+    fprintf(stderr, "failed to stat [%s]: %s\n", path, strerror(errno));
+    return BROTLI_FALSE;
+  }
+  if ((statbuf.st_mode & S_IFMT) == S_IFDIR) {
+    return AddDirectory(context, path);
+  }
+  return AddFile(context, path);
+}
+
+/* Compresses the whole corpus once; returns elapsed nanoseconds or -1. */
+static double CompressCorpus(Context* context, int quality, int lgwin,
+                             int mode) {
+  double start = BrotliBenchNow();
+  size_t i;
+  for (i = 0; i < context->num_files; ++i) {
+    CorpusFile* file = &context->files[i];
+    file->compressed_size = file->compressed_capacity;
+    if (!BrotliBenchCompress(PoolAlloc, PoolFree, &context->pool, quality,
+        lgwin, (BrotliEncoderMode)mode, file->data, file->size,
+        file->compressed, &file->compressed_size)) {
+      fprintf(stderr, "failed to compress [%s]\n", file->path);
+      return -1.0;
+    }
+  }
+  return BrotliBenchNow() - start;
+}
+
+/* Decompresses the whole corpus once; returns elapsed nanoseconds or -1. */
+static double DecompressCorpus(Context* context) {
+  double start = BrotliBenchNow();
+  size_t i;
+  for (i = 0; i < context->num_files; ++i) {
+    CorpusFile* file = &context->files[i];
+    size_t size = file->size + 1;
+    if (!BrotliBenchDecompress(PoolAlloc, PoolFree, &context->pool,
+        file->compressed, file->compressed_size, file->decompressed, &size) ||
+        size != file->size) {
+      fprintf(stderr, "failed to decompress [%s]\n", file->path);
+      return -1.0;
+    }
+  }
+  return BrotliBenchNow() - start;
+}
+
+static int CompareDoubles(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples. */
+static double Percentile(const double* samples, int count, int percent) {
+  int rank = (int)ceil((double)percent * count / 100.0);
+  if (rank < 1) rank = 1;
+  return samples[rank - 1];
+}
+
+static void Summarize(double* samples, int count, Timings* timings) {
+  qsort(samples, (size_t)count, sizeof(double), CompareDoubles);
+  timings->min_ns = samples[0];
+  timings->p50_ns = Percentile(samples, count, 50);
+  timings->p90_ns = Percentile(samples, count, 90);
+  timings->p99_ns = Percentile(samples, count, 99);
+}
+
+static double MegabytesPerSecond(size_t bytes, double ns) {
+  return ns > 0 ? (double)bytes * 1e3 / ns : 0.0;
+}
+
+static void WriteJsonTimings(FILE* f, const char* name, const Timings* t,
+                             size_t bytes) {
+  fprintf(f, "      \"%s\": {\"cold_ns\": %.0f, \"setup_ns\": %.0f, "
+          "\"min_ns\": %.0f, \"p50_ns\": %.0f, \"p90_ns\": %.0f, "
+          "\"p99_ns\": %.0f, \"mb_per_s\": %.3f}",
+          name, t->cold_ns,
+          t->cold_ns > t->p50_ns ? t->cold_ns - t->p50_ns : 0.0,
+          t->min_ns, t->p50_ns, t->p90_ns, t->p99_ns,
+          MegabytesPerSecond(bytes, t->p50_ns));
+}
+
+static BROTLI_BOOL RunConfiguration(Context* context, int quality, int lgwin,
+                                    int mode) {
+  Timings compress;
+  Timings decompress;
+  size_t compressed_size = 0;
+  double ratio;
+  size_t peak_bytes;
+  int i;
+  size_t j;
+
+  PoolRelease(&context->pool);
+  compress.cold_ns = CompressCorpus(context, quality, lgwin, mode);
+  if (compress.cold_ns < 0) return BROTLI_FALSE;
+  for (i = 0; i < context->repetitions; ++i) {
+    context->samples[i] = CompressCorpus(context, quality, lgwin, mode);
+    if (context->samples[i] < 0) return BROTLI_FALSE;
+  }
+  Summarize(context->samples, context->repetitions, &compress);
+  peak_bytes = context->pool.peak_bytes;
+
+  PoolRelease(&context->pool);
+  decompress.cold_ns = DecompressCorpus(context);
+  if (decompress.cold_ns < 0) return BROTLI_FALSE;
+  for (i = 0; i < context->repetitions; ++i) {
+    context->samples[i] = DecompressCorpus(context);
+    if (context->samples[i] < 0) return BROTLI_FALSE;
+  }
+  Summarize(context->samples, context->repetitions, &decompress);
+  if (context->pool.peak_bytes > peak_bytes) {
+    peak_bytes = context->pool.peak_bytes;
+  }
+
+  for (j = 0; j < context->num_files; ++j) {
+    CorpusFile* file = &context->files[j];
+    if (memcmp(file->data, file->decompressed, file->size) != 0) {
+      fprintf(stderr, "roundtrip mismatch for [%s]\n", file->path);
+      return BROTLI_FALSE;
+    }
+    compressed_size += file->compressed_size;
+  }
+  ratio = compressed_size ?
+      (double)context->total_size / (double)compressed_size : 0.0;
+
+  fprintf(stdout, "%2d %2d %-7s %10lu %7.3f %9.2f %9.2f %9.2f %9.2f %8lu\n",
+          quality, lgwin, kModeNames[mode], (unsigned long)compressed_size,
+          ratio,
+          MegabytesPerSecond(context->total_size, compress.p50_ns),
+          MegabytesPerSecond(context->total_size, compress.p90_ns),
+          MegabytesPerSecond(context->total_size, decompress.p50_ns),
+          MegabytesPerSecond(context->total_size, decompress.p90_ns),
+          (unsigned long)((peak_bytes + 1023) >> 10));
+  fflush(stdout);
+
+  if (context->json) {
+    FILE* f = context->json;
+    fprintf(f, "%s    {\"quality\": %d, \"lgwin\": %d, \"mode\": \"%s\", "
+            "\"compressed_bytes\": %lu, \"ratio\": %.4f, "
+            "\"peak_alloc_bytes\": %lu,\n",
+            context->json_first_result ? "" : ",\n", quality, lgwin,
+            kModeNames[mode], (unsigned long)compressed_size, ratio,
+            (unsigned long)peak_bytes);
+    WriteJsonTimings(f, "compress", &compress, context->total_size);
+    fprintf(f, ",\n");
+    WriteJsonTimings(f, "decompress", &decompress, context->total_size);
+    fprintf(f, "}");
+    context->json_first_result = BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL ParseParams(Context* context, int argc, char** argv) {
+  int i;
+  for (i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    if (arg[0] != '-' || arg[1] == 0) {
+      if (!AddPath(context, arg)) return BROTLI_FALSE;
+      continue;
+    }
+    if (arg[2] != 0 || strchr("qwmrjh", arg[1]) == NULL) {
+      fprintf(stderr, "unknown option [%s]\n", arg);
+      return BROTLI_FALSE;
+    }
+    if (arg[1] == 'h') {
+      PrintHelp(argv[0], BROTLI_FALSE);
+      exit(0);
+    }
+    if (i + 1 == argc) {
+      fprintf(stderr, "option [%s] requires a value\n", arg);
+      return BROTLI_FALSE;
+    }
+    ++i;
+    switch (arg[1]) {
+      case 'q':
+        if (!ParseRange(argv[i], BROTLI_MIN_QUALITY, BROTLI_MAX_QUALITY,
+                        &context->min_quality, &context->max_quality)) {
+          fprintf(stderr, "invalid quality range [%s]\n", argv[i]);
+          return BROTLI_FALSE;
+        }
+        break;
+      case 'w':
+        if (!ParseRange(argv[i], BROTLI_MIN_WINDOW_BITS,
+                        BROTLI_MAX_WINDOW_BITS,
+                        &context->min_lgwin, &context->max_lgwin)) {
+          fprintf(stderr, "invalid window range [%s]\n", argv[i]);
+          return BROTLI_FALSE;
+        }
+        break;
+      case 'm':
+        if (!ParseModes(argv[i], context->modes)) {
+          fprintf(stderr, "invalid mode list [%s]\n", argv[i]);
+          return BROTLI_FALSE;
+        }
+        break;
+      case 'r': {
+        int unused;
+        if (!ParseRange(argv[i], 1, 1000000, &context->repetitions,
+                        &unused)) {
+          fprintf(stderr, "invalid repetition count [%s]\n", argv[i]);
+          return BROTLI_FALSE;
+        }
+        break;
+      }
+      case 'j':
+        context->json_path = argv[i];
+        break;
+      default:
+        break;
+    }
+  }
+  return BROTLI_TRUE;
+}
+
+int main(int argc, char** argv) {
+  Context context;
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  int quality;
+  int lgwin;
+  int mode;
+  size_t i;
+
+  memset(&context, 0, sizeof(context));
+  context.min_quality = BROTLI_MIN_QUALITY;
+  context.max_quality = BROTLI_MAX_QUALITY;
+  context.min_lgwin = BROTLI_MIN_WINDOW_BITS;
+  context.max_lgwin = BROTLI_MAX_WINDOW_BITS;
+  context.modes[0] = context.modes[1] = context.modes[2] = BROTLI_TRUE;
+  context.repetitions = DEFAULT_REPETITIONS;
+  context.json_first_result = BROTLI_TRUE;
+
+  is_ok = ParseParams(&context, argc, argv);
+  if (is_ok && context.num_files == 0) {
+    is_ok = AddPath(&context, BROTLI_BENCH_DEFAULT_CORPUS);
+  }
+  if (is_ok && context.num_files == 0) {
+    fprintf(stderr, "corpus is empty\n");
+    is_ok = BROTLI_FALSE;
+  }
+  if (is_ok) {
+    context.samples =
+        (double*)malloc(sizeof(double) * (size_t)context.repetitions);
+    if (!context.samples) {
+      fprintf(stderr, "out of memory\n");
+      is_ok = BROTLI_FALSE;
+    }
+  }
+  if (is_ok && context.json_path) {
+    context.json = fopen(context.json_path, "w");
+    if (!context.json) {
+      fprintf(stderr, "failed to open output file [%s]: %s\n",
+              context.json_path, strerror(errno));
+      is_ok = BROTLI_FALSE;
+    } else {
+      fprintf(context.json, "{\n  \"files\": %lu,\n  \"corpus_bytes\": %lu,\n"
+              "  \"repetitions\": %d,\n  \"results\": [\n",
+              (unsigned long)context.num_files,
+              (unsigned long)context.total_size, context.repetitions);
+    }
+  }
+
+  if (is_ok) {
+    fprintf(stdout, "corpus: %lu files, %lu bytes; %d repetitions\n",
+            (unsigned long)context.num_files,
+            (unsigned long)context.total_size, context.repetitions);
+    fprintf(stdout, "%2s %2s %-7s %10s %7s %9s %9s %9s %9s %8s\n",
+            "q", "w", "mode", "compressed", "ratio", "comp p50", "comp p90",
+            "dec p50", "dec p90", "peak KiB");
+    for (quality = context.min_quality;
+         is_ok && quality <= context.max_quality; ++quality) {
+      for (lgwin = context.min_lgwin;
+           is_ok && lgwin <= context.max_lgwin; ++lgwin) {
+        for (mode = 0; is_ok && mode < 3; ++mode) {
+          if (!context.modes[mode]) continue;
+          is_ok = RunConfiguration(&context, quality, lgwin, mode);
+        }
+      }
+    }
+  }
+
+  if (context.json) {
+    fprintf(context.json, "\n  ]\n}\n");
+    if (fclose(context.json) != 0) is_ok = BROTLI_FALSE;
+  }
+  PoolRelease(&context.pool);
+  free(context.samples);
+  for (i = 0; i < context.num_files; ++i) FreeFile(&context.files[i]);
+  return is_ok ? 0 : 1;
+}
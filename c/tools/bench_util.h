@@ -0,0 +1,93 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Helpers shared by benchmarking tools. */
+
+#ifndef BROTLI_TOOLS_BENCH_UTIL_H_
+#define BROTLI_TOOLS_BENCH_UTIL_H_
+
+#include "../common/platform.h"
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <time.h>
+#endif  /* WIN32 */
+
+/* Returns monotonic time in nanoseconds. */
+static double BrotliBenchNow(void) {
+#if defined(_WIN32)
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart * 1e9 / (double)frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+#endif
+}
+
+/* Compresses |input| in one call. |output_size| is the capacity of |output|
+   on entry, and the compressed size on return. Memory is managed by
+   |alloc_func| / |free_func|, or by malloc / free if those are NULL. */
+static BROTLI_INLINE BROTLI_BOOL BrotliBenchCompress(
+    brotli_alloc_func alloc_func, brotli_free_func free_func, void* opaque,
+    int quality, int lgwin, BrotliEncoderMode mode, const uint8_t* input,
+    size_t input_size, uint8_t* output, size_t* output_size) {
+  size_t available_in = input_size;
+  const uint8_t* next_in = input;
+  size_t available_out = *output_size;
+  uint8_t* next_out = output;
+  BROTLI_BOOL is_ok;
+  BrotliEncoderState* s =
+      BrotliEncoderCreateInstance(alloc_func, free_func, opaque);
+  if (!s) return BROTLI_FALSE;
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  if (lgwin > BROTLI_MAX_WINDOW_BITS) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
+  }
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, (uint32_t)lgwin);
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_MODE, (uint32_t)mode);
+  if (input_size != 0) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT,
+        input_size < (1u << 30) ? (uint32_t)input_size : (1u << 30));
+  }
+  is_ok = BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+      &available_in, &next_in, &available_out, &next_out, NULL) &&
+      BrotliEncoderIsFinished(s);
+  BrotliEncoderDestroyInstance(s);
+  *output_size -= available_out;
+  return is_ok;
+}
+
+/* Decompresses |input| in one call; large-window streams are accepted.
+   |output_size| is the capacity of |output| on entry, and the decompressed
+   size on return. */
+static BROTLI_INLINE BROTLI_BOOL BrotliBenchDecompress(
+    brotli_alloc_func alloc_func, brotli_free_func free_func, void* opaque,
+    const uint8_t* input, size_t input_size, uint8_t* output,
+    size_t* output_size) {
+  size_t available_in = input_size;
+  const uint8_t* next_in = input;
+  size_t available_out = *output_size;
+  uint8_t* next_out = output;
+  BrotliDecoderResult result;
+  BrotliDecoderState* s =
+      BrotliDecoderCreateInstance(alloc_func, free_func, opaque);
+  if (!s) return BROTLI_FALSE;
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+  result = BrotliDecoderDecompressStream(s,
+      &available_in, &next_in, &available_out, &next_out, NULL);
+  BrotliDecoderDestroyInstance(s);
+  *output_size -= available_out;
+  return TO_BROTLI_BOOL(result == BROTLI_DECODER_RESULT_SUCCESS);
+}
+
+#endif  /* BROTLI_TOOLS_BENCH_UTIL_H_ */
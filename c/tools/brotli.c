@@ -19,15 +19,21 @@
 #include "../common/version.h"
 #include <brotli/decode.h>
 #include <brotli/encode.h>
+#include "./bench_util.h"
 
 #if !defined(_WIN32)
+#include <pthread.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <utime.h>
 #define MAKE_BINARY(FILENO) (FILENO)
 #else
+#include <direct.h>
 #include <io.h>
+#include <process.h>
 #include <share.h>
 #include <sys/utime.h>
+#include <windows.h>
 
 #define MAKE_BINARY(FILENO) (_setmode((FILENO), _O_BINARY), (FILENO))
 
@@ -49,6 +55,7 @@
 
 #define chmod(F, P) (0)
 #define chown(F, O, G) (0)
+#define mkdir(P, M) _mkdir(P)
 
 #if defined(_MSC_VER) && (_MSC_VER >= 1400)
 #define fseek _fseeki64
@@ -68,23 +75,326 @@ static int ms_open(const char* filename, int oflag, int pmode) {
 }
 #endif  /* WIN32 */
 
+/* Minimal threading support for parallel processing. */
+
+#define MAX_THREADS 256
+
+#if defined(_WIN32)
+typedef CRITICAL_SECTION Mutex;
+typedef CONDITION_VARIABLE Cond;
+typedef HANDLE Thread;
+#else
+typedef pthread_mutex_t Mutex;
+typedef pthread_cond_t Cond;
+typedef pthread_t Thread;
+#endif
+
+static void MutexInit(Mutex* mutex) {
+#if defined(_WIN32)
+  InitializeCriticalSection(mutex);
+#else
+  pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+static void MutexDestroy(Mutex* mutex) {
+#if defined(_WIN32)
+  DeleteCriticalSection(mutex);
+#else
+  pthread_mutex_destroy(mutex);
+#endif
+}
+
+static void MutexLock(Mutex* mutex) {
+#if defined(_WIN32)
+  EnterCriticalSection(mutex);
+#else
+  pthread_mutex_lock(mutex);
+#endif
+}
+
+static void MutexUnlock(Mutex* mutex) {
+#if defined(_WIN32)
+  LeaveCriticalSection(mutex);
+#else
+  pthread_mutex_unlock(mutex);
+#endif
+}
+
+static void CondInit(Cond* cond) {
+#if defined(_WIN32)
+  InitializeConditionVariable(cond);
+#else
+  pthread_cond_init(cond, NULL);
+#endif
+}
+
+static void CondDestroy(Cond* cond) {
+#if defined(_WIN32)
+  (void)cond;
+#else
+  pthread_cond_destroy(cond);
+#endif
+}
+
+static void CondWait(Cond* cond, Mutex* mutex) {
+#if defined(_WIN32)
+  SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+  pthread_cond_wait(cond, mutex);
+#endif
+}
+
+static void CondBroadcast(Cond* cond) {
+#if defined(_WIN32)
+  WakeAllConditionVariable(cond);
+#else
+  pthread_cond_broadcast(cond);
+#endif
+}
+
+typedef void (*WorkerFunc)(void* arg);
+
+typedef struct {
+  WorkerFunc func;
+  void* arg;
+} WorkerStart;
+
+#if defined(_WIN32)
+static unsigned __stdcall WorkerMain(void* arg) {
+  WorkerStart* start = (WorkerStart*)arg;
+  start->func(start->arg);
+  return 0;
+}
+#else
+static void* WorkerMain(void* arg) {
+  WorkerStart* start = (WorkerStart*)arg;
+  start->func(start->arg);
+  return NULL;
+}
+#endif
+
+/* |start| should stay valid until the thread is joined. */
+static BROTLI_BOOL StartThread(Thread* thread, WorkerStart* start) {
+#if defined(_WIN32)
+  *thread = (HANDLE)_beginthreadex(NULL, 0, WorkerMain, start, 0, NULL);
+  return TO_BROTLI_BOOL(*thread != 0);
+#else
+  return TO_BROTLI_BOOL(pthread_create(thread, NULL, WorkerMain, start) == 0);
+#endif
+}
+
+static void JoinThread(Thread thread) {
+#if defined(_WIN32)
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+#else
+  pthread_join(thread, NULL);
+#endif
+}
+
+/* Runs |func| on |num_threads| threads, including the calling one, and waits
+   for all of them. Workers are expected to pull tasks from a shared queue, so
+   it is fine if some threads could not be started. */
+static void RunWorkers(int num_threads, WorkerFunc func, void* arg) {
+  Thread threads[MAX_THREADS];
+  WorkerStart start;
+  int num_started = 0;
+  int i;
+  start.func = func;
+  start.arg = arg;
+  for (i = 1; i < num_threads && i < MAX_THREADS; ++i) {
+    if (!StartThread(&threads[num_started], &start)) break;
+    num_started++;
+  }
+  func(arg);
+  for (i = 0; i < num_started; ++i) JoinThread(threads[i]);
+}
+
+/* Asynchronous I/O (--async-io): a ring of buffers passed between the codec
+   and a reader or writer thread. Producer fills the slot after the committed
+   ones; consumer owns the first committed slot until it releases it. */
+
+#define PIPE_DEPTH 4
+
+typedef struct {
+  uint8_t* buffers[PIPE_DEPTH];
+  size_t sizes[PIPE_DEPTH];
+  size_t buffer_size;
+  size_t first;
+  size_t filled;  /* Committed slots, including the one owned by consumer. */
+  BROTLI_BOOL is_held;  /* Consumer owns the first slot. */
+  BROTLI_BOOL is_closed;  /* Producer will not commit anymore. */
+  BROTLI_BOOL is_cancelled;  /* Consumer will not take anymore. */
+  int error;  /* errno of the failed I/O operation, or 0. */
+  FILE* file;
+  Mutex mutex;
+  Cond cond;
+  WorkerStart start;
+  Thread thread;
+} Pipe;
+
+/* Returns the slot for producer, or NULL if consumer is gone. */
+static uint8_t* PipeAcquire(Pipe* pipe) {
+  uint8_t* buffer = NULL;
+  MutexLock(&pipe->mutex);
+  while (pipe->filled == PIPE_DEPTH && !pipe->is_cancelled) {
+    CondWait(&pipe->cond, &pipe->mutex);
+  }
+  if (!pipe->is_cancelled) {
+    buffer = pipe->buffers[(pipe->first + pipe->filled) % PIPE_DEPTH];
+  }
+  MutexUnlock(&pipe->mutex);
+  return buffer;
+}
+
+static void PipeCommit(
+    Pipe* pipe, size_t size, BROTLI_BOOL is_last, int error) {
+  MutexLock(&pipe->mutex);
+  pipe->sizes[(pipe->first + pipe->filled) % PIPE_DEPTH] = size;
+  pipe->filled++;
+  if (is_last) pipe->is_closed = BROTLI_TRUE;
+  if (error != 0) pipe->error = error;
+  CondBroadcast(&pipe->cond);
+  MutexUnlock(&pipe->mutex);
+}
+
+/* Releases the owned slot and takes the next one. Returns NULL when producer
+   is done and everything is consumed. |is_last| is set if producer will not
+   commit anything after the taken slot. */
+static const uint8_t* PipeTake(
+    Pipe* pipe, size_t* size, BROTLI_BOOL* is_last) {
+  const uint8_t* buffer = NULL;
+  MutexLock(&pipe->mutex);
+  if (pipe->is_held) {
+    pipe->first = (pipe->first + 1) % PIPE_DEPTH;
+    pipe->filled--;
+    pipe->is_held = BROTLI_FALSE;
+    CondBroadcast(&pipe->cond);
+  }
+  while (pipe->filled == 0 && !pipe->is_closed) {
+    CondWait(&pipe->cond, &pipe->mutex);
+  }
+  if (pipe->filled != 0) {
+    pipe->is_held = BROTLI_TRUE;
+    buffer = pipe->buffers[pipe->first];
+    *size = pipe->sizes[pipe->first];
+  }
+  *is_last = TO_BROTLI_BOOL(pipe->is_closed && pipe->filled <= 1);
+  MutexUnlock(&pipe->mutex);
+  return buffer;
+}
+
+static void ReadAhead(void* arg) {
+  Pipe* pipe = (Pipe*)arg;
+  for (;;) {
+    uint8_t* buffer = PipeAcquire(pipe);
+    size_t size;
+    int error = 0;
+    BROTLI_BOOL is_last;
+    if (!buffer) return;
+    size = fread(buffer, 1, pipe->buffer_size, pipe->file);
+    if (ferror(pipe->file)) error = errno ? errno : EIO;
+    is_last = TO_BROTLI_BOOL(error != 0 || feof(pipe->file));
+    PipeCommit(pipe, size, is_last, error);
+    if (is_last) return;
+  }
+}
+
+static void WriteBehind(void* arg) {
+  Pipe* pipe = (Pipe*)arg;
+  size_t size;
+  BROTLI_BOOL is_last;
+  const uint8_t* buffer;
+  while ((buffer = PipeTake(pipe, &size, &is_last)) != NULL) {
+    if (pipe->error == 0 && size != 0) {
+      fwrite(buffer, 1, size, pipe->file);
+      if (ferror(pipe->file)) {
+        MutexLock(&pipe->mutex);
+        pipe->error = errno ? errno : EIO;
+        MutexUnlock(&pipe->mutex);
+      }
+    }
+  }
+}
+
+static int PipeError(Pipe* pipe) {
+  int error;
+  MutexLock(&pipe->mutex);
+  error = pipe->error;
+  MutexUnlock(&pipe->mutex);
+  return error;
+}
+
+static Pipe* CreatePipe(FILE* file, size_t buffer_size, WorkerFunc func) {
+  Pipe* pipe = (Pipe*)calloc(1, sizeof(Pipe));
+  uint8_t* buffer;
+  size_t i;
+  if (!pipe) return NULL;
+  buffer = (uint8_t*)malloc(PIPE_DEPTH * buffer_size);
+  if (!buffer) {
+    free(pipe);
+    return NULL;
+  }
+  for (i = 0; i < PIPE_DEPTH; ++i) pipe->buffers[i] = buffer + i * buffer_size;
+  pipe->buffer_size = buffer_size;
+  pipe->file = file;
+  MutexInit(&pipe->mutex);
+  CondInit(&pipe->cond);
+  pipe->start.func = func;
+  pipe->start.arg = pipe;
+  if (!StartThread(&pipe->thread, &pipe->start)) {
+    CondDestroy(&pipe->cond);
+    MutexDestroy(&pipe->mutex);
+    free(buffer);
+    free(pipe);
+    return NULL;
+  }
+  return pipe;
+}
+
+/* Stops the thread; writer drains all committed output first. Returns errno
+   of the failed I/O operation, or 0. */
+static int DestroyPipe(Pipe* pipe) {
+  int error;
+  MutexLock(&pipe->mutex);
+  pipe->is_closed = BROTLI_TRUE;
+  pipe->is_cancelled = BROTLI_TRUE;
+  CondBroadcast(&pipe->cond);
+  MutexUnlock(&pipe->mutex);
+  JoinThread(pipe->thread);
+  error = pipe->error;
+  CondDestroy(&pipe->cond);
+  MutexDestroy(&pipe->mutex);
+  free(pipe->buffers[0]);
+  free(pipe);
+  return error;
+}
+
 typedef enum {
+  COMMAND_BENCH,
   COMMAND_COMPRESS,
   COMMAND_DECOMPRESS,
   COMMAND_HELP,
   COMMAND_INVALID,
+  COMMAND_LIST,
   COMMAND_TEST_INTEGRITY,
   COMMAND_NOOP,
   COMMAND_VERSION
 } Command;
 
 #define DEFAULT_LGWIN 24
+/* Segment size for -T is 2**NUM bytes. */
+#define DEFAULT_SEGMENT_BITS 22
+#define MIN_SEGMENT_BITS 16
+#define MAX_SEGMENT_BITS 30
 #define DEFAULT_SUFFIX ".br"
-#define MAX_OPTIONS 20
+#define MAX_OPTIONS 24
 
 typedef struct {
   /* Parameters */
   int quality;
+  int max_quality;  /* --bench: last quality of the range */
   int lgwin;
   int verbosity;
   BROTLI_BOOL force_overwrite;
@@ -94,6 +404,12 @@ typedef struct {
   BROTLI_BOOL test_integrity;
   BROTLI_BOOL decompress;
   BROTLI_BOOL large_window;
+  BROTLI_BOOL async_io;
+  BROTLI_BOOL archive;
+  const char* member;  /* --member: the only archive entry to extract */
+  int threads;  /* 0, if not specified */
+  int jobs;  /* files processed concurrently; 0, if not specified */
+  int segment_bits;  /* -T segment size is 2**segment_bits */
   const char* output_path;
   const char* suffix;
   int not_input_indices[MAX_OPTIONS];
@@ -115,6 +431,15 @@ typedef struct {
   int64_t input_file_length;  /* -1, if impossible to calculate */
   FILE* fin;
   FILE* fout;
+  /* Regular input files are memory-mapped, if possible. */
+  const uint8_t* input_map;
+  size_t input_map_size;
+  size_t input_map_pos;
+  /* Reader and writer threads (--async-io); NULL, if not used. */
+  Pipe* input_pipe;
+  Pipe* output_pipe;
+  BROTLI_BOOL is_input_eof;
+  Mutex* report_mutex;  /* NULL, unless files are processed concurrently */
 
   /* I/O buffers */
   size_t available_in;
@@ -147,6 +472,32 @@ static BROTLI_BOOL ParseInt(const char* s, int low, int high, int* result) {
   return BROTLI_TRUE;
 }
 
+/* Parses quality "A", or range "A..B" for --bench. */
+static BROTLI_BOOL ParseQuality(const char* s, int* quality, int* max_quality,
+                                BROTLI_BOOL* is_range) {
+  const char* separator = strstr(s, "..");
+  char first[6];
+  size_t first_len;
+  *is_range = BROTLI_FALSE;
+  if (!separator) {
+    if (!ParseInt(s, BROTLI_MIN_QUALITY, BROTLI_MAX_QUALITY, quality)) {
+      return BROTLI_FALSE;
+    }
+    *max_quality = *quality;
+    return BROTLI_TRUE;
+  }
+  first_len = (size_t)(separator - s);
+  if (first_len >= sizeof(first)) return BROTLI_FALSE;
+  memcpy(first, s, first_len);
+  first[first_len] = 0;
+  if (!ParseInt(first, BROTLI_MIN_QUALITY, BROTLI_MAX_QUALITY, quality) ||
+      !ParseInt(separator + 2, *quality, BROTLI_MAX_QUALITY, max_quality)) {
+    return BROTLI_FALSE;
+  }
+  *is_range = BROTLI_TRUE;
+  return BROTLI_TRUE;
+}
+
 /* Returns "base file name" or its tail, if it contains '/' or '\'. */
 static const char* FileName(const char* path) {
   const char* separator_position = strrchr(path, '/');
@@ -179,10 +530,14 @@ static Command ParseParams(Context* params) {
   size_t longest_path_len = 1;
   BROTLI_BOOL command_set = BROTLI_FALSE;
   BROTLI_BOOL quality_set = BROTLI_FALSE;
+  BROTLI_BOOL quality_range = BROTLI_FALSE;
   BROTLI_BOOL output_set = BROTLI_FALSE;
   BROTLI_BOOL keep_set = BROTLI_FALSE;
   BROTLI_BOOL lgwin_set = BROTLI_FALSE;
   BROTLI_BOOL suffix_set = BROTLI_FALSE;
+  BROTLI_BOOL threads_set = BROTLI_FALSE;
+  BROTLI_BOOL jobs_set = BROTLI_FALSE;
+  BROTLI_BOOL segment_set = BROTLI_FALSE;
   BROTLI_BOOL after_dash_dash = BROTLI_FALSE;
   Command command = ParseAlias(argv[0]);
 
@@ -198,7 +553,8 @@ static Command ParseParams(Context* params) {
     }
 
     /* Too many options. The expected longest option list is:
-       "-q 0 -w 10 -o f -D d -S b -d -f -k -n -v --", i.e. 16 items in total.
+       "-q 0 -w 10 -o f -D d -S b -T 2 -d -f -k -n -v --archive --member=m --",
+       i.e. 20 items in total.
        This check is an additional guard that is never triggered, but provides
        a guard for future changes. */
     if (next_option_index > (MAX_OPTIONS - 2)) {
@@ -269,6 +625,14 @@ static Command ParseParams(Context* params) {
           keep_set = BROTLI_TRUE;
           params->junk_source = TO_BROTLI_BOOL(c == 'j');
           continue;
+        } else if (c == 'l') {
+          if (command_set) {
+            fprintf(stderr, "command already set when parsing -l\n");
+            return COMMAND_INVALID;
+          }
+          command_set = BROTLI_TRUE;
+          command = COMMAND_LIST;
+          continue;
         } else if (c == 'n') {
           if (!params->copy_stat) {
             fprintf(stderr, "argument --no-copy-stat / -n already set\n");
@@ -303,8 +667,9 @@ static Command ParseParams(Context* params) {
           params->quality = 11;
           continue;
         }
-        /* o/q/w/D/S with parameter is expected */
-        if (c != 'o' && c != 'q' && c != 'w' && c != 'D' && c != 'S') {
+        /* o/q/w/D/S/T with parameter is expected */
+        if (c != 'o' && c != 'q' && c != 'w' && c != 'D' && c != 'S' &&
+            c != 'T') {
           fprintf(stderr, "invalid argument -%c\n", c);
           return COMMAND_INVALID;
         }
@@ -329,8 +694,8 @@ static Command ParseParams(Context* params) {
             fprintf(stderr, "quality already set\n");
             return COMMAND_INVALID;
           }
-          quality_set = ParseInt(argv[i], BROTLI_MIN_QUALITY,
-                                 BROTLI_MAX_QUALITY, &params->quality);
+          quality_set = ParseQuality(argv[i], &params->quality,
+                                     &params->max_quality, &quality_range);
           if (!quality_set) {
             fprintf(stderr, "error parsing quality value [%s]\n", argv[i]);
             return COMMAND_INVALID;
@@ -359,11 +724,40 @@ static Command ParseParams(Context* params) {
           }
           suffix_set = BROTLI_TRUE;
           params->suffix = argv[i];
+        } else if (c == 'T') {
+          if (threads_set) {
+            fprintf(stderr, "threads parameter already set\n");
+            return COMMAND_INVALID;
+          }
+          threads_set = ParseInt(argv[i], 1, MAX_THREADS, &params->threads);
+          if (!threads_set) {
+            fprintf(stderr, "error parsing threads value [%s]\n", argv[i]);
+            return COMMAND_INVALID;
+          }
         }
       }
     } else {  /* Double-dash. */
       arg = &arg[2];
-      if (strcmp("best", arg) == 0) {
+      if (strcmp("archive", arg) == 0) {
+        if (params->archive) {
+          fprintf(stderr, "argument --archive already set\n");
+          return COMMAND_INVALID;
+        }
+        params->archive = BROTLI_TRUE;
+      } else if (strcmp("async-io", arg) == 0) {
+        if (params->async_io) {
+          fprintf(stderr, "argument --async-io already set\n");
+          return COMMAND_INVALID;
+        }
+        params->async_io = BROTLI_TRUE;
+      } else if (strcmp("bench", arg) == 0) {
+        if (command_set) {
+          fprintf(stderr, "command already set when parsing --bench\n");
+          return COMMAND_INVALID;
+        }
+        command_set = BROTLI_TRUE;
+        command = COMMAND_BENCH;
+      } else if (strcmp("best", arg) == 0) {
         if (quality_set) {
           fprintf(stderr, "quality already set\n");
           return COMMAND_INVALID;
@@ -393,6 +787,13 @@ static Command ParseParams(Context* params) {
         }
         keep_set = BROTLI_TRUE;
         params->junk_source = BROTLI_FALSE;
+      } else if (strcmp("list", arg) == 0 || strcmp("info", arg) == 0) {
+        if (command_set) {
+          fprintf(stderr, "command already set when parsing --%s\n", arg);
+          return COMMAND_INVALID;
+        }
+        command_set = BROTLI_TRUE;
+        command = COMMAND_LIST;
       } else if (strcmp("no-copy-stat", arg) == 0) {
         if (!params->copy_stat) {
           fprintf(stderr, "argument --no-copy-stat / -n already set\n");
@@ -474,6 +875,22 @@ static Command ParseParams(Context* params) {
                     params->lgwin, BROTLI_MIN_WINDOW_BITS);
             return COMMAND_INVALID;
           }
+        } else if (strncmp("jobs", arg, key_len) == 0) {
+          if (jobs_set) {
+            fprintf(stderr, "jobs parameter already set\n");
+            return COMMAND_INVALID;
+          }
+          jobs_set = ParseInt(value, 1, MAX_THREADS, &params->jobs);
+          if (!jobs_set) {
+            fprintf(stderr, "error parsing jobs value [%s]\n", value);
+            return COMMAND_INVALID;
+          }
+        } else if (strncmp("member", arg, key_len) == 0) {
+          if (params->member) {
+            fprintf(stderr, "member already set\n");
+            return COMMAND_INVALID;
+          }
+          params->member = value;
         } else if (strncmp("output", arg, key_len) == 0) {
           if (output_set) {
             fprintf(stderr,
@@ -486,12 +903,33 @@ static Command ParseParams(Context* params) {
             fprintf(stderr, "quality already set\n");
             return COMMAND_INVALID;
           }
-          quality_set = ParseInt(value, BROTLI_MIN_QUALITY,
-                                 BROTLI_MAX_QUALITY, &params->quality);
+          quality_set = ParseQuality(value, &params->quality,
+                                     &params->max_quality, &quality_range);
           if (!quality_set) {
             fprintf(stderr, "error parsing quality value [%s]\n", value);
             return COMMAND_INVALID;
           }
+        } else if (strncmp("threads", arg, key_len) == 0) {
+          if (threads_set) {
+            fprintf(stderr, "threads parameter already set\n");
+            return COMMAND_INVALID;
+          }
+          threads_set = ParseInt(value, 1, MAX_THREADS, &params->threads);
+          if (!threads_set) {
+            fprintf(stderr, "error parsing threads value [%s]\n", value);
+            return COMMAND_INVALID;
+          }
+        } else if (strncmp("segment", arg, key_len) == 0) {
+          if (segment_set) {
+            fprintf(stderr, "segment parameter already set\n");
+            return COMMAND_INVALID;
+          }
+          segment_set = ParseInt(value, MIN_SEGMENT_BITS, MAX_SEGMENT_BITS,
+                                 &params->segment_bits);
+          if (!segment_set) {
+            fprintf(stderr, "error parsing segment value [%s]\n", value);
+            return COMMAND_INVALID;
+          }
         } else if (strncmp("suffix", arg, key_len) == 0) {
           if (suffix_set) {
             fprintf(stderr, "suffix already set\n");
@@ -509,9 +947,40 @@ static Command ParseParams(Context* params) {
 
   params->input_count = input_count;
   params->longest_path_len = longest_path_len;
+  if (!quality_range) params->max_quality = params->quality;
+  if (quality_range && command != COMMAND_BENCH) {
+    fprintf(stderr, "quality range is valid only with --bench\n");
+    return COMMAND_INVALID;
+  }
   params->decompress = (command == COMMAND_DECOMPRESS);
-  params->test_integrity = (command == COMMAND_TEST_INTEGRITY);
+  /* Listing only reads input, like integrity test. */
+  params->test_integrity = TO_BROTLI_BOOL(
+      command == COMMAND_TEST_INTEGRITY || command == COMMAND_LIST);
+
+  if (segment_set && !threads_set) {
+    fprintf(stderr, "--segment is valid only with -T\n");
+    return COMMAND_INVALID;
+  }
 
+  if (params->archive) {
+    if (command == COMMAND_BENCH || params->threads > 0 || jobs_set) {
+      fprintf(stderr,
+              "--archive is not compatible with --bench, -T and --jobs\n");
+      return COMMAND_INVALID;
+    }
+    /* All inputs are written to a single archive. */
+    if (command == COMMAND_COMPRESS) {
+      if (!output_set && !params->output_path) {
+        fprintf(stderr, "archive output is not specified (-o or -c)\n");
+        return COMMAND_INVALID;
+      }
+      output_set = BROTLI_FALSE;
+    }
+  }
+  if (params->member && !(params->archive && command == COMMAND_DECOMPRESS)) {
+    fprintf(stderr, "--member is valid only with --archive -d\n");
+    return COMMAND_INVALID;
+  }
   if (input_count > 1 && output_set) return COMMAND_INVALID;
   if (params->test_integrity) {
     if (params->output_path) return COMMAND_INVALID;
@@ -540,13 +1009,23 @@ static void PrintHelp(const char* name, BROTLI_BOOL error) {
   fprintf(media,
 "Options:\n"
 "  -#                          compression level (0-9)\n"
+"  --archive                   compress all files into a single solid archive\n"
+"                              (-o or -c); extract (-d) or list (-l) archives\n"
+"  --async-io                  read and write in background threads\n"
+"  --bench                     benchmark compression and decompression in\n"
+"                              memory, for each quality of -q A..B range\n"
 "  -c, --stdout                write on standard output\n"
 "  -d, --decompress            decompress\n"
 "  -f, --force                 force output file overwrite\n"
 "  -h, --help                  display this help and exit\n");
   fprintf(media,
 "  -j, --rm                    remove source file(s)\n"
+"  --jobs=NUM                  process NUM files concurrently, largest first;\n"
+"                              output is the same as without it\n"
 "  -k, --keep                  keep source file(s) (default)\n"
+"  -l, --list, --info          list compressed file(s) layout and sizes\n"
+"  --member=NAME               extract only NAME from archive\n");
+  fprintf(media,
 "  -n, --no-copy-stat          do not copy source file(s) attributes\n"
 "  -o FILE, --output=FILE      output file (only if 1 input file)\n");
   fprintf(media,
@@ -571,6 +1050,18 @@ static void PrintHelp(const char* name, BROTLI_BOOL error) {
 "  -S SUF, --suffix=SUF        output file suffix (default:'%s')\n",
           DEFAULT_SUFFIX);
   fprintf(media,
+"  --segment=NUM               with -T, cut input into segments of 2**NUM\n"
+"                              bytes (%d-%d, default: %d); window size is\n"
+"                              limited to the segment size; smaller segments\n"
+"                              give more parallelism but worse compression\n",
+          MIN_SEGMENT_BITS, MAX_SEGMENT_BITS, DEFAULT_SEGMENT_BITS);
+  fprintf(media,
+"  -T NUM, --threads=NUM       use NUM threads (1-%d)\n"
+"                              compress into seekable stream; output does\n"
+"                              not depend on NUM\n"
+"                              decompress seekable streams in parallel\n",
+          MAX_THREADS);
+  fprintf(media,
 "  -V, --version               display version and exit\n"
 "  -Z, --best                  use best compression level (11) (default)\n"
 "Simple options could be coalesced, i.e. '-9kf' is equivalent to '-9 -k -f'.\n"
@@ -744,17 +1235,53 @@ static BROTLI_BOOL NextFile(Context* context) {
   }
 }
 
+/* Maps the whole input file to memory; nothing happens for empty files,
+   pipes, and if mapping is not supported. Input is then provided in one
+   piece, without copying it to the input buffer. */
+static void MapInputFile(Context* context) {
+#if !defined(_WIN32)
+  void* map;
+  context->input_map = NULL;
+  if (!context->current_input_path || context->input_file_length <= 0 ||
+      (uint64_t)context->input_file_length > (size_t)-1) {
+    return;
+  }
+  map = mmap(NULL, (size_t)context->input_file_length, PROT_READ, MAP_PRIVATE,
+             fileno(context->fin), 0);
+  if (map == MAP_FAILED) return;
+#if defined(MADV_SEQUENTIAL)
+  madvise(map, (size_t)context->input_file_length, MADV_SEQUENTIAL);
+#endif
+  context->input_map = (const uint8_t*)map;
+  context->input_map_size = (size_t)context->input_file_length;
+  context->input_map_pos = 0;
+#else
+  context->input_map = NULL;
+#endif
+}
+
+static void UnmapInputFile(Context* context) {
+#if !defined(_WIN32)
+  if (context->input_map) {
+    munmap((void*)context->input_map, context->input_map_size);
+  }
+#endif
+  context->input_map = NULL;
+}
+
 static BROTLI_BOOL OpenFiles(Context* context) {
   BROTLI_BOOL is_ok = OpenInputFile(context->current_input_path, &context->fin);
   if (!context->test_integrity && is_ok) {
     is_ok = OpenOutputFile(
         context->current_output_path, &context->fout, context->force_overwrite);
   }
+  if (is_ok) MapInputFile(context);
   return is_ok;
 }
 
 static BROTLI_BOOL CloseFiles(Context* context, BROTLI_BOOL success) {
   BROTLI_BOOL is_ok = BROTLI_TRUE;
+  UnmapInputFile(context);
   if (!context->test_integrity && context->fout) {
     if (!success && context->current_output_path) {
       unlink(context->current_output_path);
@@ -804,10 +1331,35 @@ static void InitializeBuffers(Context* context) {
 }
 
 static BROTLI_BOOL HasMoreInput(Context* context) {
+  if (context->input_pipe) return !context->is_input_eof;
+  if (context->input_map) {
+    return TO_BROTLI_BOOL(context->input_map_pos < context->input_map_size);
+  }
   return feof(context->fin) ? BROTLI_FALSE : BROTLI_TRUE;
 }
 
 static BROTLI_BOOL ProvideInput(Context* context) {
+  if (context->input_pipe) {
+    int error;
+    context->next_in = PipeTake(context->input_pipe, &context->available_in,
+                                &context->is_input_eof);
+    if (!context->next_in) context->available_in = 0;
+    context->total_in += context->available_in;
+    error = PipeError(context->input_pipe);
+    if (error != 0) {
+      fprintf(stderr, "failed to read input [%s]: %s\n",
+              PrintablePath(context->current_input_path), strerror(error));
+      return BROTLI_FALSE;
+    }
+    return BROTLI_TRUE;
+  }
+  if (context->input_map) {
+    context->available_in = context->input_map_size - context->input_map_pos;
+    context->next_in = context->input_map + context->input_map_pos;
+    context->input_map_pos = context->input_map_size;
+    context->total_in += context->available_in;
+    return BROTLI_TRUE;
+  }
   context->available_in =
       fread(context->input, 1, kFileBufferSize, context->fin);
   context->total_in += context->available_in;
@@ -827,6 +1379,20 @@ static BROTLI_BOOL WriteOutput(Context* context) {
   if (out_size == 0) return BROTLI_TRUE;
   if (context->test_integrity) return BROTLI_TRUE;
 
+  if (context->output_pipe) {
+    int error;
+    /* Hand the buffer over to the writer and continue with the next one. */
+    PipeCommit(context->output_pipe, out_size, BROTLI_FALSE, 0);
+    context->output = PipeAcquire(context->output_pipe);
+    error = PipeError(context->output_pipe);
+    if (error != 0) {
+      fprintf(stderr, "failed to write output [%s]: %s\n",
+              PrintablePath(context->current_output_path), strerror(error));
+      return BROTLI_FALSE;
+    }
+    return BROTLI_TRUE;
+  }
+
   fwrite(context->output, 1, out_size, context->fout);
   if (ferror(context->fout)) {
     fprintf(stderr, "failed to write output [%s]: %s\n",
@@ -849,6 +1415,46 @@ static BROTLI_BOOL FlushOutput(Context* context) {
   return BROTLI_TRUE;
 }
 
+/* Starts reader and writer threads for the streaming paths; those are
+   optional, I/O is synchronous if threads could not be started. */
+static void StartAsyncIo(Context* context) {
+  if (!context->async_io) return;
+  if (!context->input_map) {
+    context->input_pipe =
+        CreatePipe(context->fin, kFileBufferSize, ReadAhead);
+    context->is_input_eof = BROTLI_FALSE;
+  }
+  if (!context->test_integrity) {
+    context->output_pipe =
+        CreatePipe(context->fout, kFileBufferSize, WriteBehind);
+    if (context->output_pipe) {
+      context->output = PipeAcquire(context->output_pipe);
+    }
+  }
+}
+
+/* Waits until all output is written. */
+static BROTLI_BOOL StopAsyncIo(Context* context, BROTLI_BOOL success) {
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  if (context->input_pipe) {
+    DestroyPipe(context->input_pipe);
+    context->input_pipe = NULL;
+  }
+  if (context->output_pipe) {
+    int error = DestroyPipe(context->output_pipe);
+    context->output_pipe = NULL;
+    context->output = context->buffer + kFileBufferSize;
+    if (error != 0) {
+      if (success) {
+        fprintf(stderr, "failed to write output [%s]: %s\n",
+                PrintablePath(context->current_output_path), strerror(error));
+      }
+      is_ok = BROTLI_FALSE;
+    }
+  }
+  return is_ok;
+}
+
 static void PrintBytes(size_t value) {
   if (value < 1024) {
     fprintf(stderr, "%d B", (int)value);
@@ -868,8 +1474,18 @@ static void PrintFileProcessingProgress(Context* context) {
   PrintBytes(context->total_out);
 }
 
+static void PrintFileProcessingResult(Context* context, const char* action) {
+  /* Keep lines whole, when several files are processed concurrently. */
+  if (context->report_mutex) MutexLock(context->report_mutex);
+  fprintf(stderr, "%s ", action);
+  PrintFileProcessingProgress(context);
+  fprintf(stderr, "\n");
+  if (context->report_mutex) MutexUnlock(context->report_mutex);
+}
+
 static BROTLI_BOOL DecompressFile(Context* context, BrotliDecoderState* s) {
   BrotliDecoderResult result = BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT;
+  size_t total_out = 0;
   InitializeBuffers(context);
   for (;;) {
     if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT) {
@@ -883,15 +1499,15 @@ static BROTLI_BOOL DecompressFile(Context* context, BrotliDecoderState* s) {
       if (!ProvideOutput(context)) return BROTLI_FALSE;
     } else if (result == BROTLI_DECODER_RESULT_SUCCESS) {
       if (!FlushOutput(context)) return BROTLI_FALSE;
+      /* In validate-only mode decoder does not fill the output buffer. */
+      context->total_out = total_out;
       if (context->available_in != 0 || HasMoreInput(context)) {
         fprintf(stderr, "corrupt input [%s]\n",
                 PrintablePath(context->current_input_path));
         return BROTLI_FALSE;
       }
       if (context->verbosity > 0) {
-        fprintf(stderr, "Decompressed ");
-        PrintFileProcessingProgress(context);
-        fprintf(stderr, "\n");
+        PrintFileProcessingResult(context, "Decompressed");
       }
       return BROTLI_TRUE;
     } else {
@@ -901,118 +1517,1713 @@ static BROTLI_BOOL DecompressFile(Context* context, BrotliDecoderState* s) {
     }
 
     result = BrotliDecoderDecompressStream(s, &context->available_in,
-        &context->next_in, &context->available_out, &context->next_out, 0);
+        &context->next_in, &context->available_out, &context->next_out,
+        &total_out);
   }
 }
 
-static BROTLI_BOOL DecompressFiles(Context* context) {
-  while (NextFile(context)) {
-    BROTLI_BOOL is_ok = BROTLI_TRUE;
-    BrotliDecoderState* s = BrotliDecoderCreateInstance(NULL, NULL, NULL);
-    if (!s) {
-      fprintf(stderr, "out of memory\n");
-      return BROTLI_FALSE;
-    }
-    /* This allows decoding "large-window" streams. Though it creates
-       fragmentation (new builds decode streams that old builds don't),
-       it is better from used experience perspective. */
-    BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
-    is_ok = OpenFiles(context);
-    if (is_ok && !context->current_input_path &&
-        !context->force_overwrite && isatty(STDIN_FILENO)) {
-      fprintf(stderr, "Use -h help. Use -f to force input from a terminal.\n");
-      is_ok = BROTLI_FALSE;
+/* Parallel decompression of seekable streams (see BROTLI_PARAM_SEGMENT_SIZE).
+   Segments are independent, so they are decoded concurrently in batches, and
+   written out in order. */
+
+typedef struct {
+  BrotliDecoderSegment segment;
+  const uint8_t* input;
+  size_t input_size;
+  /* Exact output size; for the last segment, size of the buffer allocated by
+     the worker, and then the decoded size. Output is NULL in test mode. */
+  uint8_t* output;
+  size_t output_size;
+  BROTLI_BOOL is_last;
+  BROTLI_BOOL is_ok;
+} SegmentJob;
+
+typedef struct {
+  const uint8_t* header;
+  size_t header_size;
+  BROTLI_BOOL test_integrity;
+  SegmentJob* jobs;
+  size_t num_jobs;
+  size_t next_job;
+  Mutex mutex;
+} SegmentBatch;
+
+static void DecodeSegment(SegmentBatch* batch, SegmentJob* job) {
+  BrotliDecoderResult result = BROTLI_DECODER_RESULT_ERROR;
+  size_t available_in = job->input_size;
+  const uint8_t* next_in = job->input;
+  size_t available_out = 0;
+  uint8_t* next_out = NULL;
+  size_t total_out = 0;
+  size_t segment_end;
+  BrotliDecoderState* s = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  job->is_ok = BROTLI_FALSE;
+  if (!s) return;
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+  if (batch->test_integrity) {
+    BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_VALIDATE_ONLY, 1u);
+  } else if (job->is_last) {
+    job->output = (uint8_t*)malloc(job->output_size);
+    if (!job->output) job->output_size = 0;
+  }
+  if (job->output) {
+    available_out = job->output_size;
+    next_out = job->output;
+  }
+  if (BrotliDecoderSeek(s, batch->header_size, batch->header, &job->segment,
+                        job->segment.uncompressed_offset)) {
+    for (;;) {
+      result = BrotliDecoderDecompressStream(
+          s, &available_in, &next_in, &available_out, &next_out, &total_out);
+      if (result == BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT && job->is_last &&
+          job->output) {
+        /* Size of the last segment is not recorded; grow the buffer. */
+        size_t used = (size_t)(next_out - job->output);
+        uint8_t* output = (uint8_t*)realloc(job->output, 2 * job->output_size);
+        if (!output) break;
+        job->output = output;
+        job->output_size *= 2;
+        next_out = output + used;
+        available_out = job->output_size - used;
+        continue;
+      }
+      break;
     }
-    if (is_ok) is_ok = DecompressFile(context, s);
-    BrotliDecoderDestroyInstance(s);
-    if (!CloseFiles(context, is_ok)) is_ok = BROTLI_FALSE;
-    if (!is_ok) return BROTLI_FALSE;
   }
-  return BROTLI_TRUE;
+  BrotliDecoderDestroyInstance(s);
+  segment_end = total_out - (size_t)job->segment.uncompressed_offset;
+  if (job->is_last) {
+    /* The last segment is followed by the end of the stream. */
+    job->is_ok = TO_BROTLI_BOOL(
+        result == BROTLI_DECODER_RESULT_SUCCESS && available_in == 0);
+    job->output_size = segment_end;
+  } else {
+    /* Other segments end exactly at the next segment boundary. */
+    job->is_ok = TO_BROTLI_BOOL(
+        result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT &&
+        available_in == 0 && segment_end == job->output_size);
+  }
 }
 
-static BROTLI_BOOL CompressFile(Context* context, BrotliEncoderState* s) {
-  BROTLI_BOOL is_eof = BROTLI_FALSE;
-  InitializeBuffers(context);
+static void DecodeSegmentsWorker(void* arg) {
+  SegmentBatch* batch = (SegmentBatch*)arg;
   for (;;) {
-    if (context->available_in == 0 && !is_eof) {
-      if (!ProvideInput(context)) return BROTLI_FALSE;
-      is_eof = !HasMoreInput(context);
-    }
-
-    if (!BrotliEncoderCompressStream(s,
-        is_eof ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
-        &context->available_in, &context->next_in,
-        &context->available_out, &context->next_out, NULL)) {
-      /* Should detect OOM? */
-      fprintf(stderr, "failed to compress data [%s]\n",
-              PrintablePath(context->current_input_path));
-      return BROTLI_FALSE;
+    SegmentJob* job = NULL;
+    MutexLock(&batch->mutex);
+    if (batch->next_job < batch->num_jobs) {
+      job = &batch->jobs[batch->next_job++];
     }
+    MutexUnlock(&batch->mutex);
+    if (!job) return;
+    DecodeSegment(batch, job);
+  }
+}
 
-    if (context->available_out == 0) {
-      if (!ProvideOutput(context)) return BROTLI_FALSE;
+/* Reads the seek table of the current input file. Returns BROTLI_FALSE if
+   input is not a seekable stream with more than one segment, or can not be
+   read at random; input is rewound in any case. */
+static BROTLI_BOOL ReadSeekTable(Context* context,
+    BrotliDecoderSegment** segments, size_t* num_segments, uint8_t* header,
+    size_t* header_size) {
+  /* Seek table tail and empty last metablock. */
+  const size_t tail_size = BROTLI_SEEK_TABLE_TAIL_SIZE + 1;
+  uint8_t tail[BROTLI_SEEK_TABLE_TAIL_SIZE + 1];
+  uint8_t* table = NULL;
+  size_t table_size;
+  size_t count;
+  BROTLI_BOOL is_ok = BROTLI_FALSE;
+  *segments = NULL;
+  if (!context->current_input_path ||
+      context->input_file_length < (int64_t)tail_size) {
+    return BROTLI_FALSE;
+  }
+  if (fseek(context->fin, -(long)tail_size, SEEK_END) == 0 &&
+      fread(tail, 1, tail_size, context->fin) == tail_size) {
+    count = (size_t)tail[0] | ((size_t)tail[1] << 8) |
+        ((size_t)tail[2] << 16) | ((size_t)tail[3] << 24);
+    table_size = count * BROTLI_SEEK_TABLE_ENTRY_SIZE + tail_size;
+    if (count > 1 && count <= BROTLI_SEEK_TABLE_MAX_SEGMENTS &&
+        (int64_t)table_size <= context->input_file_length) {
+      table = (uint8_t*)malloc(table_size);
     }
-
-    if (BrotliEncoderIsFinished(s)) {
-      if (!FlushOutput(context)) return BROTLI_FALSE;
-      if (context->verbosity > 0) {
-        fprintf(stderr, "Compressed ");
-        PrintFileProcessingProgress(context);
-        fprintf(stderr, "\n");
-      }
-      return BROTLI_TRUE;
+  }
+  if (table && fseek(context->fin, -(long)table_size, SEEK_END) == 0 &&
+      fread(table, 1, table_size, context->fin) == table_size &&
+      BrotliDecoderGetSeekTable(table_size, table, num_segments, NULL)) {
+    *segments = (BrotliDecoderSegment*)malloc(
+        *num_segments * sizeof(BrotliDecoderSegment));
+    if (*segments) {
+      is_ok = BrotliDecoderGetSeekTable(
+          table_size, table, num_segments, *segments);
     }
   }
+  free(table);
+  if (fseek(context->fin, 0, SEEK_SET) != 0) is_ok = BROTLI_FALSE;
+  if (is_ok) {
+    *header_size = fread(header, 1, *header_size, context->fin);
+    if (fseek(context->fin, 0, SEEK_SET) != 0) is_ok = BROTLI_FALSE;
+  }
+  if (is_ok && (*segments)[*num_segments - 1].compressed_offset >=
+      (uint64_t)context->input_file_length) {
+    is_ok = BROTLI_FALSE;
+  }
+  if (!is_ok) {
+    free(*segments);
+    *segments = NULL;
+  }
+  return is_ok;
 }
 
-static BROTLI_BOOL CompressFiles(Context* context) {
-  while (NextFile(context)) {
-    BROTLI_BOOL is_ok = BROTLI_TRUE;
-    BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
-    if (!s) {
-      fprintf(stderr, "out of memory\n");
-      return BROTLI_FALSE;
+static BROTLI_BOOL DecompressFileParallel(Context* context,
+    const BrotliDecoderSegment* segments, size_t num_segments,
+    const uint8_t* header, size_t header_size) {
+  const size_t batch_size = 2 * (size_t)context->threads;
+  SegmentBatch batch;
+  SegmentJob* jobs = (SegmentJob*)malloc(batch_size * sizeof(SegmentJob));
+  uint8_t* input = NULL;
+  uint8_t* output = NULL;
+  size_t input_capacity = 0;
+  size_t output_capacity = 0;
+  size_t first;
+  BROTLI_BOOL is_ok = TO_BROTLI_BOOL(jobs != NULL);
+  InitializeBuffers(context);
+  batch.header = header;
+  batch.header_size = header_size;
+  batch.test_integrity = context->test_integrity;
+  batch.jobs = jobs;
+  MutexInit(&batch.mutex);
+  for (first = 0; is_ok && first < num_segments; first += batch_size) {
+    size_t end = first + batch_size < num_segments ?
+        first + batch_size : num_segments;
+    uint64_t input_end = end < num_segments ?
+        segments[end].compressed_offset :
+        (uint64_t)context->input_file_length;
+    uint64_t output_end = segments[end - 1].uncompressed_offset;
+    uint64_t input_size = input_end - segments[first].compressed_offset;
+    uint64_t output_size = 0;
+    size_t i;
+    if (end < num_segments) output_end = segments[end].uncompressed_offset;
+    if (!context->test_integrity) {
+      output_size = output_end - segments[first].uncompressed_offset;
     }
-    BrotliEncoderSetParameter(s,
-        BROTLI_PARAM_QUALITY, (uint32_t)context->quality);
-    if (context->lgwin > 0) {
-      /* Specified by user. */
-      /* Do not enable "large-window" extension, if not required. */
-      if (context->lgwin > BROTLI_MAX_WINDOW_BITS) {
-        BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
-      }
-      BrotliEncoderSetParameter(s,
-          BROTLI_PARAM_LGWIN, (uint32_t)context->lgwin);
-    } else {
-      /* 0, or not specified by user; could be chosen by compressor. */
-      uint32_t lgwin = DEFAULT_LGWIN;
-      /* Use file size to limit lgwin. */
-      if (context->input_file_length >= 0) {
-        lgwin = BROTLI_MIN_WINDOW_BITS;
-        while (BROTLI_MAX_BACKWARD_LIMIT(lgwin) <
-               (uint64_t)context->input_file_length) {
-          lgwin++;
-          if (lgwin == BROTLI_MAX_WINDOW_BITS) break;
-        }
-      }
-      BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, lgwin);
+    if (input_size > (size_t)-1 || output_size > (size_t)-1) {
+      is_ok = BROTLI_FALSE;
+      break;
     }
-    if (context->input_file_length > 0) {
-      uint32_t size_hint = context->input_file_length < (1 << 30) ?
-          (uint32_t)context->input_file_length : (1u << 30);
-      BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT, size_hint);
+    if (input_size > input_capacity) {
+      free(input);
+      input_capacity = (size_t)input_size;
+      input = (uint8_t*)malloc(input_capacity);
     }
-    is_ok = OpenFiles(context);
-    if (is_ok && !context->current_output_path &&
-        !context->force_overwrite && 0/*&& isatty(STDOUT_FILENO)*/) {
-      fprintf(stderr, "Use -h help. Use -f to force output to a terminal.\n");
-      is_ok = BROTLI_FALSE;
+    if (output_size > output_capacity) {
+      free(output);
+      output_capacity = (size_t)output_size;
+      output = (uint8_t*)malloc(output_capacity);
     }
-    if (is_ok) is_ok = CompressFile(context, s);
+    if ((input_size && !input) || (output_size && !output)) {
+      fprintf(stderr, "out of memory\n");
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    /* Batches are consecutive, so input is read sequentially. */
+    if (fread(input, 1, (size_t)input_size, context->fin) != input_size) {
+      fprintf(stderr, "failed to read input [%s]: %s\n",
+              PrintablePath(context->current_input_path), strerror(errno));
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    context->total_in += (size_t)input_size;
+    for (i = first; i < end; ++i) {
+      SegmentJob* job = &jobs[i - first];
+      job->segment = segments[i];
+      job->input = input +
+          (segments[i].compressed_offset - segments[first].compressed_offset);
+      job->is_last = TO_BROTLI_BOOL(i + 1 == num_segments);
+      job->input_size = (size_t)((job->is_last ?
+          input_end : segments[i + 1].compressed_offset) -
+          segments[i].compressed_offset);
+      job->output = NULL;
+      if (job->is_last) {
+        /* Initial guess: the last segment is not longer than the others. */
+        job->output_size = (size_t)segments[1].uncompressed_offset;
+        if (job->output_size < kFileBufferSize) {
+          job->output_size = kFileBufferSize;
+        }
+      } else {
+        job->output_size = (size_t)(segments[i + 1].uncompressed_offset -
+            segments[i].uncompressed_offset);
+        if (output) {
+          job->output = output + (segments[i].uncompressed_offset -
+              segments[first].uncompressed_offset);
+        }
+      }
+    }
+    batch.num_jobs = end - first;
+    batch.next_job = 0;
+    RunWorkers(context->threads < (int)batch.num_jobs ?
+        context->threads : (int)batch.num_jobs, DecodeSegmentsWorker, &batch);
+    for (i = 0; i < batch.num_jobs; ++i) {
+      SegmentJob* job = &jobs[i];
+      if (is_ok && !job->is_ok) {
+        fprintf(stderr, "corrupt input [%s]\n",
+                PrintablePath(context->current_input_path));
+        is_ok = BROTLI_FALSE;
+      }
+    }
+    if (is_ok && !context->test_integrity) {
+      /* All but the last segment are decoded into the shared buffer. */
+      SegmentJob* last = &jobs[batch.num_jobs - 1];
+      if (output_size != 0) {
+        fwrite(output, 1, (size_t)output_size, context->fout);
+      }
+      if (last->is_last && last->output_size != 0) {
+        fwrite(last->output, 1, last->output_size, context->fout);
+      }
+      if (ferror(context->fout)) {
+        fprintf(stderr, "failed to write output [%s]: %s\n",
+                PrintablePath(context->current_output_path), strerror(errno));
+        is_ok = BROTLI_FALSE;
+      }
+    }
+    for (i = 0; i < batch.num_jobs; ++i) {
+      context->total_out += jobs[i].output_size;
+      if (jobs[i].is_last) free(jobs[i].output);
+    }
+  }
+  MutexDestroy(&batch.mutex);
+  free(jobs);
+  free(input);
+  free(output);
+  if (is_ok && context->verbosity > 0) {
+    PrintFileProcessingResult(context, "Decompressed");
+  }
+  return is_ok;
+}
+
+/* Parallel processing of multiple files (--jobs). All entries are collected
+   upfront, then files are handed out to workers largest-first, so that big
+   files start early and small ones fill the gaps at the end. Each worker has
+   its own copy of context, with own buffers. */
+
+typedef BROTLI_BOOL (*FileFunc)(Context* context);
+
+typedef struct {
+  const char* input_path;
+  char* output_path;
+  int64_t input_file_length;
+} FileEntry;
+
+typedef struct {
+  const Context* context;
+  FileFunc func;
+  FileEntry* files;
+  size_t num_files;
+  size_t next_file;
+  BROTLI_BOOL is_ok;
+  Mutex mutex;
+} FileQueue;
+
+static int CompareFileEntries(const void* a, const void* b) {
+  int64_t size_a = ((const FileEntry*)a)->input_file_length;
+  int64_t size_b = ((const FileEntry*)b)->input_file_length;
+  if (size_a != size_b) return (size_a > size_b) ? -1 : 1;
+  return 0;
+}
+
+static void SelectFile(Context* context, const FileEntry* file) {
+  context->current_input_path = file->input_path;
+  context->current_output_path = file->output_path;
+  context->input_file_length = file->input_file_length;
+}
+
+static void ProcessFilesWorker(void* arg) {
+  FileQueue* queue = (FileQueue*)arg;
+  Context context = *queue->context;
+  /* Files are processed concurrently already; -T output does not depend on
+     the number of threads anyway. */
+  if (context.threads > 1) context.threads = 1;
+  context.report_mutex = &queue->mutex;
+  context.buffer = (uint8_t*)malloc(kFileBufferSize * 2);
+  if (!context.buffer) {
+    MutexLock(&queue->mutex);
+    if (queue->is_ok) fprintf(stderr, "out of memory\n");
+    queue->is_ok = BROTLI_FALSE;
+    MutexUnlock(&queue->mutex);
+    return;
+  }
+  context.input = context.buffer;
+  context.output = context.buffer + kFileBufferSize;
+  for (;;) {
+    FileEntry* file = NULL;
+    MutexLock(&queue->mutex);
+    /* Like sequential processing, stop after the first failure. */
+    if (queue->is_ok && queue->next_file < queue->num_files) {
+      file = &queue->files[queue->next_file++];
+    }
+    MutexUnlock(&queue->mutex);
+    if (!file) break;
+    SelectFile(&context, file);
+    if (!queue->func(&context)) {
+      MutexLock(&queue->mutex);
+      queue->is_ok = BROTLI_FALSE;
+      MutexUnlock(&queue->mutex);
+    }
+  }
+  free(context.buffer);
+}
+
+/* Applies |func| to all input entries. */
+static BROTLI_BOOL ProcessFiles(Context* context, FileFunc func) {
+  FileQueue queue;
+  size_t capacity = 0;
+  BROTLI_BOOL is_parallel = TO_BROTLI_BOOL(context->jobs > 1 &&
+      context->input_count > 1 && !context->write_to_stdout);
+  size_t i;
+  if (!is_parallel) {
+    while (NextFile(context)) {
+      if (!func(context)) return BROTLI_FALSE;
+    }
+    return BROTLI_TRUE;
+  }
+  queue.context = context;
+  queue.func = func;
+  queue.files = NULL;
+  queue.num_files = 0;
+  queue.next_file = 0;
+  queue.is_ok = BROTLI_TRUE;
+  while (queue.is_ok && NextFile(context)) {
+    FileEntry* file;
+    if (queue.num_files == capacity) {
+      FileEntry* files;
+      capacity = capacity ? 2 * capacity : 16;
+      files = (FileEntry*)realloc(queue.files, capacity * sizeof(FileEntry));
+      if (!files) {
+        queue.is_ok = BROTLI_FALSE;
+        break;
+      }
+      queue.files = files;
+    }
+    file = &queue.files[queue.num_files];
+    file->input_path = context->current_input_path;
+    file->input_file_length = context->input_file_length;
+    file->output_path = NULL;
+    /* Console entries are consumed in order; do not reorder anything. */
+    if (!context->current_input_path) is_parallel = BROTLI_FALSE;
+    if (context->current_output_path) {
+      file->output_path =
+          (char*)malloc(strlen(context->current_output_path) + 1);
+      if (!file->output_path) {
+        queue.is_ok = BROTLI_FALSE;
+        break;
+      }
+      strcpy(file->output_path, context->current_output_path);
+    }
+    queue.num_files++;
+  }
+  if (!queue.is_ok) fprintf(stderr, "out of memory\n");
+  if (queue.is_ok && is_parallel) {
+    qsort(queue.files, queue.num_files, sizeof(FileEntry), CompareFileEntries);
+    MutexInit(&queue.mutex);
+    RunWorkers(context->jobs < (int)queue.num_files ?
+        context->jobs : (int)queue.num_files, ProcessFilesWorker, &queue);
+    MutexDestroy(&queue.mutex);
+  } else {
+    for (i = 0; queue.is_ok && i < queue.num_files; ++i) {
+      SelectFile(context, &queue.files[i]);
+      queue.is_ok = func(context);
+    }
+  }
+  for (i = 0; i < queue.num_files; ++i) free(queue.files[i].output_path);
+  free(queue.files);
+  return queue.is_ok;
+}
+
+static BROTLI_BOOL DecompressCurrentFile(Context* context) {
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  BrotliDecoderState* s = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  if (!s) {
+    fprintf(stderr, "out of memory\n");
+    return BROTLI_FALSE;
+  }
+  /* This allows decoding "large-window" streams. Though it creates
+     fragmentation (new builds decode streams that old builds don't),
+     it is better from used experience perspective. */
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+  if (context->test_integrity) {
+    BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_VALIDATE_ONLY, 1u);
+  }
+  is_ok = OpenFiles(context);
+  if (is_ok && !context->current_input_path &&
+      !context->force_overwrite && isatty(STDIN_FILENO)) {
+    fprintf(stderr, "Use -h help. Use -f to force input from a terminal.\n");
+    is_ok = BROTLI_FALSE;
+  }
+  if (is_ok) {
+    BrotliDecoderSegment* segments = NULL;
+    size_t num_segments = 0;
+    uint8_t header[16];
+    size_t header_size = sizeof(header);
+    if (context->threads > 1 && ReadSeekTable(context, &segments,
+        &num_segments, header, &header_size)) {
+      is_ok = DecompressFileParallel(
+          context, segments, num_segments, header, header_size);
+    } else {
+      StartAsyncIo(context);
+      is_ok = DecompressFile(context, s);
+      if (!StopAsyncIo(context, is_ok)) is_ok = BROTLI_FALSE;
+    }
+    free(segments);
+  }
+  BrotliDecoderDestroyInstance(s);
+  if (!CloseFiles(context, is_ok)) is_ok = BROTLI_FALSE;
+  return is_ok;
+}
+
+static BROTLI_BOOL DecompressFiles(Context* context) {
+  return ProcessFiles(context, DecompressCurrentFile);
+}
+
+typedef struct {
+  uint64_t compressed_size;
+  uint64_t uncompressed_size;
+  uint64_t num_metablocks;
+  uint64_t num_metadata_blocks;
+} ListTotals;
+
+static void PrintListLine(const ListTotals* stats, const char* window,
+    const char* content_size, const char* segments, const char* name) {
+  fprintf(stdout, "%12lu  %12lu  %7.3f  %6s  %10lu  %8lu  %7s  %8s  %s\n",
+          (unsigned long)stats->compressed_size,
+          (unsigned long)stats->uncompressed_size,
+          stats->compressed_size ? (double)stats->uncompressed_size /
+              (double)stats->compressed_size : 0.0,
+          window, (unsigned long)stats->num_metablocks,
+          (unsigned long)stats->num_metadata_blocks, content_size, segments,
+          name);
+}
+
+/* Reads the first bytes of a regular input file, without consuming them. */
+static size_t PeekInputHeader(Context* context, uint8_t* header, size_t size) {
+  size_t header_size;
+  if (context->input_map) {
+    header_size = context->input_map_size < size ?
+        context->input_map_size : size;
+    memcpy(header, context->input_map, header_size);
+    return header_size;
+  }
+  if (!context->current_input_path) return 0;
+  header_size = fread(header, 1, size, context->fin);
+  if (fseek(context->fin, 0, SEEK_SET) != 0) return 0;
+  return header_size;
+}
+
+/* Prints the layout of the current input. Compressed metablocks could be
+   delimited only by decoding them, so the whole stream is scanned in
+   validate-only mode; nothing is written, and corrupt input is reported as
+   with --test. Content size and seek table are read from the ends of regular
+   files directly. */
+static BROTLI_BOOL ListCurrentFile(Context* context, ListTotals* totals) {
+  BrotliDecoderStreamInfo info;
+  BrotliDecoderSegment* segments = NULL;
+  size_t num_segments = 0;
+  uint8_t header[32];
+  size_t header_size = sizeof(header);
+  uint64_t content_size;
+  BROTLI_BOOL has_content_size = BROTLI_FALSE;
+  int verbosity = context->verbosity;
+  char window[16];
+  char content_size_str[8];
+  char segments_str[24];
+  ListTotals stats;
+  BROTLI_BOOL is_ok;
+  BrotliDecoderState* s = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  if (!s) {
+    fprintf(stderr, "out of memory\n");
+    return BROTLI_FALSE;
+  }
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_VALIDATE_ONLY, 1u);
+  is_ok = OpenFiles(context);
+  if (is_ok) {
+    if (!ReadSeekTable(context, &segments, &num_segments, header,
+                       &header_size)) {
+      num_segments = 0;
+      header_size = PeekInputHeader(context, header, sizeof(header));
+    }
+    has_content_size =
+        BrotliDecoderPeekContentSize(header_size, header, &content_size);
+    context->verbosity = 0;
+    is_ok = DecompressFile(context, s);
+    context->verbosity = verbosity;
+  }
+  if (is_ok) {
+    BrotliDecoderGetStreamInfo(s, &info);
+    stats.compressed_size = context->total_in;
+    stats.uncompressed_size = context->total_out;
+    stats.num_metablocks = info.num_metablocks;
+    stats.num_metadata_blocks = info.num_metadata_blocks;
+    sprintf(window, "%d%s", (int)info.window_bits,
+            info.large_window ? "L" : "");
+    strcpy(content_size_str, has_content_size ?
+        (content_size == stats.uncompressed_size ? "yes" : "wrong") : "-");
+    if (num_segments > 0) {
+      sprintf(segments_str, "%lu", (unsigned long)num_segments);
+    } else {
+      strcpy(segments_str, "-");
+    }
+    PrintListLine(&stats, window, content_size_str, segments_str,
+                  PrintablePath(context->current_input_path));
+    totals->compressed_size += stats.compressed_size;
+    totals->uncompressed_size += stats.uncompressed_size;
+    totals->num_metablocks += stats.num_metablocks;
+    totals->num_metadata_blocks += stats.num_metadata_blocks;
+  }
+  free(segments);
+  BrotliDecoderDestroyInstance(s);
+  if (!CloseFiles(context, is_ok)) is_ok = BROTLI_FALSE;
+  return is_ok;
+}
+
+static BROTLI_BOOL ListFiles(Context* context) {
+  ListTotals totals;
+  size_t num_files = 0;
+  memset(&totals, 0, sizeof(totals));
+  fprintf(stdout, "  compressed  uncompressed    ratio  window  metablocks"
+          "  metadata  content  segments  name\n");
+  while (NextFile(context)) {
+    if (!ListCurrentFile(context, &totals)) return BROTLI_FALSE;
+    num_files++;
+  }
+  if (num_files > 1) PrintListLine(&totals, "", "", "", "(totals)");
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL CompressFile(Context* context, BrotliEncoderState* s) {
+  BROTLI_BOOL is_eof = BROTLI_FALSE;
+  InitializeBuffers(context);
+  for (;;) {
+    if (context->available_in == 0 && !is_eof) {
+      if (!ProvideInput(context)) return BROTLI_FALSE;
+      is_eof = !HasMoreInput(context);
+    }
+
+    if (!BrotliEncoderCompressStream(s,
+        is_eof ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS,
+        &context->available_in, &context->next_in,
+        &context->available_out, &context->next_out, NULL)) {
+      /* Should detect OOM? */
+      fprintf(stderr, "failed to compress data [%s]\n",
+              PrintablePath(context->current_input_path));
+      return BROTLI_FALSE;
+    }
+
+    if (context->available_out == 0) {
+      if (!ProvideOutput(context)) return BROTLI_FALSE;
+    }
+
+    if (BrotliEncoderIsFinished(s)) {
+      if (!FlushOutput(context)) return BROTLI_FALSE;
+      if (context->verbosity > 0) {
+        PrintFileProcessingResult(context, "Compressed");
+      }
+      return BROTLI_TRUE;
+    }
+  }
+}
+
+/* Runs the encoder until |size| bytes of |data| are consumed with |op|, and
+   the output is drained. */
+static BROTLI_BOOL CompressChunk(Context* context, BrotliEncoderState* s,
+    BrotliEncoderOperation op, size_t size, const uint8_t* data) {
+  for (;;) {
+    if (!BrotliEncoderCompressStream(s, op, &size, &data,
+        &context->available_out, &context->next_out, NULL)) {
+      fprintf(stderr, "failed to compress data [%s]\n",
+              PrintablePath(context->current_input_path));
+      return BROTLI_FALSE;
+    }
+    if (context->available_out == 0) {
+      if (!ProvideOutput(context)) return BROTLI_FALSE;
+      continue;
+    }
+    if (op == BROTLI_OPERATION_FINISH ? BrotliEncoderIsFinished(s) :
+        (size == 0 && !BrotliEncoderHasMoreOutput(s))) {
+      return BROTLI_TRUE;
+    }
+  }
+}
+
+static BROTLI_BOOL WriteCompressed(
+    Context* context, const uint8_t* data, size_t size) {
+  context->total_out += size;
+  if (size == 0) return BROTLI_TRUE;
+  fwrite(data, 1, size, context->fout);
+  if (ferror(context->fout)) {
+    fprintf(stderr, "failed to write output [%s]: %s\n",
+            PrintablePath(context->current_output_path), strerror(errno));
+    return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Largest input that encoder could reference in place. */
+static const size_t kMaxInPlaceInputSize = ((size_t)3 << 30) - 1;
+
+/* Compresses mapped input in one shot; encoder hashes and references the
+   mapping directly, instead of copying it to its ring buffer. Returns
+   BROTLI_FALSE if that is not possible; input is not consumed then. */
+static BROTLI_BOOL CompressFileInPlace(
+    Context* context, uint32_t lgwin, BROTLI_BOOL* is_ok) {
+  size_t max_size;
+  size_t encoded_size;
+  uint8_t* encoded;
+  /* Qualities 0 and 1 do not use ring buffer anyway. */
+  if (!context->input_map || context->quality < 2 ||
+      context->input_map_size > kMaxInPlaceInputSize) {
+    return BROTLI_FALSE;
+  }
+  max_size = BrotliEncoderMaxCompressedSize(context->input_map_size);
+  if (max_size == 0) return BROTLI_FALSE;
+  encoded = (uint8_t*)malloc(max_size);
+  if (!encoded) return BROTLI_FALSE;
+  InitializeBuffers(context);
+  encoded_size = max_size;
+  *is_ok = BrotliEncoderCompress(context->quality, (int)lgwin,
+      BROTLI_DEFAULT_MODE, context->input_map_size, context->input_map,
+      &encoded_size, encoded);
+  if (!*is_ok) {
+    fprintf(stderr, "failed to compress data [%s]\n",
+            PrintablePath(context->current_input_path));
+  } else {
+    context->total_in = context->input_map_size;
+    *is_ok = WriteCompressed(context, encoded, encoded_size);
+  }
+  free(encoded);
+  if (*is_ok && context->verbosity > 0) {
+    PrintFileProcessingResult(context, "Compressed");
+  }
+  return BROTLI_TRUE;
+}
+
+/* Parallel compression (-T). Input is cut into segments of fixed size
+   (--segment, 4 MiB by default); segments are compressed concurrently by
+   independent encoders, as BROTLI_PARAM_SEGMENT_SIZE does, and written in
+   order. Result is a regular seekable stream; it does not depend on the
+   number of threads. Input that fits one segment is compressed as a plain
+   stream. Each segment starts with empty history, and window is limited to
+   the segment size, so the density loss is higher for smaller segments, and
+   is negligible for the default size. */
+
+typedef struct {
+  uint8_t* input;
+  size_t input_size;
+  uint64_t offset;
+  /* The only segment; stream is finished instead of being flushed. */
+  BROTLI_BOOL is_single;
+  uint8_t* output;
+  size_t output_capacity;
+  size_t output_size;
+  BROTLI_BOOL is_ok;
+} CompressJob;
+
+typedef struct {
+  int quality;
+  uint32_t lgwin;
+  size_t segment_size;
+  CompressJob* jobs;
+  size_t num_jobs;
+  size_t next_job;
+  Mutex mutex;
+} CompressBatch;
+
+static void CompressSegment(CompressBatch* batch, CompressJob* job) {
+  /* Initial output size is derived from the input only, so that output is
+     produced exactly the same way whatever buffers are recycled. */
+  size_t output_size = BrotliEncoderMaxCompressedSize(job->input_size) + 16;
+  size_t available_in = job->input_size;
+  const uint8_t* next_in = job->input;
+  size_t available_out;
+  uint8_t* next_out;
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  job->is_ok = BROTLI_FALSE;
+  job->output_size = 0;
+  if (!s) return;
+  if (output_size < job->input_size) output_size = job->input_size + 1024;
+  if (job->output_capacity < output_size) {
+    free(job->output);
+    job->output = (uint8_t*)malloc(output_size);
+    job->output_capacity = job->output ? output_size : 0;
+  }
+  if (!job->output) {
     BrotliEncoderDestroyInstance(s);
-    if (!CloseFiles(context, is_ok)) is_ok = BROTLI_FALSE;
+    return;
+  }
+  available_out = output_size;
+  next_out = job->output;
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)batch->quality);
+  if (batch->lgwin > BROTLI_MAX_WINDOW_BITS) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
+  }
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, batch->lgwin);
+  if (job->is_single) {
+    if (job->input_size != 0) {
+      BrotliEncoderSetParameter(
+          s, BROTLI_PARAM_SIZE_HINT, (uint32_t)job->input_size);
+    }
+  } else {
+    BrotliEncoderSetParameter(
+        s, BROTLI_PARAM_SIZE_HINT, (uint32_t)batch->segment_size);
+    if (job->offset != 0) {
+      BrotliEncoderSetParameter(s, BROTLI_PARAM_STREAM_OFFSET,
+          job->offset < (1u << 30) ? (uint32_t)job->offset : (1u << 30));
+    }
+  }
+  for (;;) {
+    if (!BrotliEncoderCompressStream(s, job->is_single ?
+        BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH,
+        &available_in, &next_in, &available_out, &next_out, NULL)) {
+      break;
+    }
+    if (job->is_single ? BrotliEncoderIsFinished(s) :
+        (available_in == 0 && !BrotliEncoderHasMoreOutput(s))) {
+      job->output_size = (size_t)(next_out - job->output);
+      job->is_ok = BROTLI_TRUE;
+      break;
+    }
+    if (available_out == 0) {
+      size_t used = (size_t)(next_out - job->output);
+      uint8_t* output = (uint8_t*)realloc(job->output, 2 * used);
+      if (!output) break;
+      job->output = output;
+      job->output_capacity = 2 * used;
+      next_out = output + used;
+      available_out = used;
+    }
+  }
+  BrotliEncoderDestroyInstance(s);
+}
+
+static void CompressSegmentsWorker(void* arg) {
+  CompressBatch* batch = (CompressBatch*)arg;
+  for (;;) {
+    CompressJob* job = NULL;
+    MutexLock(&batch->mutex);
+    if (batch->next_job < batch->num_jobs) {
+      job = &batch->jobs[batch->next_job++];
+    }
+    MutexUnlock(&batch->mutex);
+    if (!job) return;
+    CompressSegment(batch, job);
+  }
+}
+
+/* Writes seek table metadata block and empty last metablock; output is byte
+   aligned after the last flushed segment. Stream offset prevents the encoder
+   from emitting the stream header. */
+static BROTLI_BOOL WriteSeekTable(Context* context, const uint64_t* table,
+    size_t num_segments, uint64_t total_size) {
+  const size_t size = num_segments * BROTLI_SEEK_TABLE_ENTRY_SIZE +
+      BROTLI_SEEK_TABLE_TAIL_SIZE;
+  uint8_t* data = (uint8_t*)malloc(size);
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  size_t pos = 0;
+  size_t i;
+  size_t j;
+  BROTLI_BOOL is_ok;
+  if (!data || !s) {
+    fprintf(stderr, "out of memory\n");
+    free(data);
+    if (s) BrotliEncoderDestroyInstance(s);
+    return BROTLI_FALSE;
+  }
+  for (i = 0; i < 2 * num_segments; ++i) {
+    for (j = 0; j < 8; ++j) data[pos++] = (uint8_t)(table[i] >> (8 * j));
+  }
+  for (j = 0; j < 4; ++j) {
+    data[pos + j] = (uint8_t)(num_segments >> (8 * j));
+    data[pos + 4 + j] = (uint8_t)(BROTLI_SEEK_TABLE_SIGNATURE >> (8 * j));
+  }
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_STREAM_OFFSET,
+      total_size < (1u << 30) ? (uint32_t)total_size : (1u << 30));
+  is_ok = CompressChunk(context, s, BROTLI_OPERATION_EMIT_METADATA,
+                        size, data) &&
+      CompressChunk(context, s, BROTLI_OPERATION_FINISH, 0, NULL) &&
+      FlushOutput(context);
+  BrotliEncoderDestroyInstance(s);
+  free(data);
+  return is_ok;
+}
+
+static BROTLI_BOOL CompressFileParallel(Context* context, uint32_t lgwin) {
+  const size_t batch_size = context->threads < 2 ? 2 : (size_t)context->threads;
+  CompressBatch batch;
+  uint64_t* table = NULL;
+  size_t num_segments = 0;
+  uint64_t offset = 0;
+  BROTLI_BOOL is_eof = BROTLI_FALSE;
+  BROTLI_BOOL is_single = BROTLI_FALSE;
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  size_t i;
+  /* Window larger than segment is useless. */
+  if (lgwin > (uint32_t)context->segment_bits) {
+    lgwin = (uint32_t)context->segment_bits;
+  }
+  InitializeBuffers(context);
+  batch.quality = context->quality;
+  batch.lgwin = lgwin;
+  batch.segment_size = (size_t)1 << context->segment_bits;
+  batch.jobs = (CompressJob*)calloc(batch_size, sizeof(CompressJob));
+  if (!batch.jobs) is_ok = BROTLI_FALSE;
+  for (i = 0; is_ok && i < batch_size; ++i) {
+    batch.jobs[i].input = (uint8_t*)malloc(batch.segment_size);
+    if (!batch.jobs[i].input) is_ok = BROTLI_FALSE;
+  }
+  if (!is_ok) fprintf(stderr, "out of memory\n");
+  MutexInit(&batch.mutex);
+  while (is_ok && !is_eof) {
+    /* Read ahead the whole batch. */
+    batch.num_jobs = 0;
+    while (batch.num_jobs < batch_size && !is_eof) {
+      CompressJob* job = &batch.jobs[batch.num_jobs];
+      job->input_size =
+          fread(job->input, 1, batch.segment_size, context->fin);
+      if (ferror(context->fin)) {
+        fprintf(stderr, "failed to read input [%s]: %s\n",
+                PrintablePath(context->current_input_path), strerror(errno));
+        is_ok = BROTLI_FALSE;
+        break;
+      }
+      is_eof = TO_BROTLI_BOOL(job->input_size < batch.segment_size);
+      /* Empty segment is useless, unless the whole input is empty. */
+      if (job->input_size == 0 && offset != 0) break;
+      job->offset = offset;
+      job->is_single = BROTLI_FALSE;
+      offset += job->input_size;
+      context->total_in += job->input_size;
+      batch.num_jobs++;
+    }
+    if (!is_ok || batch.num_jobs == 0) break;
+    if (num_segments == 0 && is_eof && batch.num_jobs == 1) {
+      is_single = BROTLI_TRUE;
+      batch.jobs[0].is_single = BROTLI_TRUE;
+    }
+    batch.next_job = 0;
+    RunWorkers(context->threads < (int)batch.num_jobs ?
+        context->threads : (int)batch.num_jobs, CompressSegmentsWorker, &batch);
+    for (i = 0; is_ok && i < batch.num_jobs; ++i) {
+      CompressJob* job = &batch.jobs[i];
+      if (!job->is_ok) {
+        fprintf(stderr, "failed to compress data [%s]\n",
+                PrintablePath(context->current_input_path));
+        is_ok = BROTLI_FALSE;
+        break;
+      }
+      if (num_segments == BROTLI_SEEK_TABLE_MAX_SEGMENTS) {
+        fprintf(stderr, "too many segments [%s]\n",
+                PrintablePath(context->current_input_path));
+        is_ok = BROTLI_FALSE;
+        break;
+      }
+      if ((num_segments & (num_segments - 1)) == 0) {
+        uint64_t* new_table = (uint64_t*)realloc(
+            table, 2 * (num_segments ? 2 * num_segments : 1) *
+            sizeof(uint64_t));
+        if (!new_table) {
+          fprintf(stderr, "out of memory\n");
+          is_ok = BROTLI_FALSE;
+          break;
+        }
+        table = new_table;
+      }
+      table[2 * num_segments] = (uint64_t)context->total_out;
+      table[2 * num_segments + 1] = job->offset;
+      num_segments++;
+      is_ok = WriteCompressed(context, job->output, job->output_size);
+    }
+  }
+  if (is_ok && !is_single) {
+    is_ok = WriteSeekTable(context, table, num_segments, offset);
+  }
+  MutexDestroy(&batch.mutex);
+  if (batch.jobs) {
+    for (i = 0; i < batch_size; ++i) {
+      free(batch.jobs[i].input);
+      free(batch.jobs[i].output);
+    }
+  }
+  free(batch.jobs);
+  free(table);
+  if (is_ok && context->verbosity > 0) {
+    PrintFileProcessingResult(context, "Compressed");
+  }
+  return is_ok;
+}
+
+/* Returns window size specified by user, or chosen by input size. */
+static uint32_t ChooseLgwin(Context* context, int64_t input_size) {
+  uint32_t lgwin = DEFAULT_LGWIN;
+  /* Specified by user. */
+  if (context->lgwin > 0) return (uint32_t)context->lgwin;
+  /* 0, or not specified by user; could be chosen by compressor. */
+  /* Use file size to limit lgwin. */
+  if (input_size >= 0) {
+    lgwin = BROTLI_MIN_WINDOW_BITS;
+    while (BROTLI_MAX_BACKWARD_LIMIT(lgwin) < (uint64_t)input_size) {
+      lgwin++;
+      if (lgwin == BROTLI_MAX_WINDOW_BITS) break;
+    }
+  }
+  return lgwin;
+}
+
+/* Creates encoder for the current file; NULL, if out of memory. */
+static BrotliEncoderState* CreateEncoder(Context* context, uint32_t lgwin) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  if (!s) {
+    fprintf(stderr, "out of memory\n");
+    return NULL;
+  }
+  BrotliEncoderSetParameter(s,
+      BROTLI_PARAM_QUALITY, (uint32_t)context->quality);
+  /* Do not enable "large-window" extension, if not required. */
+  if (lgwin > BROTLI_MAX_WINDOW_BITS) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
+  }
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, lgwin);
+  if (context->input_file_length > 0) {
+    uint32_t size_hint = context->input_file_length < (1 << 30) ?
+        (uint32_t)context->input_file_length : (1u << 30);
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT, size_hint);
+  }
+  return s;
+}
+
+static BROTLI_BOOL CompressCurrentFile(Context* context) {
+  uint32_t lgwin = ChooseLgwin(context, context->input_file_length);
+  BROTLI_BOOL is_ok = OpenFiles(context);
+  if (is_ok && !context->current_output_path &&
+      !context->force_overwrite && 0/*&& isatty(STDOUT_FILENO)*/) {
+    fprintf(stderr, "Use -h help. Use -f to force output to a terminal.\n");
+    is_ok = BROTLI_FALSE;
+  }
+  if (is_ok) {
+    if (context->threads > 0) {
+      is_ok = CompressFileParallel(context, lgwin);
+    } else if (!CompressFileInPlace(context, lgwin, &is_ok)) {
+      BrotliEncoderState* s = CreateEncoder(context, lgwin);
+      is_ok = TO_BROTLI_BOOL(s != NULL);
+      if (is_ok) {
+        StartAsyncIo(context);
+        is_ok = CompressFile(context, s);
+        if (!StopAsyncIo(context, is_ok)) is_ok = BROTLI_FALSE;
+        BrotliEncoderDestroyInstance(s);
+      }
+    }
+  }
+  if (!CloseFiles(context, is_ok)) is_ok = BROTLI_FALSE;
+  return is_ok;
+}
+
+static BROTLI_BOOL CompressFiles(Context* context) {
+  return ProcessFiles(context, CompressCurrentFile);
+}
+
+/* Solid archive (--archive): all inputs are compressed as a single stream,
+   so later files could reference earlier ones. The index is a metadata block
+   right before the empty last metablock; it lists every file as its
+   NUL-terminated name, offset and size in the decompressed stream, followed
+   by the number of files, the index size and the signature. Numbers are
+   little-endian, 64-bit in the file list and 32-bit in the tail. Regular
+   decoders skip the index and produce the concatenation of the files. */
+
+#define ARCHIVE_SIGNATURE 0x52415242  /* "BRAR" */
+#define ARCHIVE_TAIL_SIZE 12
+/* Limit of a single metadata block. */
+#define ARCHIVE_MAX_INDEX_SIZE (1 << 24)
+
+typedef struct {
+  const char* name;
+  /* Used only when archive is created. */
+  const char* path;
+  int64_t input_file_length;
+  uint64_t offset;
+  uint64_t size;
+} ArchiveEntry;
+
+typedef struct {
+  uint8_t* data;  /* Serialized index; entry names point here. */
+  ArchiveEntry* entries;
+  size_t num_entries;
+} ArchiveIndex;
+
+static void StoreLE(uint8_t* data, uint64_t value, int n_bytes) {
+  int i;
+  for (i = 0; i < n_bytes; ++i) data[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t LoadLE(const uint8_t* data, int n_bytes) {
+  uint64_t value = 0;
+  while (n_bytes-- > 0) value = (value << 8) | data[n_bytes];
+  return value;
+}
+
+static void FreeArchiveIndex(ArchiveIndex* index) {
+  free(index->data);
+  free(index->entries);
+  index->data = NULL;
+  index->entries = NULL;
+  index->num_entries = 0;
+}
+
+static BROTLI_BOOL AddArchiveEntry(ArchiveIndex* index, size_t* capacity) {
+  if (index->num_entries == *capacity) {
+    ArchiveEntry* entries;
+    *capacity = *capacity ? 2 * *capacity : 16;
+    entries = (ArchiveEntry*)realloc(
+        index->entries, *capacity * sizeof(ArchiveEntry));
+    if (!entries) {
+      fprintf(stderr, "out of memory\n");
+      return BROTLI_FALSE;
+    }
+    index->entries = entries;
+  }
+  memset(&index->entries[index->num_entries++], 0, sizeof(ArchiveEntry));
+  return BROTLI_TRUE;
+}
+
+/* Serializes the index of compressed entries to |index->data|. */
+static BROTLI_BOOL EncodeArchiveIndex(ArchiveIndex* index, size_t* size) {
+  uint8_t* data;
+  size_t i;
+  *size = ARCHIVE_TAIL_SIZE;
+  for (i = 0; i < index->num_entries; ++i) {
+    *size += strlen(index->entries[i].name) + 1 + 16;
+    if (*size > ARCHIVE_MAX_INDEX_SIZE) {
+      fprintf(stderr, "too many files for archive index\n");
+      return BROTLI_FALSE;
+    }
+  }
+  data = (uint8_t*)malloc(*size);
+  if (!data) {
+    fprintf(stderr, "out of memory\n");
+    return BROTLI_FALSE;
+  }
+  index->data = data;
+  for (i = 0; i < index->num_entries; ++i) {
+    const ArchiveEntry* entry = &index->entries[i];
+    size_t name_size = strlen(entry->name) + 1;
+    memcpy(data, entry->name, name_size);
+    data += name_size;
+    StoreLE(data, entry->offset, 8);
+    StoreLE(data + 8, entry->size, 8);
+    data += 16;
+  }
+  StoreLE(data, index->num_entries, 4);
+  StoreLE(data + 4, *size, 4);
+  StoreLE(data + 8, ARCHIVE_SIGNATURE, 4);
+  return BROTLI_TRUE;
+}
+
+/* Reads the index from the end of the current input; offsets should match
+   sizes, i.e. files follow each other without gaps. */
+static BROTLI_BOOL ReadArchiveIndex(Context* context, ArchiveIndex* index) {
+  uint8_t tail[ARCHIVE_TAIL_SIZE + 1];
+  const size_t tail_size = sizeof(tail);
+  size_t index_size = 0;
+  size_t count = 0;
+  size_t pos = 0;
+  uint64_t offset = 0;
+  BROTLI_BOOL is_ok = BROTLI_FALSE;
+  index->data = NULL;
+  index->entries = NULL;
+  index->num_entries = 0;
+  if (context->current_input_path &&
+      context->input_file_length >= (int64_t)tail_size &&
+      fseek(context->fin, -(long)tail_size, SEEK_END) == 0 &&
+      fread(tail, 1, tail_size, context->fin) == tail_size &&
+      tail[ARCHIVE_TAIL_SIZE] == 3 &&
+      LoadLE(tail + 8, 4) == ARCHIVE_SIGNATURE) {
+    count = (size_t)LoadLE(tail, 4);
+    index_size = (size_t)LoadLE(tail + 4, 4);
+    if (index_size >= ARCHIVE_TAIL_SIZE &&
+        index_size <= ARCHIVE_MAX_INDEX_SIZE &&
+        (int64_t)index_size < context->input_file_length &&
+        count <= (index_size - ARCHIVE_TAIL_SIZE) / 17) {
+      index->data = (uint8_t*)malloc(index_size);
+      index->entries = (ArchiveEntry*)malloc(
+          (count ? count : 1) * sizeof(ArchiveEntry));
+    }
+  }
+  if (index->data && index->entries &&
+      fseek(context->fin, -(long)(index_size + 1), SEEK_END) == 0 &&
+      fread(index->data, 1, index_size, context->fin) == index_size) {
+    is_ok = BROTLI_TRUE;
+    index_size -= ARCHIVE_TAIL_SIZE;
+    while (is_ok && index->num_entries < count) {
+      ArchiveEntry* entry = &index->entries[index->num_entries++];
+      const uint8_t* name_end = (const uint8_t*)memchr(
+          index->data + pos, 0, index_size - pos);
+      if (!name_end || (size_t)(name_end - index->data) + 17 > index_size) {
+        is_ok = BROTLI_FALSE;
+        break;
+      }
+      entry->name = (const char*)(index->data + pos);
+      pos = (size_t)(name_end - index->data) + 1;
+      entry->offset = LoadLE(index->data + pos, 8);
+      entry->size = LoadLE(index->data + pos + 8, 8);
+      pos += 16;
+      is_ok = TO_BROTLI_BOOL(entry->offset == offset &&
+                             entry->size <= ~offset);
+      offset += entry->size;
+    }
+    if (pos != index_size) is_ok = BROTLI_FALSE;
+  }
+  if (fseek(context->fin, 0, SEEK_SET) != 0) is_ok = BROTLI_FALSE;
+  if (!is_ok) {
+    fprintf(stderr, "archive index not found [%s]\n",
+            PrintablePath(context->current_input_path));
+    FreeArchiveIndex(index);
+  }
+  return is_ok;
+}
+
+/* Extracted files are created relative to the current directory. */
+static BROTLI_BOOL IsSafeArchiveName(const char* name) {
+  const char* part = name;
+  if (name[0] == 0 || name[0] == '/' || name[0] == '\\' ||
+      strchr(name, ':')) {
+    return BROTLI_FALSE;
+  }
+  for (;;) {
+    size_t len = strcspn(part, "/\\");
+    if (len == 2 && part[0] == '.' && part[1] == '.') return BROTLI_FALSE;
+    if (part[len] == 0) return BROTLI_TRUE;
+    part += len + 1;
+  }
+}
+
+/* Returns the name that |path| is stored under: drive prefix and leading
+   separators are dropped, so that files are extracted relative to the
+   current directory. */
+static const char* ArchiveName(const char* path) {
+  if (((path[0] >= 'A' && path[0] <= 'Z') ||
+       (path[0] >= 'a' && path[0] <= 'z')) && path[1] == ':') {
+    path += 2;
+  }
+  while (path[0] == '/' || path[0] == '\\') path++;
+  return path;
+}
+
+/* Appends the current input to the archive stream. */
+static BROTLI_BOOL ArchiveFile(Context* context, BrotliEncoderState* s) {
+  while (HasMoreInput(context)) {
+    if (!ProvideInput(context)) return BROTLI_FALSE;
+    while (context->available_in != 0) {
+      if (!BrotliEncoderCompressStream(s, BROTLI_OPERATION_PROCESS,
+          &context->available_in, &context->next_in,
+          &context->available_out, &context->next_out, NULL)) {
+        fprintf(stderr, "failed to compress data [%s]\n",
+                PrintablePath(context->current_input_path));
+        return BROTLI_FALSE;
+      }
+      if (context->available_out == 0 && !ProvideOutput(context)) {
+        return BROTLI_FALSE;
+      }
+    }
+  }
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL CompressArchive(Context* context) {
+  ArchiveIndex index = {NULL, NULL, 0};
+  size_t capacity = 0;
+  size_t index_size = 0;
+  int64_t total_size = 0;
+  uint32_t lgwin;
+  BrotliEncoderState* s = NULL;
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  size_t i;
+  while (is_ok && NextFile(context)) {
+    if (!context->current_input_path) {
+      fprintf(stderr, "standard input could not be archived\n");
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    is_ok = AddArchiveEntry(&index, &capacity);
+    if (!is_ok) break;
+    index.entries[index.num_entries - 1].path = context->current_input_path;
+    index.entries[index.num_entries - 1].name =
+        ArchiveName(context->current_input_path);
+    if (!IsSafeArchiveName(index.entries[index.num_entries - 1].name)) {
+      fprintf(stderr, "file could not be archived under its name [%s]\n",
+              context->current_input_path);
+      is_ok = BROTLI_FALSE;
+      break;
+    }
+    index.entries[index.num_entries - 1].input_file_length =
+        context->input_file_length;
+    if (context->input_file_length < 0 || total_size < 0) {
+      total_size = -1;
+    } else {
+      total_size += context->input_file_length;
+    }
+  }
+  if (!is_ok || context->iterator_error) {
+    FreeArchiveIndex(&index);
+    return BROTLI_FALSE;
+  }
+  lgwin = ChooseLgwin(context, total_size);
+  s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  if (!s) {
+    fprintf(stderr, "out of memory\n");
+    FreeArchiveIndex(&index);
+    return BROTLI_FALSE;
+  }
+  BrotliEncoderSetParameter(s,
+      BROTLI_PARAM_QUALITY, (uint32_t)context->quality);
+  if (lgwin > BROTLI_MAX_WINDOW_BITS) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_LARGE_WINDOW, 1u);
+  }
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_LGWIN, lgwin);
+  if (total_size > 0) {
+    BrotliEncoderSetParameter(s, BROTLI_PARAM_SIZE_HINT,
+        total_size < (1 << 30) ? (uint32_t)total_size : (1u << 30));
+  }
+  context->current_output_path = context->output_path;
+  is_ok = OpenOutputFile(
+      context->output_path, &context->fout, context->force_overwrite);
+  InitializeBuffers(context);
+  for (i = 0; is_ok && i < index.num_entries; ++i) {
+    ArchiveEntry* entry = &index.entries[i];
+    context->current_input_path = entry->path;
+    context->input_file_length = entry->input_file_length;
+    entry->offset = context->total_in;
+    is_ok = OpenInputFile(entry->path, &context->fin);
+    if (!is_ok) break;
+    MapInputFile(context);
+    is_ok = ArchiveFile(context, s);
+    UnmapInputFile(context);
+    fclose(context->fin);
+    context->fin = NULL;
+    entry->size = context->total_in - entry->offset;
+    if (is_ok && context->verbosity > 0) {
+      fprintf(stderr, "Archived [%s]: ", PrintablePath(entry->path));
+      PrintBytes((size_t)entry->size);
+      fprintf(stderr, "\n");
+    }
+  }
+  if (is_ok) is_ok = EncodeArchiveIndex(&index, &index_size);
+  if (is_ok) {
+    is_ok = CompressChunk(context, s, BROTLI_OPERATION_EMIT_METADATA,
+                            index_size, index.data) &&
+        CompressChunk(context, s, BROTLI_OPERATION_FINISH, 0, NULL) &&
+        FlushOutput(context);
+  }
+  BrotliEncoderDestroyInstance(s);
+  if (context->fout) {
+    if (fclose(context->fout) != 0) {
+      if (is_ok) {
+        fprintf(stderr, "fclose failed [%s]: %s\n",
+                PrintablePath(context->output_path), strerror(errno));
+      }
+      is_ok = BROTLI_FALSE;
+    }
+    if (!is_ok && context->output_path) unlink(context->output_path);
+    context->fout = NULL;
+  }
+  if (is_ok && context->verbosity > 0) {
+    fprintf(stderr, "Compressed [%s]: %lu files, ",
+            PrintablePath(context->output_path),
+            (unsigned long)index.num_entries);
+    PrintBytes(context->total_in);
+    fprintf(stderr, " -> ");
+    PrintBytes(context->total_out);
+    fprintf(stderr, "\n");
+  }
+  if (is_ok && context->junk_source) {
+    for (i = 0; i < index.num_entries; ++i) unlink(index.entries[i].path);
+  }
+  FreeArchiveIndex(&index);
+  return is_ok;
+}
+
+/* Creates missing directories of the extracted file |name|. */
+static BROTLI_BOOL CreateParentDirectories(const char* name) {
+  size_t len = strlen(name);
+  char* path = (char*)malloc(len + 1);
+  BROTLI_BOOL is_ok = BROTLI_TRUE;
+  size_t i;
+  if (!path) {
+    fprintf(stderr, "out of memory\n");
+    return BROTLI_FALSE;
+  }
+  memcpy(path, name, len + 1);
+  for (i = 1; is_ok && i < len; ++i) {
+    if (path[i] != '/' && path[i] != '\\') continue;
+    path[i] = 0;
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+      fprintf(stderr, "failed to create directory [%s]: %s\n",
+              path, strerror(errno));
+      is_ok = BROTLI_FALSE;
+    }
+    path[i] = name[i];
+  }
+  free(path);
+  return is_ok;
+}
+
+/* Decodes next |size| bytes of the archive stream; those are written to
+   |fout|, unless it is NULL. */
+static BROTLI_BOOL ExtractEntry(Context* context, BrotliDecoderState* s,
+    const char* name, uint64_t size, FILE* fout) {
+  BrotliDecoderResult result;
+  while (size > 0) {
+    uint8_t* next_out = context->output;
+    size_t available_out =
+        size < kFileBufferSize ? (size_t)size : kFileBufferSize;
+    size_t out_size;
+    if (context->available_in == 0 && HasMoreInput(context)) {
+      if (!ProvideInput(context)) return BROTLI_FALSE;
+    }
+    result = BrotliDecoderDecompressStream(s, &context->available_in,
+        &context->next_in, &available_out, &next_out, NULL);
+    out_size = (size_t)(next_out - context->output);
+    size -= out_size;
+    context->total_out += out_size;
+    if (fout && out_size != 0) {
+      fwrite(context->output, 1, out_size, fout);
+      if (ferror(fout)) {
+        fprintf(stderr, "failed to write output [%s]: %s\n",
+                PrintablePath(name), strerror(errno));
+        return BROTLI_FALSE;
+      }
+    }
+    if (result == BROTLI_DECODER_RESULT_ERROR ||
+        (result == BROTLI_DECODER_RESULT_SUCCESS && size != 0) ||
+        (result == BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT &&
+         !HasMoreInput(context))) {
+      fprintf(stderr, "corrupt input [%s]\n",
+              PrintablePath(context->current_input_path));
+      return BROTLI_FALSE;
+    }
+  }
+  return BROTLI_TRUE;
+}
+
+/* Extracts either all files, or only --member; decoding stops at the end of
+   the last extracted file. With -o / -c all extracted files are written to
+   the same output, otherwise to files named as stored. */
+static BROTLI_BOOL ExtractCurrentArchive(Context* context) {
+  ArchiveIndex index;
+  size_t first = 0;
+  size_t last;
+  BROTLI_BOOL to_single_output = TO_BROTLI_BOOL(
+      context->output_path || context->write_to_stdout);
+  BROTLI_BOOL is_ok;
+  size_t i;
+  BrotliDecoderState* s;
+  if (!OpenInputFile(context->current_input_path, &context->fin)) {
+    return BROTLI_FALSE;
+  }
+  is_ok = ReadArchiveIndex(context, &index);
+  last = index.num_entries;
+  if (is_ok && context->member) {
+    for (first = 0; first < index.num_entries; ++first) {
+      if (strcmp(index.entries[first].name,
+                 ArchiveName(context->member)) == 0) {
+        break;
+      }
+    }
+    if (first == index.num_entries) {
+      fprintf(stderr, "member [%s] not found in [%s]\n", context->member,
+              PrintablePath(context->current_input_path));
+      is_ok = BROTLI_FALSE;
+    }
+    last = first + 1;
+  }
+  for (i = first; is_ok && !to_single_output && i < last; ++i) {
+    if (!IsSafeArchiveName(index.entries[i].name)) {
+      fprintf(stderr, "unsafe member name [%s] in [%s]\n",
+              index.entries[i].name,
+              PrintablePath(context->current_input_path));
+      is_ok = BROTLI_FALSE;
+    }
+  }
+  s = BrotliDecoderCreateInstance(NULL, NULL, NULL);
+  if (is_ok && !s) {
+    fprintf(stderr, "out of memory\n");
+    is_ok = BROTLI_FALSE;
+  }
+  if (is_ok) {
+    BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_LARGE_WINDOW, 1u);
+    MapInputFile(context);
+    InitializeBuffers(context);
+    if (to_single_output) {
+      context->current_output_path = context->output_path;
+      is_ok = OpenOutputFile(
+          context->output_path, &context->fout, context->force_overwrite);
+    }
+  }
+  for (i = 0; is_ok && i < last; ++i) {
+    const ArchiveEntry* entry = &index.entries[i];
+    FILE* fout = NULL;
+    if (i >= first && !to_single_output) {
+      context->current_output_path = entry->name;
+      is_ok = CreateParentDirectories(entry->name) &&
+          OpenOutputFile(entry->name, &fout, context->force_overwrite);
+      if (!is_ok) break;
+    } else if (i >= first) {
+      fout = context->fout;
+    }
+    is_ok = ExtractEntry(context, s, entry->name, entry->size, fout);
+    if (fout && fout != context->fout) {
+      if (fclose(fout) != 0 && is_ok) {
+        fprintf(stderr, "fclose failed [%s]: %s\n",
+                PrintablePath(entry->name), strerror(errno));
+        is_ok = BROTLI_FALSE;
+      }
+      if (!is_ok) unlink(entry->name);
+    }
+    if (is_ok && fout && context->verbosity > 0) {
+      fprintf(stderr, "Extracted [%s]: ", entry->name);
+      PrintBytes((size_t)entry->size);
+      fprintf(stderr, "\n");
+    }
+  }
+  if (s) BrotliDecoderDestroyInstance(s);
+  FreeArchiveIndex(&index);
+  if (context->fout) {
+    if (fclose(context->fout) != 0) {
+      if (is_ok) {
+        fprintf(stderr, "fclose failed [%s]: %s\n",
+                PrintablePath(context->output_path), strerror(errno));
+      }
+      is_ok = BROTLI_FALSE;
+    }
+    if (!is_ok && context->output_path) unlink(context->output_path);
+    context->fout = NULL;
+  }
+  UnmapInputFile(context);
+  fclose(context->fin);
+  context->fin = NULL;
+  return is_ok;
+}
+
+static BROTLI_BOOL ExtractArchives(Context* context) {
+  while (NextFile(context)) {
+    if (!ExtractCurrentArchive(context)) return BROTLI_FALSE;
+  }
+  return BROTLI_TRUE;
+}
+
+/* Lists archive entries; only the index is read, nothing is decoded. */
+static BROTLI_BOOL ListArchives(Context* context) {
+  while (NextFile(context)) {
+    ArchiveIndex index;
+    uint64_t total_size = 0;
+    size_t i;
+    BROTLI_BOOL is_ok = OpenInputFile(context->current_input_path,
+                                      &context->fin);
+    if (!is_ok) return BROTLI_FALSE;
+    is_ok = ReadArchiveIndex(context, &index);
+    fclose(context->fin);
+    context->fin = NULL;
+    if (!is_ok) return BROTLI_FALSE;
+    fprintf(stdout, "[%s]:\n", PrintablePath(context->current_input_path));
+    fprintf(stdout, "      offset          size  name\n");
+    for (i = 0; i < index.num_entries; ++i) {
+      const ArchiveEntry* entry = &index.entries[i];
+      fprintf(stdout, "%12lu  %12lu  %s\n", (unsigned long)entry->offset,
+              (unsigned long)entry->size, entry->name);
+      total_size += entry->size;
+    }
+    fprintf(stdout, "%12s  %12lu  (%lu files, %lu bytes compressed)\n", "",
+            (unsigned long)total_size, (unsigned long)index.num_entries,
+            (unsigned long)context->input_file_length);
+    FreeArchiveIndex(&index);
+  }
+  return BROTLI_TRUE;
+}
+
+/* Built-in benchmark (--bench): every input is compressed and decompressed
+   in memory at each quality of the range, repeatedly for a fixed time. */
+
+#define BENCH_SECONDS 1.0
+
+typedef struct {
+  size_t input_size;
+  size_t compressed_size;
+  double compress_ns;  /* Time of one iteration. */
+  double decompress_ns;
+} BenchResult;
+
+static BROTLI_BOOL ReadWholeFile(
+    Context* context, uint8_t** data, size_t* size) {
+  size_t capacity = kFileBufferSize;
+  BROTLI_BOOL is_ok = OpenInputFile(context->current_input_path,
+                                    &context->fin);
+  *data = NULL;
+  *size = 0;
+  if (!is_ok) return BROTLI_FALSE;
+  if (context->input_file_length > 0 &&
+      (uint64_t)context->input_file_length < (size_t)-1) {
+    capacity = (size_t)context->input_file_length + 1;
+  }
+  while (is_ok) {
+    if (!*data || *size == capacity) {
+      uint8_t* new_data;
+      if (*data) capacity *= 2;
+      new_data = (uint8_t*)realloc(*data, capacity);
+      if (!new_data) {
+        fprintf(stderr, "out of memory\n");
+        is_ok = BROTLI_FALSE;
+        break;
+      }
+      *data = new_data;
+    }
+    *size += fread(*data + *size, 1, capacity - *size, context->fin);
+    if (ferror(context->fin)) {
+      fprintf(stderr, "failed to read input [%s]: %s\n",
+              PrintablePath(context->current_input_path), strerror(errno));
+      is_ok = BROTLI_FALSE;
+    }
+    if (feof(context->fin)) break;
+  }
+  if (context->current_input_path) fclose(context->fin);
+  context->fin = NULL;
+  return is_ok;
+}
+
+static double MegabytesPerSecond(size_t bytes, double ns) {
+  return ns > 0 ? (double)bytes * 1e3 / ns : 0.0;
+}
+
+static void PrintBenchHeader(void) {
+  fprintf(stdout,
+          " q  lgwin   compressed    ratio  compress MB/s  decompress MB/s\n");
+}
+
+static void PrintBenchResult(
+    int quality, uint32_t lgwin, const BenchResult* result) {
+  fprintf(stdout, "%2d  %5d  %11lu  %7.3f  %13.2f  %15.2f\n",
+          quality, (int)lgwin, (unsigned long)result->compressed_size,
+          result->compressed_size ? (double)result->input_size /
+              (double)result->compressed_size : 0.0,
+          MegabytesPerSecond(result->input_size, result->compress_ns),
+          MegabytesPerSecond(result->input_size, result->decompress_ns));
+}
+
+/* Measures one file at one quality; each direction is repeated until
+   BENCH_SECONDS pass, at least once. */
+static BROTLI_BOOL BenchQuality(Context* context, int quality, uint32_t lgwin,
+    const uint8_t* data, size_t size, uint8_t* compressed,
+    size_t compressed_capacity, uint8_t* decompressed, BenchResult* result) {
+  double start = BrotliBenchNow();
+  double elapsed;
+  size_t iterations = 0;
+  size_t compressed_size = 0;
+  size_t decompressed_size = 0;
+  do {
+    compressed_size = compressed_capacity;
+    if (!BrotliBenchCompress(NULL, NULL, NULL, quality, (int)lgwin,
+        BROTLI_DEFAULT_MODE, data, size, compressed, &compressed_size)) {
+      fprintf(stderr, "failed to compress data [%s]\n",
+              PrintablePath(context->current_input_path));
+      return BROTLI_FALSE;
+    }
+    iterations++;
+    elapsed = BrotliBenchNow() - start;
+  } while (elapsed < BENCH_SECONDS * 1e9);
+  result->input_size = size;
+  result->compressed_size = compressed_size;
+  result->compress_ns = elapsed / (double)iterations;
+
+  start = BrotliBenchNow();
+  iterations = 0;
+  do {
+    decompressed_size = size + 1;
+    if (!BrotliBenchDecompress(NULL, NULL, NULL, compressed,
+        compressed_size, decompressed, &decompressed_size)) {
+      decompressed_size = size + 1;
+      break;
+    }
+    iterations++;
+    elapsed = BrotliBenchNow() - start;
+  } while (elapsed < BENCH_SECONDS * 1e9);
+  if (decompressed_size != size || memcmp(data, decompressed, size) != 0) {
+    fprintf(stderr, "roundtrip mismatch [%s]\n",
+            PrintablePath(context->current_input_path));
+    return BROTLI_FALSE;
+  }
+  result->decompress_ns = elapsed / (double)iterations;
+  return BROTLI_TRUE;
+}
+
+static BROTLI_BOOL BenchFiles(Context* context) {
+  BenchResult totals[BROTLI_MAX_QUALITY + 1];
+  size_t num_files = 0;
+  size_t total_size = 0;
+  int quality;
+  memset(totals, 0, sizeof(totals));
+  while (NextFile(context)) {
+    uint8_t* data;
+    size_t size;
+    size_t compressed_capacity;
+    uint8_t* compressed;
+    uint8_t* decompressed;
+    uint32_t lgwin;
+    BROTLI_BOOL is_ok;
+    if (!ReadWholeFile(context, &data, &size)) {
+      free(data);
+      return BROTLI_FALSE;
+    }
+    lgwin = ChooseLgwin(context, (int64_t)size);
+    compressed_capacity = BrotliEncoderMaxCompressedSize(size);
+    if (compressed_capacity == 0) compressed_capacity = size + 1024;
+    compressed = (uint8_t*)malloc(compressed_capacity);
+    decompressed = (uint8_t*)malloc(size + 1);
+    is_ok = TO_BROTLI_BOOL(compressed && decompressed);
+    if (!is_ok) fprintf(stderr, "out of memory\n");
+    if (is_ok) {
+      fprintf(stdout, "[%s]: %lu bytes\n",
+              PrintablePath(context->current_input_path), (unsigned long)size);
+      PrintBenchHeader();
+    }
+    for (quality = context->quality;
+         is_ok && quality <= context->max_quality; ++quality) {
+      BenchResult result;
+      is_ok = BenchQuality(context, quality, lgwin, data, size, compressed,
+          compressed_capacity, decompressed, &result);
+      if (!is_ok) break;
+      PrintBenchResult(quality, lgwin, &result);
+      fflush(stdout);
+      totals[quality].input_size += result.input_size;
+      totals[quality].compressed_size += result.compressed_size;
+      totals[quality].compress_ns += result.compress_ns;
+      totals[quality].decompress_ns += result.decompress_ns;
+    }
+    free(data);
+    free(compressed);
+    free(decompressed);
     if (!is_ok) return BROTLI_FALSE;
+    num_files++;
+    total_size += size;
+  }
+  if (num_files > 1) {
+    fprintf(stdout, "Total: %lu files, %lu bytes\n",
+            (unsigned long)num_files, (unsigned long)total_size);
+    fprintf(stdout,
+            " q   compressed    ratio  compress MB/s  decompress MB/s\n");
+    for (quality = context->quality; quality <= context->max_quality;
+         ++quality) {
+      const BenchResult* result = &totals[quality];
+      fprintf(stdout, "%2d  %11lu  %7.3f  %13.2f  %15.2f\n", quality,
+              (unsigned long)result->compressed_size,
+              result->compressed_size ? (double)result->input_size /
+                  (double)result->compressed_size : 0.0,
+              MegabytesPerSecond(result->input_size, result->compress_ns),
+              MegabytesPerSecond(result->input_size, result->decompress_ns));
+    }
   }
   return BROTLI_TRUE;
 }
@@ -1033,6 +3244,12 @@ int main(int argc, char** argv) {
   context.write_to_stdout = BROTLI_FALSE;
   context.decompress = BROTLI_FALSE;
   context.large_window = BROTLI_FALSE;
+  context.async_io = BROTLI_FALSE;
+  context.archive = BROTLI_FALSE;
+  context.member = NULL;
+  context.threads = 0;
+  context.jobs = 0;
+  context.segment_bits = DEFAULT_SEGMENT_BITS;
   context.output_path = NULL;
   context.suffix = DEFAULT_SUFFIX;
   for (i = 0; i < MAX_OPTIONS; ++i) context.not_input_indices[i] = 0;
@@ -1050,11 +3267,16 @@ int main(int argc, char** argv) {
   context.current_output_path = NULL;
   context.fin = NULL;
   context.fout = NULL;
+  context.input_map = NULL;
+  context.input_pipe = NULL;
+  context.output_pipe = NULL;
+  context.report_mutex = NULL;
 
   command = ParseParams(&context);
 
   if (command == COMMAND_COMPRESS || command == COMMAND_DECOMPRESS ||
-      command == COMMAND_TEST_INTEGRITY) {
+      command == COMMAND_TEST_INTEGRITY || command == COMMAND_BENCH ||
+      command == COMMAND_LIST) {
     if (is_ok) {
       size_t modified_path_len =
           context.longest_path_len + strlen(context.suffix) + 1;
@@ -1080,15 +3302,28 @@ int main(int argc, char** argv) {
       PrintVersion();
       break;
 
+    case COMMAND_BENCH:
+      is_ok = BenchFiles(&context);
+      break;
+
     case COMMAND_COMPRESS:
-      is_ok = CompressFiles(&context);
+      is_ok = context.archive ?
+          CompressArchive(&context) : CompressFiles(&context);
       break;
 
     case COMMAND_DECOMPRESS:
+      is_ok = context.archive ?
+          ExtractArchives(&context) : DecompressFiles(&context);
+      break;
+
     case COMMAND_TEST_INTEGRITY:
       is_ok = DecompressFiles(&context);
       break;
 
+    case COMMAND_LIST:
+      is_ok = context.archive ? ListArchives(&context) : ListFiles(&context);
+      break;
+
     case COMMAND_HELP:
     case COMMAND_INVALID:
     default:
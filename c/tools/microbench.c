@@ -0,0 +1,530 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Microbenchmarks for internal encoder and decoder kernels.
+
+   The harness links internal library objects directly. Every kernel is first
+   calibrated, so that a single sample runs for at least the requested time,
+   then warmed up and measured several times; minimum and median time per
+   operation are reported. Kernels that are static inside decode.c can not be
+   called directly; "decode/" entries time a whole BrotliDecoderDecompress of
+   synthetic streams, named after their shape, that are dominated by Huffman
+   header decoding (huffman_headers) or by command processing (the rest). */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/dictionary.h"
+#include "../common/transform.h"
+#include "../dec/huffman.h"
+#include "../enc/bit_cost.h"
+#include "../enc/cluster.h"
+#include "../enc/encoder_dict.h"
+#include "../enc/entropy_encode.h"
+#include "../enc/find_match_length.h"
+#include "../enc/histogram.h"
+#include "../enc/static_dict.h"
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#include "./bench_util.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif  /* WIN32 */
+
+#define DEFAULT_REPETITIONS 10
+#define DEFAULT_WARMUP 2
+#define DEFAULT_SAMPLE_MS 20
+#define MAX_REPETITIONS 1000
+
+#define TEXT_SIZE (256 * 1024)
+#define NUM_HISTOGRAMS 64
+#define HISTOGRAM_CHUNK 512
+#define NUM_MATCH_PROBES 4096
+#define NUM_DICTIONARY_PROBES 256
+#define NUM_WORDS 64
+#define NUM_STREAMS 5
+#define FLUSH_CHUNK 512
+#define MATCH_LIMIT 256
+
+typedef struct {
+  const char* name;
+  const uint8_t* data;
+  size_t size;
+  uint8_t* compressed;
+  size_t compressed_size;
+} Stream;
+
+typedef struct {
+  /* Synthetic inputs */
+  uint8_t text[TEXT_SIZE];
+  size_t word_starts[NUM_DICTIONARY_PROBES];
+  uint8_t mutated[TEXT_SIZE];
+  size_t match_offsets[NUM_MATCH_PROBES];
+
+  /* BrotliBuildHuffmanTable */
+  uint16_t symbol_lists_array[BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1 +
+                              BROTLI_NUM_LITERAL_SYMBOLS];
+  uint16_t code_length_count[BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1];
+  HuffmanCode table[BROTLI_HUFFMAN_MAX_SIZE_258];
+
+  /* BrotliCreateHuffmanTree */
+  uint32_t literal_counts[BROTLI_NUM_LITERAL_SYMBOLS];
+  HuffmanTree tree[2 * BROTLI_NUM_LITERAL_SYMBOLS + 1];
+  uint8_t depth[BROTLI_NUM_LITERAL_SYMBOLS];
+
+  /* BrotliPopulationCost and BrotliHistogramCombine */
+  HistogramLiteral histograms[NUM_HISTOGRAMS];
+  HistogramLiteral out[NUM_HISTOGRAMS];
+  uint32_t cluster_size[NUM_HISTOGRAMS];
+  uint32_t symbols[NUM_HISTOGRAMS];
+  uint32_t clusters[NUM_HISTOGRAMS];
+  HistogramPair pairs[NUM_HISTOGRAMS * NUM_HISTOGRAMS / 2 + 1];
+
+  /* BrotliFindAllStaticDictionaryMatches */
+  BrotliEncoderDictionary encoder_dictionary;
+
+  /* BrotliTransformDictionaryWord */
+  const uint8_t* words[NUM_WORDS];
+  int word_lengths[NUM_WORDS];
+
+  /* Decoder streams */
+  uint8_t repeated[TEXT_SIZE];
+  uint8_t letters[TEXT_SIZE];
+  uint8_t vocabulary[TEXT_SIZE];
+  Stream streams[NUM_STREAMS];
+  uint8_t decoded[TEXT_SIZE];
+} Fixture;
+
+typedef struct {
+  const char* name;
+  /* Description of a single operation. */
+  const char* unit;
+  /* Number of operations performed by one call of |run|. */
+  size_t ops;
+  void (*run)(Fixture* f, const void* arg);
+  const void* arg;
+} Kernel;
+
+/* Prevents the compiler from dropping benchmarked computations. */
+static volatile size_t sink;
+
+static uint32_t Random(uint32_t* seed) {
+  *seed = *seed * 1103515245u + 12345u;
+  return *seed >> 8;
+}
+
+static BROTLI_BOOL PinToCpu(int cpu) {
+#if defined(_WIN32)
+  return SetThreadAffinityMask(GetCurrentThread(),
+                               (DWORD_PTR)1 << cpu) != 0 ?
+      BROTLI_TRUE : BROTLI_FALSE;
+#elif defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET((size_t)cpu, &set);
+  return sched_setaffinity(0, sizeof(set), &set) == 0 ?
+      BROTLI_TRUE : BROTLI_FALSE;
+#else
+  BROTLI_UNUSED(cpu);
+  return BROTLI_FALSE;
+#endif
+}
+
+/* Fills |out| with space-separated static dictionary words, picking among
+   the first |vocabulary| words of each length 4..10. Optionally records
+   positions of the first words. */
+static void MakeWords(uint8_t* out, size_t size, uint32_t vocabulary,
+                      uint32_t seed, size_t* starts, size_t num_starts) {
+  const BrotliDictionary* dictionary = BrotliGetDictionary();
+  size_t pos = 0;
+  size_t num_words = 0;
+  while (pos < size) {
+    uint32_t len = 4 + Random(&seed) % 7;
+    uint32_t count = 1u << dictionary->size_bits_by_length[len];
+    uint32_t idx = Random(&seed) % (vocabulary < count ? vocabulary : count);
+    const uint8_t* word =
+        &dictionary->data[dictionary->offsets_by_length[len] + idx * len];
+    size_t i;
+    if (num_words < num_starts) starts[num_words] = pos;
+    ++num_words;
+    for (i = 0; i < len && pos < size; ++i) out[pos++] = word[i];
+    if (pos < size) out[pos++] = ' ';
+  }
+}
+
+static BROTLI_BOOL Compress(Stream* stream, int quality, size_t flush_chunk) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+  size_t capacity = BrotliEncoderMaxCompressedSize(stream->size) + 1024;
+  size_t available_out = capacity;
+  uint8_t* next_out;
+  const uint8_t* next_in = stream->data;
+  size_t pos = 0;
+  BROTLI_BOOL ok = BROTLI_TRUE;
+  stream->compressed = (uint8_t*)malloc(capacity);
+  if (!s || !stream->compressed) return BROTLI_FALSE;
+  next_out = stream->compressed;
+  BrotliEncoderSetParameter(s, BROTLI_PARAM_QUALITY, (uint32_t)quality);
+  while (ok && !BrotliEncoderIsFinished(s)) {
+    size_t chunk = stream->size - pos < flush_chunk ?
+        stream->size - pos : flush_chunk;
+    size_t available_in = chunk;
+    BrotliEncoderOperation op = pos + chunk == stream->size ?
+        BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+    ok = BrotliEncoderCompressStream(s, op, &available_in, &next_in,
+                                     &available_out, &next_out, NULL);
+    ok = ok && available_in == 0 && !BrotliEncoderHasMoreOutput(s);
+    pos += chunk;
+  }
+  stream->compressed_size = capacity - available_out;
+  BrotliEncoderDestroyInstance(s);
+  return ok;
+}
+
+static BROTLI_BOOL InitFixture(Fixture* f) {
+  const BrotliDictionary* dictionary = BrotliGetDictionary();
+  uint32_t seed = 42;
+  int next_symbol[BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1];
+  uint16_t* symbol_lists =
+      &f->symbol_lists_array[BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1];
+  size_t i;
+
+  MakeWords(f->text, TEXT_SIZE, 1u << 30, 1, f->word_starts,
+            NUM_DICTIONARY_PROBES);
+
+  /* Copy of text with a mutation every 32 bytes on average. */
+  memcpy(f->mutated, f->text, TEXT_SIZE);
+  for (i = 0; i < TEXT_SIZE / 32; ++i) {
+    f->mutated[Random(&seed) % TEXT_SIZE] ^= 0x20;
+  }
+  for (i = 0; i < NUM_MATCH_PROBES; ++i) {
+    f->match_offsets[i] = Random(&seed) % (TEXT_SIZE - MATCH_LIMIT);
+  }
+
+  /* Literal code lengths of the text, as decoder would read them. */
+  memset(f->literal_counts, 0, sizeof(f->literal_counts));
+  for (i = 0; i < TEXT_SIZE; ++i) f->literal_counts[f->text[i]]++;
+  BrotliCreateHuffmanTree(f->literal_counts, BROTLI_NUM_LITERAL_SYMBOLS, 15,
+                          f->tree, f->depth);
+  memset(f->code_length_count, 0, sizeof(f->code_length_count));
+  for (i = 0; i <= BROTLI_HUFFMAN_MAX_CODE_LENGTH; ++i) {
+    next_symbol[i] = (int)i - (BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1);
+    symbol_lists[next_symbol[i]] = 0xFFFF;
+  }
+  for (i = 0; i < BROTLI_NUM_LITERAL_SYMBOLS; ++i) {
+    int len = f->depth[i];
+    if (len == 0) continue;
+    symbol_lists[next_symbol[len]] = (uint16_t)i;
+    next_symbol[len] = (int)i;
+    f->code_length_count[len]++;
+  }
+
+  /* Histograms of chunks with different vocabularies. */
+  for (i = 0; i < TEXT_SIZE; ++i) {
+    f->letters[i] = (uint8_t)('a' + Random(&seed) % 26);
+  }
+  MakeWords(f->vocabulary, TEXT_SIZE, 16, 2, NULL, 0);
+  for (i = 0; i < NUM_HISTOGRAMS; ++i) {
+    const uint8_t* source = (i % 3 == 0) ? f->text :
+        (i % 3 == 1) ? f->letters : f->vocabulary;
+    HistogramClearLiteral(&f->histograms[i]);
+    HistogramAddVectorLiteral(&f->histograms[i],
+                              &source[i * HISTOGRAM_CHUNK], HISTOGRAM_CHUNK);
+    f->histograms[i].bit_cost_ =
+        BrotliPopulationCostLiteral(&f->histograms[i]);
+  }
+
+  BrotliInitEncoderDictionary(&f->encoder_dictionary);
+
+  for (i = 0; i < NUM_WORDS; ++i) {
+    uint32_t len = 4 + (uint32_t)(i % 7);
+    uint32_t idx = Random(&seed) &
+        ((1u << dictionary->size_bits_by_length[len]) - 1);
+    f->words[i] =
+        &dictionary->data[dictionary->offsets_by_length[len] + idx * len];
+    f->word_lengths[i] = (int)len;
+  }
+
+  /* 4 KiB block repeated with rare mutations: long copies. */
+  for (i = 0; i < TEXT_SIZE; ++i) {
+    f->repeated[i] = i < 4096 ? f->text[i] : f->repeated[i - 4096];
+    if (i >= 4096 && Random(&seed) % 1024 == 0) f->repeated[i] ^= 1;
+  }
+
+  f->streams[0].name = "huffman_headers";
+  f->streams[0].data = f->text;
+  f->streams[1].name = "literals";
+  f->streams[1].data = f->letters;
+  f->streams[2].name = "short_copies";
+  f->streams[2].data = f->vocabulary;
+  f->streams[3].name = "long_copies";
+  f->streams[3].data = f->repeated;
+  f->streams[4].name = "dictionary";
+  f->streams[4].data = f->text;
+  for (i = 0; i < NUM_STREAMS; ++i) f->streams[i].size = TEXT_SIZE;
+  /* Flushing every 512 bytes emits a metablock with fresh Huffman codes. */
+  if (!Compress(&f->streams[0], 5, FLUSH_CHUNK)) return BROTLI_FALSE;
+  for (i = 1; i < 4; ++i) {
+    if (!Compress(&f->streams[i], 5, TEXT_SIZE)) return BROTLI_FALSE;
+  }
+  return Compress(&f->streams[4], 9, TEXT_SIZE);
+}
+
+static void RunBuildHuffmanTable(Fixture* f, const void* arg) {
+  uint16_t count[BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1];
+  BROTLI_UNUSED(arg);
+  memcpy(count, f->code_length_count, sizeof(count));
+  sink += BrotliBuildHuffmanTable(f->table, 8,
+      &f->symbol_lists_array[BROTLI_HUFFMAN_MAX_CODE_LENGTH + 1], count);
+}
+
+static void RunDecompress(Fixture* f, const void* arg) {
+  const Stream* stream = (const Stream*)arg;
+  size_t decoded_size = TEXT_SIZE;
+  if (BrotliDecoderDecompress(stream->compressed_size, stream->compressed,
+      &decoded_size, f->decoded) != BROTLI_DECODER_RESULT_SUCCESS ||
+      decoded_size != stream->size) {
+    fprintf(stderr, "failed to decompress %s stream\n", stream->name);
+    exit(1);
+  }
+  sink += f->decoded[decoded_size / 2];
+}
+
+static void RunFindMatchLength(Fixture* f, const void* arg) {
+  size_t total = 0;
+  size_t i;
+  BROTLI_UNUSED(arg);
+  for (i = 0; i < NUM_MATCH_PROBES; ++i) {
+    size_t offset = f->match_offsets[i];
+    total += FindMatchLengthWithLimit(&f->text[offset], &f->mutated[offset],
+                                      MATCH_LIMIT);
+  }
+  sink += total;
+}
+
+static void RunPopulationCost(Fixture* f, const void* arg) {
+  double total = 0.0;
+  size_t i;
+  BROTLI_UNUSED(arg);
+  for (i = 0; i < NUM_HISTOGRAMS; ++i) {
+    total += BrotliPopulationCostLiteral(&f->histograms[i]);
+  }
+  sink += (size_t)total;
+}
+
+static void RunHistogramCombine(Fixture* f, const void* arg) {
+  uint32_t i;
+  BROTLI_UNUSED(arg);
+  memcpy(f->out, f->histograms, sizeof(f->out));
+  for (i = 0; i < NUM_HISTOGRAMS; ++i) {
+    f->cluster_size[i] = 1;
+    f->symbols[i] = i;
+    f->clusters[i] = i;
+  }
+  sink += BrotliHistogramCombineLiteral(f->out, f->cluster_size, f->symbols,
+      f->clusters, f->pairs, NUM_HISTOGRAMS, NUM_HISTOGRAMS,
+      BROTLI_MAX_NUMBER_OF_BLOCK_TYPES,
+      NUM_HISTOGRAMS * NUM_HISTOGRAMS / 2);
+}
+
+static void RunCreateHuffmanTree(Fixture* f, const void* arg) {
+  BROTLI_UNUSED(arg);
+  BrotliCreateHuffmanTree(f->literal_counts, BROTLI_NUM_LITERAL_SYMBOLS, 15,
+                          f->tree, f->depth);
+  sink += f->depth[' '];
+}
+
+static void RunFindAllStaticDictionaryMatches(Fixture* f, const void* arg) {
+  uint32_t matches[BROTLI_MAX_STATIC_DICTIONARY_MATCH_LEN + 1];
+  size_t i;
+  size_t j;
+  BROTLI_UNUSED(arg);
+  for (i = 0; i < NUM_DICTIONARY_PROBES; ++i) {
+    for (j = 0; j <= BROTLI_MAX_STATIC_DICTIONARY_MATCH_LEN; ++j) {
+      matches[j] = kInvalidMatch;
+    }
+    sink += (size_t)BrotliFindAllStaticDictionaryMatches(
+        &f->encoder_dictionary, &f->text[f->word_starts[i]], 4,
+        BROTLI_MAX_STATIC_DICTIONARY_MATCH_LEN, matches);
+  }
+}
+
+static void RunTransformDictionaryWord(Fixture* f, const void* arg) {
+  const BrotliTransforms* transforms = BrotliGetTransforms();
+  uint8_t dst[64];
+  int total = 0;
+  int i;
+  int j;
+  BROTLI_UNUSED(arg);
+  for (i = 0; i < NUM_WORDS; ++i) {
+    for (j = 0; j < (int)transforms->num_transforms; ++j) {
+      total += BrotliTransformDictionaryWord(dst, f->words[i],
+          f->word_lengths[i], transforms, j);
+    }
+  }
+  sink += (size_t)total;
+}
+
+static int CompareDoubles(const void* a, const void* b) {
+  double x = *(const double*)a;
+  double y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static void PrintHelp(const char* name, BROTLI_BOOL error) {
+  FILE* media = error ? stderr : stdout;
+  fprintf(media,
+"Usage: %s [OPTION]...\n"
+"Options:\n"
+"  -c CPU          pin the benchmark thread to CPU\n"
+"  -f NAME         run only kernels whose name contains NAME\n"
+"  -r NUM          measured samples per kernel (default: %d)\n",
+          name, DEFAULT_REPETITIONS);
+  fprintf(media,
+"  -t MS           minimal duration of a sample (default: %d)\n"
+"  -u NUM          warmup samples per kernel (default: %d)\n"
+"  -h              display this help and exit\n",
+          DEFAULT_SAMPLE_MS, DEFAULT_WARMUP);
+}
+
+static BROTLI_BOOL ParseNumber(const char* s, int low, int high, int* out) {
+  char* end;
+  long value = strtol(s, &end, 10);
+  if (end == s || *end != 0 || value < low || value > high) {
+    return BROTLI_FALSE;
+  }
+  *out = (int)value;
+  return BROTLI_TRUE;
+}
+
+int main(int argc, char** argv) {
+  Fixture* f;
+  Kernel kernels[16];
+  size_t num_kernels = 0;
+  double samples[MAX_REPETITIONS];
+  const char* filter = NULL;
+  int repetitions = DEFAULT_REPETITIONS;
+  int warmup = DEFAULT_WARMUP;
+  int sample_ms = DEFAULT_SAMPLE_MS;
+  int cpu = -1;
+  size_t k;
+  int i;
+
+  for (i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    BROTLI_BOOL ok = BROTLI_TRUE;
+    if (strcmp(arg, "-h") == 0) {
+      PrintHelp(argv[0], BROTLI_FALSE);
+      return 0;
+    }
+    if (arg[0] != '-' || arg[1] == 0 || arg[2] != 0 || i + 1 == argc) {
+      PrintHelp(argv[0], BROTLI_TRUE);
+      return 1;
+    }
+    ++i;
+    switch (arg[1]) {
+      case 'c': ok = ParseNumber(argv[i], 0, 1023, &cpu); break;
+      case 'f': filter = argv[i]; break;
+      case 'r': ok = ParseNumber(argv[i], 1, MAX_REPETITIONS, &repetitions);
+        break;
+      case 't': ok = ParseNumber(argv[i], 1, 100000, &sample_ms); break;
+      case 'u': ok = ParseNumber(argv[i], 0, 1000, &warmup); break;
+      default: ok = BROTLI_FALSE; break;
+    }
+    if (!ok) {
+      fprintf(stderr, "invalid option [%s %s]\n", arg, argv[i]);
+      return 1;
+    }
+  }
+
+  if (cpu >= 0 && !PinToCpu(cpu)) {
+    fprintf(stderr, "failed to pin to CPU %d; continuing unpinned\n", cpu);
+  }
+
+  f = (Fixture*)malloc(sizeof(Fixture));
+  if (!f || !InitFixture(f)) {
+    fprintf(stderr, "failed to prepare benchmark inputs\n");
+    return 1;
+  }
+
+#define ADD_KERNEL(NAME, UNIT, OPS, RUN, ARG) {  \
+    kernels[num_kernels].name = NAME;            \
+    kernels[num_kernels].unit = UNIT;            \
+    kernels[num_kernels].ops = OPS;              \
+    kernels[num_kernels].run = RUN;              \
+    kernels[num_kernels].arg = ARG;              \
+    ++num_kernels;                               \
+  }
+  ADD_KERNEL("BrotliBuildHuffmanTable", "256-symbol table", 1,
+             RunBuildHuffmanTable, NULL);
+  ADD_KERNEL("decode/huffman_headers", "256 KiB, 512 B metablocks",
+             1, RunDecompress, &f->streams[0]);
+  ADD_KERNEL("decode/literals", "256 KiB stream", 1,
+             RunDecompress, &f->streams[1]);
+  ADD_KERNEL("decode/short_copies", "256 KiB stream", 1,
+             RunDecompress, &f->streams[2]);
+  ADD_KERNEL("decode/long_copies", "256 KiB stream", 1,
+             RunDecompress, &f->streams[3]);
+  ADD_KERNEL("decode/dictionary", "256 KiB stream", 1,
+             RunDecompress, &f->streams[4]);
+  ADD_KERNEL("FindMatchLengthWithLimit", "call", NUM_MATCH_PROBES,
+             RunFindMatchLength, NULL);
+  ADD_KERNEL("BrotliPopulationCost", "literal histogram", NUM_HISTOGRAMS,
+             RunPopulationCost, NULL);
+  ADD_KERNEL("BrotliHistogramCombine", "64 literal histograms", 1,
+             RunHistogramCombine, NULL);
+  ADD_KERNEL("BrotliCreateHuffmanTree", "256-symbol tree", 1,
+             RunCreateHuffmanTree, NULL);
+  ADD_KERNEL("BrotliFindAllStaticDictionaryMatches", "position",
+             NUM_DICTIONARY_PROBES, RunFindAllStaticDictionaryMatches, NULL);
+  ADD_KERNEL("BrotliTransformDictionaryWord", "transform",
+             NUM_WORDS * BrotliGetTransforms()->num_transforms,
+             RunTransformDictionaryWord, NULL);
+#undef ADD_KERNEL
+
+  fprintf(stdout, "%-40s %12s %12s %8s  %s\n",
+          "kernel", "min ns/op", "median ns/op", "spread", "op");
+  for (k = 0; k < num_kernels; ++k) {
+    const Kernel* kernel = &kernels[k];
+    size_t iterations = 1;
+    size_t j;
+    double min_ns = (double)sample_ms * 1e6;
+    double per_op;
+    if (filter && !strstr(kernel->name, filter)) continue;
+
+    /* Calibrate: double the number of iterations until sample is long. */
+    for (;;) {
+      double start = BrotliBenchNow();
+      for (j = 0; j < iterations; ++j) kernel->run(f, kernel->arg);
+      if (BrotliBenchNow() - start >= min_ns) break;
+      iterations *= 2;
+    }
+    for (i = 0; i < warmup + repetitions; ++i) {
+      double start = BrotliBenchNow();
+      for (j = 0; j < iterations; ++j) kernel->run(f, kernel->arg);
+      if (i >= warmup) samples[i - warmup] = BrotliBenchNow() - start;
+    }
+    qsort(samples, (size_t)repetitions, sizeof(double), CompareDoubles);
+    per_op = (double)iterations * (double)kernel->ops;
+    fprintf(stdout, "%-40s %12.2f %12.2f %7.1f%%  %s\n", kernel->name,
+            samples[0] / per_op, samples[repetitions / 2] / per_op,
+            100.0 * (samples[repetitions - 1] - samples[0]) /
+                samples[repetitions / 2],
+            kernel->unit);
+    fflush(stdout);
+  }
+
+  for (k = 0; k < NUM_STREAMS; ++k) free(f->streams[k].compressed);
+  free(f);
+  return 0;
+}
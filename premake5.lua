@@ -76,3 +76,5 @@ project "brotli"
   linkoptions "-static"
   files { "c/tools/brotli.c" }
   links { "brotlicommon_static", "brotlidec_static", "brotlienc_static" }
+  filter "system:not windows"
+    links "pthread"
@@ -0,0 +1,662 @@
+/* Copyright 2026 Google Inc. All Rights Reserved.
+
+   Distributed under MIT license.
+   See file LICENSE for detail or copy at https://opensource.org/licenses/MIT
+*/
+
+/* Tests of the public encoder and decoder API.
+
+   Usage: api_test [TEST]...
+   With no arguments all tests are run. Buffers are allocated with exactly
+   the size that is passed to the API, so that out-of-bounds accesses are
+   caught by sanitizers. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+
+#define CHECK(EXPR)                                                   \
+  if (!(EXPR)) {                                                      \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+            #EXPR);                                                   \
+    return BROTLI_FALSE;                                              \
+  }
+
+/* Fills |data| with text-like content: words from a small vocabulary mixed
+   with random bytes, so that both matches and literals are produced. */
+static void FillData(uint8_t* data, size_t size, uint32_t seed) {
+  static const char* kWords[] = {
+    "brotli ", "stream ", "window ", "metablock ", "literal ", "copy ",
+    "distance ", "context ", "huffman ", "the ", "of ", "and "
+  };
+  uint32_t state = seed * 2654435761u + 1;
+  size_t pos = 0;
+  while (pos < size) {
+    const char* word;
+    size_t len;
+    state = state * 1103515245u + 12345u;
+    if ((state >> 28) == 0) {
+      data[pos++] = (uint8_t)(state >> 16);
+      continue;
+    }
+    word = kWords[(state >> 16) % (sizeof(kWords) / sizeof(kWords[0]))];
+    len = strlen(word);
+    if (len > size - pos) len = size - pos;
+    memcpy(data + pos, word, len);
+    pos += len;
+  }
+}
+
+/* Allocates at least one byte, so that empty buffers are valid pointers. */
+static uint8_t* Allocate(size_t size) {
+  return (uint8_t*)malloc(size ? size : 1);
+}
+
+/* Decodes |encoded| into exactly |size| bytes and compares with |data|. */
+static BROTLI_BOOL CheckDecoded(const uint8_t* encoded, size_t encoded_size,
+    const uint8_t* data, size_t size) {
+  size_t decoded_size = size;
+  uint8_t* decoded = Allocate(size);
+  BROTLI_BOOL is_ok;
+  CHECK(decoded != NULL);
+  is_ok = TO_BROTLI_BOOL(BrotliDecoderDecompress(encoded_size, encoded,
+      &decoded_size, decoded) == BROTLI_DECODER_RESULT_SUCCESS &&
+      decoded_size == size && memcmp(decoded, data, size) == 0);
+  free(decoded);
+  CHECK(is_ok);
+  return BROTLI_TRUE;
+}
+
+/* One-shot BrotliEncoderCompress reads the input in place for qualities 2 and
+   above; input sizes around 0, the hasher look-ahead and the input block size
+   are checked. */
+static BROTLI_BOOL TestCompressInPlace(void) {
+  static const int kLgwins[] = {10, 22};
+  int quality;
+  size_t i;
+  for (quality = 2; quality <= BROTLI_MAX_QUALITY; ++quality) {
+    for (i = 0; i < sizeof(kLgwins) / sizeof(kLgwins[0]); ++i) {
+      const int lgwin = kLgwins[i];
+      /* Input block size, as chosen by the encoder. */
+      const size_t block = (size_t)1 << (quality < 4 ? 14 :
+          (quality >= 9 && lgwin > 16) ? 18 : 16);
+      const size_t sizes[] = {0, 1, 2, 6, 7, 8, 9, 15,
+          block - 1, block, block + 1, block + 7};
+      size_t j;
+      for (j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j) {
+        const size_t size = sizes[j];
+        size_t encoded_size = BrotliEncoderMaxCompressedSize(size);
+        uint8_t* data = Allocate(size);
+        uint8_t* encoded = Allocate(encoded_size);
+        BROTLI_BOOL is_ok;
+        CHECK(data != NULL && encoded != NULL);
+        FillData(data, size, (uint32_t)quality * 100 + (uint32_t)j);
+        is_ok = BrotliEncoderCompress(quality, lgwin, BROTLI_MODE_GENERIC,
+            size, data, &encoded_size, encoded) &&
+            CheckDecoded(encoded, encoded_size, data, size);
+        free(data);
+        free(encoded);
+        if (!is_ok) {
+          fprintf(stderr, "quality %d, lgwin %d, size %lu\n", quality, lgwin,
+                  (unsigned long)size);
+          return BROTLI_FALSE;
+        }
+      }
+    }
+  }
+  return BROTLI_TRUE;
+}
+
+/* Compresses |data| with the streaming API; |params| holds |num_params|
+   parameter / value pairs. Returns the stream, to be released with free, or
+   NULL if compression fails. */
+static uint8_t* CompressWithParams(const uint32_t* params, size_t num_params,
+    const uint8_t* data, size_t size, size_t* encoded_size) {
+  BrotliEncoderState* s = BrotliEncoderCreateInstance(0, 0, 0);
+  /* Leave room for segment padding and the seek table. */
+  size_t capacity = BrotliEncoderMaxCompressedSize(size) + (size >> 4) + 4096;
+  uint8_t* encoded = Allocate(capacity);
+  size_t available_in = size;
+  const uint8_t* next_in = data;
+  size_t available_out = capacity;
+  uint8_t* next_out = encoded;
+  BROTLI_BOOL is_ok = TO_BROTLI_BOOL(s != NULL && encoded != NULL);
+  size_t i;
+  for (i = 0; is_ok && i < num_params; ++i) {
+    is_ok = BrotliEncoderSetParameter(s,
+        (BrotliEncoderParameter)params[2 * i], params[2 * i + 1]);
+  }
+  while (is_ok && !BrotliEncoderIsFinished(s)) {
+    is_ok = BrotliEncoderCompressStream(s, BROTLI_OPERATION_FINISH,
+        &available_in, &next_in, &available_out, &next_out, NULL);
+    if (available_out == 0) is_ok = BROTLI_FALSE;
+  }
+  if (s) BrotliEncoderDestroyInstance(s);
+  if (!is_ok) {
+    free(encoded);
+    return NULL;
+  }
+  *encoded_size = capacity - available_out;
+  return encoded;
+}
+
+/* Decodes |encoded| without output and reports the stream layout. */
+static BROTLI_BOOL GetStreamInfo(const uint8_t* encoded, size_t encoded_size,
+    BrotliDecoderStreamInfo* info) {
+  BrotliDecoderState* s = BrotliDecoderCreateInstance(0, 0, 0);
+  size_t available_in = encoded_size;
+  const uint8_t* next_in = encoded;
+  size_t available_out = 0;
+  BrotliDecoderResult result;
+  CHECK(s != NULL);
+  BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_VALIDATE_ONLY, 1);
+  result = BrotliDecoderDecompressStream(
+      s, &available_in, &next_in, &available_out, NULL, NULL);
+  BrotliDecoderGetStreamInfo(s, info);
+  BrotliDecoderDestroyInstance(s);
+  CHECK(result == BROTLI_DECODER_RESULT_SUCCESS);
+  return BROTLI_TRUE;
+}
+
+/* Compresses |data| with |params| (see CompressWithParams) and checks that
+   BrotliDecoderDecompressedSize reports |size| for the stream, and a bound of
+   the output for truncated prefixes. |info| is set to the stream layout. */
+static BROTLI_BOOL CheckDecompressedSize(const uint32_t* params,
+    size_t num_params, const uint8_t* data, size_t size,
+    BrotliDecoderStreamInfo* info) {
+  size_t encoded_size = 0;
+  uint8_t* encoded =
+      CompressWithParams(params, num_params, data, size, &encoded_size);
+  size_t decoded_size = 1;
+  BROTLI_BOOL is_ok;
+  size_t i;
+  CHECK(encoded != NULL);
+  is_ok = GetStreamInfo(encoded, encoded_size, info) &&
+      BrotliDecoderDecompressedSize(encoded_size, encoded, &decoded_size) ==
+          BROTLI_DECODER_RESULT_SUCCESS && decoded_size == size;
+  for (i = 1; is_ok && i < 8; ++i) {
+    /* Prefixes of 1/8 .. 7/8 of the stream. */
+    const size_t prefix = encoded_size * i / 8;
+    BrotliDecoderState* s = BrotliDecoderCreateInstance(0, 0, 0);
+    size_t available_in = prefix;
+    const uint8_t* next_in = encoded;
+    size_t available_out = 0;
+    size_t decoded = 0;
+    if (!s) break;
+    BrotliDecoderSetParameter(s, BROTLI_DECODER_PARAM_VALIDATE_ONLY, 1);
+    BrotliDecoderDecompressStream(
+        s, &available_in, &next_in, &available_out, NULL, &decoded);
+    BrotliDecoderDestroyInstance(s);
+    is_ok = TO_BROTLI_BOOL(
+        BrotliDecoderDecompressedSize(prefix, encoded, &decoded_size) ==
+            BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT &&
+        decoded_size >= decoded && decoded_size <= size);
+  }
+  free(encoded);
+  CHECK(is_ok && i == 8);
+  return BROTLI_TRUE;
+}
+
+/* BrotliDecoderDecompressedSize on streams of various layouts. */
+static BROTLI_BOOL TestDecompressedSize(void) {
+  /* Small window forces several compressed metablocks. */
+  static const uint32_t kSmallWindow[] = {
+    BROTLI_PARAM_QUALITY, 5, BROTLI_PARAM_LGWIN, 16
+  };
+  /* Content size block at the start, seek table at the end; segments also
+     end with byte padding metadata blocks. */
+  static const uint32_t kMetadata[] = {
+    BROTLI_PARAM_QUALITY, 5, BROTLI_PARAM_CONTENT_SIZE, 300000,
+    BROTLI_PARAM_SEGMENT_SIZE, 1 << 16
+  };
+  /* Large window stream header; not enabled by default. */
+  static const uint8_t kCorrupted[] = {0x11, 0x16, 0x03};
+  const size_t size = 300000;
+  uint8_t* data = Allocate(size);
+  uint8_t* noise = Allocate(size);
+  uint32_t seed = 1;
+  size_t decoded_size = 1;
+  BrotliDecoderStreamInfo info;
+  BROTLI_BOOL is_ok;
+  size_t i;
+  is_ok = TO_BROTLI_BOOL(data != NULL && noise != NULL);
+  if (is_ok) {
+    FillData(data, size, 39);
+    for (i = 0; i < size; ++i) {
+      seed = seed * 1103515245u + 12345u;
+      noise[i] = (uint8_t)(seed >> 16);
+    }
+  }
+  is_ok = is_ok && CheckDecompressedSize(kSmallWindow, 2, data, size, &info) &&
+      info.num_metablocks > 2 && info.num_uncompressed_metablocks == 0 &&
+      CheckDecompressedSize(kMetadata, 3, data, size, &info) &&
+      info.num_metadata_blocks >= 2 &&
+      /* Incompressible input is stored in uncompressed metablocks. */
+      CheckDecompressedSize(kSmallWindow, 2, noise, size, &info) &&
+      info.num_uncompressed_metablocks > 1;
+  free(data);
+  free(noise);
+  CHECK(is_ok);
+
+  CHECK(BrotliDecoderDecompressedSize(sizeof(kCorrupted), kCorrupted,
+        &decoded_size) == BROTLI_DECODER_RESULT_ERROR);
+  CHECK(decoded_size == 0);
+  return BROTLI_TRUE;
+}
+
+/* BROTLI_PARAM_CONTENT_SIZE and BrotliDecoderPeekContentSize. */
+static BROTLI_BOOL TestContentSize(void) {
+  static const uint32_t kPlain[] = {BROTLI_PARAM_QUALITY, 6};
+  const size_t size = 100000;
+  uint32_t params[] = {BROTLI_PARAM_QUALITY, 6, BROTLI_PARAM_CONTENT_SIZE, 0};
+  uint8_t* data = Allocate(size);
+  uint8_t* plain = NULL;
+  uint8_t* encoded = NULL;
+  uint8_t* too_short = NULL;
+  uint8_t* too_long = NULL;
+  size_t plain_size = 0;
+  size_t encoded_size = 0;
+  size_t unused;
+  uint64_t content_size = 0;
+  BROTLI_BOOL is_ok;
+  CHECK(data != NULL);
+  FillData(data, size, 40);
+
+  plain = CompressWithParams(kPlain, 1, data, size, &plain_size);
+  params[3] = (uint32_t)size;
+  encoded = CompressWithParams(params, 2, data, size, &encoded_size);
+  is_ok = TO_BROTLI_BOOL(plain != NULL && encoded != NULL &&
+      /* The block fits in 20 bytes, and is skipped by decoder. */
+      BrotliDecoderPeekContentSize(20, encoded, &content_size) &&
+      content_size == size &&
+      !BrotliDecoderPeekContentSize(8, encoded, &content_size) &&
+      CheckDecoded(encoded, encoded_size, data, size) &&
+      /* Streams without the block are not mistaken for ones with it. */
+      !BrotliDecoderPeekContentSize(plain_size, plain, &content_size));
+  free(encoded);
+  encoded = NULL;
+
+  /* Encoder rejects input that does not match the declared size. */
+  params[3] = (uint32_t)size + 1;
+  too_short = CompressWithParams(params, 2, data, size, &unused);
+  params[3] = (uint32_t)size - 1;
+  too_long = CompressWithParams(params, 2, data, size, &unused);
+  is_ok = is_ok && too_short == NULL && too_long == NULL;
+  free(too_short);
+  free(too_long);
+
+  /* Zero disables recording; the stream is the same as without the param. */
+  params[3] = 0;
+  encoded = CompressWithParams(params, 2, data, size, &encoded_size);
+  is_ok = is_ok && encoded != NULL && encoded_size == plain_size &&
+      memcmp(encoded, plain, plain_size) == 0;
+  free(encoded);
+  free(plain);
+  free(data);
+  CHECK(is_ok);
+  return BROTLI_TRUE;
+}
+
+#define SEEK_TEST_SIZE 300000
+#define SEEK_TEST_SEGMENT_SIZE 65536
+#define SEEK_TEST_SEGMENTS 5
+
+/* Compresses text into a seekable stream of SEEK_TEST_SEGMENTS segments. */
+static uint8_t* CompressSegmented(uint8_t* data, size_t* encoded_size) {
+  static const uint32_t kParams[] = {
+    BROTLI_PARAM_QUALITY, 5, BROTLI_PARAM_LGWIN, 18,
+    BROTLI_PARAM_SEGMENT_SIZE, SEEK_TEST_SEGMENT_SIZE
+  };
+  FillData(data, SEEK_TEST_SIZE, 41);
+  return CompressWithParams(kParams, 3, data, SEEK_TEST_SIZE, encoded_size);
+}
+
+/* Decodes |encoded| from |segment| with BrotliDecoderSeek and compares the
+   output with |data| from |offset| on. */
+static BROTLI_BOOL CheckSeek(const uint8_t* encoded, size_t encoded_size,
+    const uint8_t* data, const BrotliDecoderSegment* segment, size_t offset) {
+  BrotliDecoderState* s = BrotliDecoderCreateInstance(0, 0, 0);
+  size_t available_in = encoded_size - (size_t)segment->compressed_offset;
+  const uint8_t* next_in = encoded + segment->compressed_offset;
+  size_t available_out = SEEK_TEST_SIZE - offset;
+  uint8_t* decoded = Allocate(available_out);
+  uint8_t* next_out = decoded;
+  size_t total_out = 0;
+  BROTLI_BOOL is_ok = TO_BROTLI_BOOL(s != NULL && decoded != NULL &&
+      BrotliDecoderSeek(s, encoded_size, encoded, segment, offset) &&
+      BrotliDecoderDecompressStream(s, &available_in, &next_in,
+          &available_out, &next_out, &total_out) ==
+              BROTLI_DECODER_RESULT_SUCCESS &&
+      available_out == 0 && total_out == SEEK_TEST_SIZE &&
+      memcmp(decoded, data + offset, SEEK_TEST_SIZE - offset) == 0);
+  if (s) BrotliDecoderDestroyInstance(s);
+  free(decoded);
+  if (!is_ok) {
+    fprintf(stderr, "segment at %lu, offset %lu\n",
+            (unsigned long)segment->uncompressed_offset, (unsigned long)offset);
+  }
+  return is_ok;
+}
+
+/* Checks that BrotliDecoderGetSeekTable rejects |encoded| with |length|
+   bytes at |pos| (counted from the end) set to |value|. */
+static BROTLI_BOOL CheckTamperedSeekTable(const uint8_t* encoded,
+    size_t encoded_size, size_t pos, size_t length, uint8_t value) {
+  uint8_t* tampered = Allocate(encoded_size);
+  size_t num_segments = 0;
+  BROTLI_BOOL is_ok;
+  CHECK(tampered != NULL);
+  memcpy(tampered, encoded, encoded_size);
+  memset(tampered + encoded_size - pos, value, length);
+  is_ok = !BrotliDecoderGetSeekTable(
+      encoded_size, tampered, &num_segments, NULL);
+  free(tampered);
+  CHECK(is_ok);
+  return BROTLI_TRUE;
+}
+
+/* BROTLI_PARAM_SEGMENT_SIZE, BrotliDecoderGetSeekTable and
+   BrotliDecoderSeek. */
+static BROTLI_BOOL TestSeek(void) {
+  /* Tail: segment count, signature, empty last metablock. */
+  const size_t tail = 4 + 4 + 1;
+  const size_t table = SEEK_TEST_SEGMENTS * 16 + tail;
+  uint8_t* data = Allocate(SEEK_TEST_SIZE);
+  uint8_t* encoded;
+  size_t encoded_size = 0;
+  BrotliDecoderSegment segments[SEEK_TEST_SEGMENTS + 1];
+  size_t num_segments = 0;
+  BrotliDecoderState* s;
+  BROTLI_BOOL is_ok;
+  size_t i;
+  CHECK(data != NULL);
+  encoded = CompressSegmented(data, &encoded_size);
+  if (!encoded) free(data);
+  CHECK(encoded != NULL);
+
+  /* Offsets are strictly increasing; segments start at multiples of the
+     segment size. The table is found in the tail of the stream alone. */
+  is_ok = BrotliDecoderGetSeekTable(
+      encoded_size, encoded, &num_segments, NULL) &&
+      num_segments == SEEK_TEST_SEGMENTS;
+  num_segments = SEEK_TEST_SEGMENTS - 1;
+  is_ok = is_ok && !BrotliDecoderGetSeekTable(
+      encoded_size, encoded, &num_segments, segments);
+  num_segments = SEEK_TEST_SEGMENTS + 1;
+  is_ok = is_ok && BrotliDecoderGetSeekTable(
+      table, encoded + encoded_size - table, &num_segments, segments) &&
+      num_segments == SEEK_TEST_SEGMENTS;
+  for (i = 0; is_ok && i < num_segments; ++i) {
+    is_ok = TO_BROTLI_BOOL(segments[i].compressed_offset < encoded_size &&
+        segments[i].uncompressed_offset == i * SEEK_TEST_SEGMENT_SIZE &&
+        (i == 0 ? segments[i].compressed_offset == 0 :
+            segments[i].compressed_offset > segments[i - 1].compressed_offset));
+  }
+
+  /* Decoding from segment boundaries and from the middle of segments. */
+  for (i = 0; is_ok && i < num_segments; ++i) {
+    const size_t start = (size_t)segments[i].uncompressed_offset;
+    is_ok = CheckSeek(encoded, encoded_size, data, &segments[i], start) &&
+        CheckSeek(encoded, encoded_size, data, &segments[i], start + 12345) &&
+        CheckSeek(encoded, encoded_size, data, &segments[i],
+                  i + 1 < num_segments ? start + SEEK_TEST_SEGMENT_SIZE - 1 :
+                                         SEEK_TEST_SIZE - 1);
+  }
+
+  /* Truncated and tampered tables are rejected. */
+  is_ok = is_ok && !BrotliDecoderGetSeekTable(
+      encoded_size - 1, encoded, &num_segments, NULL);
+  is_ok = is_ok && !BrotliDecoderGetSeekTable(
+      table - 1, encoded + encoded_size - table + 1, &num_segments, NULL);
+  /* Signature. */
+  is_ok = is_ok && CheckTamperedSeekTable(encoded, encoded_size, 2, 1, 'X');
+  /* Segment count larger than the stream. */
+  is_ok = is_ok && CheckTamperedSeekTable(encoded, encoded_size, 8, 1, 0x7F);
+  /* Segment count is zero. */
+  is_ok = is_ok && CheckTamperedSeekTable(encoded, encoded_size, 9, 4, 0);
+  /* First entry does not start at 0. */
+  is_ok = is_ok && CheckTamperedSeekTable(encoded, encoded_size,
+      table - 8, 1, 1);
+  /* Second entry has the same compressed offset as the first one. */
+  is_ok = is_ok && CheckTamperedSeekTable(encoded, encoded_size,
+      table - 16, 8, 0);
+  /* Third entry has the same uncompressed offset as the second one. */
+  is_ok = is_ok && CheckTamperedSeekTable(encoded, encoded_size,
+      table - 2 * 16 - 8 - 2, 1, 1);
+
+  /* Offset before the segment start, and an instance that is already used. */
+  s = BrotliDecoderCreateInstance(0, 0, 0);
+  is_ok = is_ok && s != NULL && !BrotliDecoderSeek(s, encoded_size, encoded,
+      &segments[2], segments[2].uncompressed_offset - 1);
+  if (s) BrotliDecoderDestroyInstance(s);
+  s = BrotliDecoderCreateInstance(0, 0, 0);
+  if (is_ok && s != NULL) {
+    size_t available_in = 16;
+    const uint8_t* next_in = encoded;
+    size_t available_out = 0;
+    BrotliDecoderDecompressStream(
+        s, &available_in, &next_in, &available_out, NULL, NULL);
+    is_ok = !BrotliDecoderSeek(s, encoded_size, encoded, &segments[2],
+        segments[2].uncompressed_offset);
+  }
+  if (s) BrotliDecoderDestroyInstance(s);
+
+  free(encoded);
+  free(data);
+  CHECK(is_ok);
+  return BROTLI_TRUE;
+}
+
+/* Allocator that fills memory with garbage, like debug heaps do. */
+static void* GarbageAlloc(void* opaque, size_t size) {
+  void* result = malloc(size);
+  (void)opaque;
+  if (result) memset(result, 0xAA, size);
+  return result;
+}
+
+static void GarbageFree(void* opaque, void* address) {
+  (void)opaque;
+  free(address);
+}
+
+/* BrotliDecoderSeek into a stream that is only flushed, not segmented:
+   references before the seek position read zeros, not stale memory. */
+static BROTLI_BOOL TestSeekDependent(void) {
+  const size_t half = 4096;
+  uint8_t* data = Allocate(2 * half);
+  size_t capacity = BrotliEncoderMaxCompressedSize(2 * half) + 1024;
+  uint8_t* encoded = Allocate(capacity);
+  uint8_t* decoded = Allocate(half);
+  BrotliEncoderState* enc = BrotliEncoderCreateInstance(0, 0, 0);
+  BrotliDecoderState* s =
+      BrotliDecoderCreateInstance(GarbageAlloc, GarbageFree, NULL);
+  BrotliDecoderSegment segment = {0, 0};
+  size_t available_in = half;
+  const uint8_t* next_in = data;
+  size_t available_out = capacity;
+  uint8_t* next_out = encoded;
+  size_t encoded_size = 0;
+  size_t num_zeros = 0;
+  BROTLI_BOOL is_ok = TO_BROTLI_BOOL(data && encoded && decoded && enc && s);
+  size_t i;
+  if (is_ok) {
+    /* The second half repeats the first one, so it is encoded as a copy. */
+    FillData(data, half, 42);
+    memcpy(data + half, data, half);
+    BrotliEncoderSetParameter(enc, BROTLI_PARAM_QUALITY, 5);
+    BrotliEncoderSetParameter(enc, BROTLI_PARAM_LGWIN, 16);
+    is_ok = BrotliEncoderCompressStream(enc, BROTLI_OPERATION_FLUSH,
+        &available_in, &next_in, &available_out, &next_out, NULL) &&
+        available_in == 0 && !BrotliEncoderHasMoreOutput(enc);
+    segment.compressed_offset = (uint64_t)(next_out - encoded);
+    segment.uncompressed_offset = half;
+    available_in = half;
+    is_ok = is_ok && BrotliEncoderCompressStream(enc,
+        BROTLI_OPERATION_FINISH, &available_in, &next_in, &available_out,
+        &next_out, NULL) && BrotliEncoderIsFinished(enc);
+    encoded_size = (size_t)(next_out - encoded);
+  }
+  if (is_ok) {
+    available_in = encoded_size - (size_t)segment.compressed_offset;
+    next_in = encoded + segment.compressed_offset;
+    available_out = half;
+    next_out = decoded;
+    is_ok = BrotliDecoderSeek(s, encoded_size, encoded, &segment, half) &&
+        BrotliDecoderDecompressStream(s, &available_in, &next_in,
+            &available_out, &next_out, NULL) ==
+                BROTLI_DECODER_RESULT_SUCCESS && available_out == 0;
+  }
+  for (i = 0; is_ok && i < half; ++i) {
+    if (decoded[i] == 0) num_zeros++;
+    is_ok = TO_BROTLI_BOOL(decoded[i] == 0 || decoded[i] == data[half + i]);
+  }
+  is_ok = is_ok && num_zeros != 0;
+  if (s) BrotliDecoderDestroyInstance(s);
+  if (enc) BrotliEncoderDestroyInstance(enc);
+  free(decoded);
+  free(encoded);
+  free(data);
+  CHECK(is_ok);
+  return BROTLI_TRUE;
+}
+
+/* Decodes |length| bytes at |offset| with BrotliDecoderDecompressRange and
+   compares them with |data|; the range is clipped at the end of the data. */
+static BROTLI_BOOL CheckRange(const uint8_t* encoded, size_t encoded_size,
+    size_t num_segments, const BrotliDecoderSegment* segments,
+    const uint8_t* data, size_t size, size_t offset, size_t length) {
+  const size_t expected =
+      offset >= size ? 0 : (length < size - offset ? length : size - offset);
+  uint8_t* decoded = Allocate(length);
+  size_t decoded_size = length;
+  BROTLI_BOOL is_ok = TO_BROTLI_BOOL(decoded != NULL &&
+      BrotliDecoderDecompressRange(encoded_size, encoded, num_segments,
+          segments, offset, &decoded_size, decoded) ==
+              BROTLI_DECODER_RESULT_SUCCESS &&
+      decoded_size == expected &&
+      memcmp(decoded, data + offset, expected) == 0);
+  free(decoded);
+  if (!is_ok) {
+    fprintf(stderr, "range at %lu, length %lu\n", (unsigned long)offset,
+            (unsigned long)length);
+  }
+  return is_ok;
+}
+
+/* BrotliDecoderDecompressRange with embedded and separate seek tables. */
+static BROTLI_BOOL TestDecompressRange(void) {
+  static const uint32_t kPlain[] = {BROTLI_PARAM_QUALITY, 5};
+  static const size_t kRanges[][2] = {
+    /* Within the first and a middle segment. */
+    {1000, 5000}, {2 * SEEK_TEST_SEGMENT_SIZE + 7, 100},
+    /* Whole segment, and across segment boundaries. */
+    {SEEK_TEST_SEGMENT_SIZE, SEEK_TEST_SEGMENT_SIZE},
+    {SEEK_TEST_SEGMENT_SIZE - 100, 200}, {10, 3 * SEEK_TEST_SEGMENT_SIZE},
+    /* Empty range, range running past the end, at and past the end. */
+    {12345, 0}, {SEEK_TEST_SIZE - 10, 100}, {SEEK_TEST_SIZE, 100},
+    {SEEK_TEST_SIZE + 100, 100}
+  };
+  const size_t num_ranges = sizeof(kRanges) / sizeof(kRanges[0]);
+  static const BrotliDecoderSegment kStart = {0, 0};
+  uint8_t* data = Allocate(SEEK_TEST_SIZE);
+  uint8_t* encoded;
+  uint8_t* plain;
+  size_t encoded_size = 0;
+  size_t plain_size = 0;
+  BrotliDecoderSegment segments[SEEK_TEST_SEGMENTS];
+  size_t num_segments = SEEK_TEST_SEGMENTS;
+  uint8_t byte;
+  size_t length = 1;
+  BROTLI_BOOL is_ok;
+  size_t i;
+  CHECK(data != NULL);
+  encoded = CompressSegmented(data, &encoded_size);
+  plain = CompressWithParams(kPlain, 1, data, SEEK_TEST_SIZE, &plain_size);
+  is_ok = TO_BROTLI_BOOL(encoded != NULL && plain != NULL &&
+      BrotliDecoderGetSeekTable(encoded_size, encoded, &num_segments,
+                                segments));
+
+  for (i = 0; is_ok && i < num_ranges; ++i) {
+    is_ok = CheckRange(encoded, encoded_size, 0, NULL, data, SEEK_TEST_SIZE,
+                       kRanges[i][0], kRanges[i][1]) &&
+        CheckRange(encoded, encoded_size, num_segments, segments, data,
+                   SEEK_TEST_SIZE, kRanges[i][0], kRanges[i][1]);
+  }
+
+  /* Input that ends before the range does; the output is still valid. */
+  if (is_ok) {
+    uint8_t* decoded = Allocate(SEEK_TEST_SEGMENT_SIZE);
+    length = SEEK_TEST_SEGMENT_SIZE;
+    is_ok = TO_BROTLI_BOOL(decoded != NULL && BrotliDecoderDecompressRange(
+        (size_t)segments[3].compressed_offset - 100, encoded, num_segments,
+        segments, 2 * SEEK_TEST_SEGMENT_SIZE, &length, decoded) ==
+            BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT &&
+        length < SEEK_TEST_SEGMENT_SIZE &&
+        memcmp(decoded, data + 2 * SEEK_TEST_SEGMENT_SIZE, length) == 0);
+    free(decoded);
+  }
+
+  /* Plain streams have no embedded table; with a single entry table, that
+     could always be made up, they are decoded from the start. */
+  length = 1;
+  is_ok = is_ok && BrotliDecoderDecompressRange(plain_size, plain, 0, NULL,
+      0, &length, &byte) == BROTLI_DECODER_RESULT_ERROR && length == 0;
+  for (i = 0; is_ok && i < num_ranges; ++i) {
+    is_ok = CheckRange(plain, plain_size, 1, &kStart, data, SEEK_TEST_SIZE,
+                       kRanges[i][0], kRanges[i][1]);
+  }
+
+  free(encoded);
+  free(plain);
+  free(data);
+  CHECK(is_ok);
+  return BROTLI_TRUE;
+}
+
+typedef struct {
+  const char* name;
+  BROTLI_BOOL (*func)(void);
+} Test;
+
+static const Test kTests[] = {
+  {"compress_in_place", TestCompressInPlace},
+  {"decompressed_size", TestDecompressedSize},
+  {"content_size", TestContentSize},
+  {"seek", TestSeek},
+  {"seek_dependent", TestSeekDependent},
+  {"decompress_range", TestDecompressRange}
+};
+
+int main(int argc, char** argv) {
+  const size_t num_tests = sizeof(kTests) / sizeof(kTests[0]);
+  int failures = 0;
+  size_t i;
+  int j;
+  for (j = 1; j < argc; ++j) {
+    for (i = 0; i < num_tests; ++i) {
+      if (strcmp(argv[j], kTests[i].name) == 0) break;
+    }
+    if (i == num_tests) {
+      fprintf(stderr, "unknown test: [%s]\n", argv[j]);
+      return 1;
+    }
+  }
+  for (i = 0; i < num_tests; ++i) {
+    BROTLI_BOOL selected = TO_BROTLI_BOOL(argc < 2);
+    for (j = 1; j < argc; ++j) {
+      if (strcmp(argv[j], kTests[i].name) == 0) selected = BROTLI_TRUE;
+    }
+    if (!selected) continue;
+    if (kTests[i].func()) {
+      fprintf(stderr, "[ OK ] %s\n", kTests[i].name);
+    } else {
+      fprintf(stderr, "[FAIL] %s\n", kTests[i].name);
+      failures++;
+    }
+  }
+  return failures ? 1 : 0;
+}
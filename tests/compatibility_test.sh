@@ -21,5 +21,7 @@ for file in tests/testdata/*.compressed*; do
   # Test the streaming version
   cat $file | $BROTLI -dc > $uncompressed
   diff -q $uncompressed $expected
+  # Test the validate-only mode
+  $BROTLI -t $file
   rm -f $uncompressed
 done
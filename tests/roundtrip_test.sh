@@ -30,5 +30,43 @@ for file in $INPUTS; do
     # Test the streaming version
     cat $file | $BROTLI -cq $quality | $BROTLI -cd >$uncompressed
     diff -q $file $uncompressed
+    # Test the streaming version with background I/O threads
+    cat $file | $BROTLI --async-io -cq $quality | \
+        $BROTLI --async-io -cd >$uncompressed
+    diff -q $file $uncompressed
+    # Test the multithreaded (seekable) version
+    $BROTLI -fq $quality --segment=16 -T 3 $file -o $compressed
+    $BROTLI $compressed -fdo $uncompressed -T 3
+    diff -q $file $uncompressed
+    # Test that listing reports the original size
+    $BROTLI -l $compressed | grep -q " $(wc -c < $file | tr -d ' ') "
   done
 done
+
+echo "Roundtrip testing solid archive"
+archive=${TMP_DIR}/archive.br
+uncompressed=${TMP_DIR}/archive.unbr
+$BROTLI --archive -fq 9 -o $archive $INPUTS
+$BROTLI --archive -l $archive
+$BROTLI -dc $archive >$uncompressed
+cat $INPUTS | cmp - $uncompressed
+for file in $INPUTS; do
+  $BROTLI --archive -d --member=$file -fo $uncompressed $archive
+  diff -q $file $uncompressed
+done
+# Files are extracted to stored names, relative to the current directory;
+# leading separators are not stored.
+root=$(pwd)
+rm -rf ${TMP_DIR}/extracted
+mkdir ${TMP_DIR}/extracted
+$BROTLI --archive -fq 1 -o $archive $(for file in $INPUTS; do
+  echo $root/$file; done)
+(cd ${TMP_DIR}/extracted && ${BROTLI_WRAPPER} $root/bin/brotli --archive \
+    -d $root/$archive)
+for file in $INPUTS; do
+  diff -q $file ${TMP_DIR}/extracted/${root#/}/$file
+done
+# Names that could point outside of the current directory are rejected.
+if $BROTLI --archive -fo $archive tests/../tests/testdata/alice29.txt; then
+  exit 1
+fi
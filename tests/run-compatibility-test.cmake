@@ -12,6 +12,14 @@ if(result)
   message(FATAL_ERROR "Decompression failed")
 endif()
 
+execute_process(
+  WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --test ${INPUT}
+  RESULT_VARIABLE result)
+if(result)
+  message(FATAL_ERROR "Integrity test failed")
+endif()
+
 function(test_file_equality f1 f2)
   if(NOT CMAKE_VERSION VERSION_LESS 2.8.7)
     file(SHA512 "${f1}" f1_cs)
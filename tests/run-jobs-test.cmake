@@ -0,0 +1,38 @@
+set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
+
+# Files are compressed one by one, and then concurrently (--jobs); outputs
+# should be the same. Inputs are copied, as outputs are written next to them.
+string(REPLACE "|" ";" INPUTS "${INPUTS}")
+file(REMOVE_RECURSE "${OUTPUT}")
+file(MAKE_DIRECTORY "${OUTPUT}")
+set(FILES)
+foreach(INPUT ${INPUTS})
+  get_filename_component(NAME "${INPUT}" NAME)
+  configure_file("${INPUT}" "${OUTPUT}/${NAME}" COPYONLY)
+  list(APPEND FILES "${OUTPUT}/${NAME}")
+endforeach()
+
+execute_process(
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --quality=${QUALITY} --suffix=.seq ${FILES}
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Compression failed: ${result_stderr}")
+endif()
+
+execute_process(
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --quality=${QUALITY} --jobs=${JOBS} --suffix=.par ${FILES}
+  RESULT_VARIABLE result
+  ERROR_VARIABLE result_stderr)
+if(result)
+  message(FATAL_ERROR "Concurrent compression failed: ${result_stderr}")
+endif()
+
+foreach(FILE ${FILES})
+  execute_process(
+    COMMAND ${CMAKE_COMMAND} -E compare_files "${FILE}.seq" "${FILE}.par"
+    RESULT_VARIABLE result)
+  if(result)
+    message(FATAL_ERROR "Outputs do not match for ${FILE}")
+  endif()
+endforeach()
@@ -1,8 +1,22 @@
 set(ENV{QEMU_LD_PREFIX} "${BROTLI_WRAPPER_LD_PREFIX}")
 
+# Optional: multithreaded (seekable) roundtrip with the given segment size.
+set(EXTRA_ARGS)
+set(DECOMPRESS_ARGS)
+if(THREADS)
+  set(EXTRA_ARGS --threads=${THREADS} --segment=${SEGMENT})
+  set(DECOMPRESS_ARGS --threads=${THREADS})
+endif()
+
+# Optional: solid archive; the file is extracted from it by name.
+if(ARCHIVE)
+  set(EXTRA_ARGS --archive)
+  set(DECOMPRESS_ARGS --archive --member=${INPUT})
+endif()
+
 execute_process(
   WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
-  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=${QUALITY} ${INPUT} --output=${OUTPUT}.br
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --quality=${QUALITY} ${EXTRA_ARGS} ${INPUT} --output=${OUTPUT}.br
   RESULT_VARIABLE result
   ERROR_VARIABLE result_stderr)
 if(result)
@@ -11,7 +25,7 @@ endif()
 
 execute_process(
   WORKING_DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}"
-  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --decompress ${OUTPUT}.br --output=${OUTPUT}.unbr
+  COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --force --decompress ${DECOMPRESS_ARGS} ${OUTPUT}.br --output=${OUTPUT}.unbr
   RESULT_VARIABLE result)
 if(result)
   message(FATAL_ERROR "Decompression failed")
@@ -34,3 +48,19 @@ function(test_file_equality f1 f2)
 endfunction()
 
 test_file_equality("${INPUT}" "${OUTPUT}.unbr")
+
+# Archive is also extracted to the stored name, that is relative to the
+# current directory; missing directories are created.
+if(ARCHIVE)
+  file(REMOVE_RECURSE "${OUTPUT}.d")
+  file(MAKE_DIRECTORY "${OUTPUT}.d")
+  execute_process(
+    WORKING_DIRECTORY "${OUTPUT}.d"
+    COMMAND ${BROTLI_WRAPPER} ${BROTLI_CLI} --decompress --archive ${OUTPUT}.br
+    RESULT_VARIABLE result)
+  if(result)
+    message(FATAL_ERROR "Extraction failed")
+  endif()
+  string(REGEX REPLACE "^([A-Za-z]:)?[/\\]+" "" STORED_NAME "${INPUT}")
+  test_file_equality("${INPUT}" "${OUTPUT}.d/${STORED_NAME}")
+endif()